@@ -25,17 +25,34 @@
 
     /* device type for systemd filtering */
     #define SEARCH_DEVICE_TYPE "usb"
+    #define USB_DEVICE_DEVTYPE "usb_device"
 
     /* file format and read mode */
     #define FILE_SEPARATOR ";"
+    #define FIELD_SEPARATOR ';'
+    #define LINE_SEPARATOR '\n'
+    #define FIELDS_PER_LINE 4
     #define FILE_TYPE_SEPARATOR "."
     #define FILE_TYPE "csv"
     #define FILE_TYPE_PLUS_SEPARATOR ".csv"
     #define READ_MODE "r"
-    #define OPEN_READ_WRITE_MODE "w+"
+    #define WRITE_MODE "w"
+    #define WRITE_BINARY_MODE "wb"
     
     /* default database file path */
     #define DATA_FILE_PATH "data-files/vendor_id_product_id_and_name.csv"
+
+    /* compiled database image (built with --compile-db) */
+    #define DATA_IMAGE_PATH "data-files/vendor_id_product_id_and_name.db"
+    #define DATA_IMAGE_TEMP_PATH "data-files/vendor_id_product_id_and_name.db.tmp"
+    #define DB_IMAGE_MAGIC "DRUIDDB"
+    #define DB_IMAGE_MAGIC_SIZE 8
+    #define DB_IMAGE_VERSION 4
+    #define DB_IMAGE_ALIGNMENT 8
+    #define ID_FLAG_VENDOR 0x1
+    #define ID_FLAG_PRODUCT 0x2
+    #define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+    #define FNV_PRIME 0x100000001b3ULL
     
     /* paths to cli info/help files */
     #define HELP_FILE "src/INFO_FILE/HELP"
@@ -47,6 +64,46 @@
     #define VENDOR_NAME "ID_VENDOR"
     #define PRODUCT_ID "ID_MODEL_ID"
     #define PRODUCT_NAME "ID_MODEL"
+    #define SERIAL_NUMBER "ID_SERIAL_SHORT"
+
+    /* usb enumeration backends (--backend, --sysfs-root, --devices, --replay) */
+    #define USB_BACKEND_SYSTEMD 0
+    #define USB_BACKEND_SYSFS 1
+    #define USB_BACKEND_DEVICE_LIST 2
+    #define USB_BACKEND_REPLAY 3
+    #define USB_BACKEND_COUNT 4
+    #define USB_BACKEND_SYSTEMD_NAME "systemd"
+    #define USB_BACKEND_SYSFS_NAME "sysfs"
+
+    /* device properties read through a backend (device list field order) */
+    #define USB_PROPERTY_VENDOR_ID 0
+    #define USB_PROPERTY_VENDOR_NAME 1
+    #define USB_PROPERTY_PRODUCT_ID 2
+    #define USB_PROPERTY_PRODUCT_NAME 3
+    #define USB_PROPERTY_SERIAL 4
+    #define USB_PROPERTY_PATH 5
+    #define USB_PROPERTY_COUNT 6
+
+    /* sysfs backend: default root, usb device directory and attribute files */
+    #define SYSFS_DEFAULT_ROOT "/sys"
+    #define SYSFS_USB_DEVICES_PATH "bus/usb/devices"
+    #define SYSFS_ATTRIBUTE_COUNT USB_PROPERTY_PATH
+    #define SYSFS_VALUE_SIZE 512
+
+    /* device list backend: comment lines */
+    #define DEVICE_LIST_COMMENT '#'
+
+    /* replay backend: udevadm info --export-db records and lsusb lines */
+    #define REPLAY_STDIN "-"
+    #define REPLAY_BUFFER_SIZE (1 << 20)
+    #define REPLAY_VALUE_SIZE 512
+    #define REPLAY_DEVICE_PREFIX "P: "
+    #define REPLAY_PROPERTY_PREFIX "E: "
+    #define REPLAY_PREFIX_SIZE 3
+    #define REPLAY_DEVTYPE_KEY "DEVTYPE"
+    #define REPLAY_LSUSB_PREFIX "Bus "
+    #define REPLAY_LSUSB_ID ": ID "
+    #define REPLAY_LSUSB_ID_SIZE 9
 
     /* cli flag macros */
     #define HELP_FLAG "-h"
@@ -54,29 +111,131 @@
     #define LICENSE_FLAG "-l"
     #define UPDATE_FLAG "-u"
     #define OUTPUT_FLAG "-o"
+    #define COMPILE_DB_FLAG "-c"
+    #define JOBS_FLAG "-j"
+    #define VENDOR_FLAG "-v"
+    #define ENGINE_FLAG "-e"
+    #define WATCH_FLAG "-w"
+    #define BACKEND_FLAG "-b"
+    #define SYSFS_ROOT_FLAG "-s"
+    #define DEVICE_LIST_FLAG "-d"
+    #define REPLAY_FLAG "-r"
+    #define PER_PORT_FLAG "-p"
+    #define FLEET_FLAG "-F"
+    #define QUERY_FLAG "-q"
+    #define READ_REPORT_FLAG "-R"
+    #define JOURNAL_FLAG "-J"
     #define HELP_FLAG_OPTION "--help"
     #define FORMAT_FLAG_OPTION "--format"
     #define LICENSE_FLAG_OPTION "--license"
     #define UPDATE_FLAG_OPTION "--update"
     #define OUTPUT_FLAG_OPTION "--output"
+    #define COMPILE_DB_FLAG_OPTION "--compile-db"
+    #define JOBS_FLAG_OPTION "--jobs"
+    #define VENDOR_FLAG_OPTION "--vendor"
+    #define ENGINE_FLAG_OPTION "--engine"
+    #define WATCH_FLAG_OPTION "--watch"
+    #define BACKEND_FLAG_OPTION "--backend"
+    #define SYSFS_ROOT_FLAG_OPTION "--sysfs-root"
+    #define DEVICE_LIST_FLAG_OPTION "--devices"
+    #define REPLAY_FLAG_OPTION "--replay"
+    #define PER_PORT_FLAG_OPTION "--per-port"
+    #define FLEET_FLAG_OPTION "--fleet"
+    #define QUERY_FLAG_OPTION "--query"
+    #define READ_REPORT_FLAG_OPTION "--read-report"
+    #define JOURNAL_FLAG_OPTION "--journal"
+    #define FORMAT_OUTPUT_FLAG_OPTION "--format-output"
+    #define FORMAT_OUTPUT_FLAG_SEPARATOR '='
+    #define METRICS_FILE_FLAG_OPTION "--metrics-file"
+    #define METRICS_FILE_FLAG_SEPARATOR '='
 
     /* default messages */
     #define UNKNOWN_DEVICE_MESSAGE "Unknown"
     #define UNKNOWN_FILE_TYPE_MESSAGE "Error: unknown file type. Should be a csv file.\n"
     #define UNKNOWN_FILE_MESSAGE "Error: unknown file.\n"
+    #define DATABASE_TOO_LARGE_MESSAGE "Error: database files exceed 4 GiB.\n"
+    #define COMPILE_DB_UP_TO_DATE_MESSAGE "Database image is up to date: %s\n"
+    #define COMPILE_DB_DONE_MESSAGE "Database image written: %s (%lu entries)\n"
+    #define COMPILE_DB_ERROR_MESSAGE "Error: cannot write database image.\n"
+    #define EMBEDDED_DB_COMPILE_MESSAGE "Error: this binary embeds its database, there is nothing to compile.\n"
+    #define INVALID_JOBS_MESSAGE "Error: --jobs expects a worker count between 1 and %d.\n"
+    #define INVALID_ENGINE_MESSAGE "Error: --engine expects hash or eytzinger.\n"
+    #define INVALID_FORMAT_OUTPUT_MESSAGE "Error: --format-output expects json, ndjson or binary.\n"
+    #define INVALID_VENDOR_MESSAGE "Error: --vendor expects a 4 digit hexadecimal vendor id.\n"
+    #define UNKNOWN_VENDOR_MESSAGE "Error: vendor %04x is not in the database.\n"
+    #define VENDOR_HEADER_MESSAGE "Vendor %04x: %.*s (%lu products)\n"
+    #define VENDOR_PRODUCT_MESSAGE "    %04x  %.*s\n"
+    #define WATCH_STARTED_MESSAGE "Watching USB hotplug events, press Ctrl+C to stop.\n\n"
+    #define WATCH_REMOVED_MESSAGE "USB device removed: %s:%s (%s)\n\n"
+    #define WATCH_ERROR_MESSAGE "Error: cannot watch USB hotplug events.\n"
+    #define INVALID_BACKEND_MESSAGE "Error: --backend expects systemd or sysfs.\n"
+    #define INVALID_SYSFS_ROOT_MESSAGE "Error: --sysfs-root expects a directory.\n"
+    #define SYSFS_ERROR_MESSAGE "Error: cannot read USB devices under %s.\n"
+    #define INVALID_DEVICE_LIST_MESSAGE "Error: --devices expects a device list file.\n"
+    #define DEVICE_LIST_ERROR_MESSAGE "Error: cannot read the device list %s.\n"
+    #define INVALID_REPLAY_MESSAGE "Error: --replay expects a udevadm or lsusb dump file.\n"
+    #define REPLAY_ERROR_MESSAGE "Error: cannot read the dump %s.\n"
+    #define FLEET_ERROR_MESSAGE "Error: cannot read the host snapshots under %s.\n"
+    #define READ_REPORT_ERROR_MESSAGE "Error: %s is not a readable druid report.\n"
+    #define READ_REPORT_DIRECTORY_ERROR_MESSAGE "Error: cannot read the reports under %s.\n"
+    #define JOURNAL_DROPPED_MESSAGE "Warning: %lu journal entries were dropped.\n"
+    #define INVALID_OUTPUT_MESSAGE "Error: --output expects a file path.\n"
+    #define INVALID_METRICS_FILE_MESSAGE "Error: --metrics-file expects a file path.\n"
+    #define METRICS_FILE_ERROR_MESSAGE "Error: cannot write the metrics file %s.\n"
+    #define DRUIDD_STARTED_MESSAGE "druidd: %lu entries loaded, listening on %s\n"
+    #define DRUIDD_SOCKET_ERROR_MESSAGE "Error: cannot listen on %s (is another druidd running?).\n"
+    #define DRUIDD_USAGE_MESSAGE "Usage: druidd [-u file] [-j count] [-e engine] [-b backend] [-p]\n"
+    #define BENCH_DELIMITERS_MESSAGE "delimiter scan of a %.1f MB generated csv (fastest of %d passes)\n"
+    #define BENCH_RATE_FORMAT "  %-20s %7.2f GB/s %12lu found\n"
+    #define BENCH_UNSUPPORTED_FORMAT "  %-20s not supported by this cpu\n"
+    #define BENCH_LOOKUPS_MESSAGE "%lu mixed hit/miss lookups in %lu database rows (fastest of %d passes, linear once)\n"
+    #define BENCH_LOOKUP_FORMAT "  %-20s %9.1f ns/lookup %9lu known %9lu vendor only %9lu unknown\n"
+    #define BENCH_USAGE_MESSAGE "Usage: druid-bench [-e engine]\n"
+    #define INVALID_QUERY_MESSAGE "Error: --query expects a vendor:product id pair (e.g. 046d:c52b).\n"
+    #define QUERY_CONNECT_ERROR_MESSAGE "Error: cannot reach druidd on %s.\n"
+    #define QUERY_PROTOCOL_ERROR_MESSAGE "Error: unexpected answer from druidd.\n"
+    #define QUERY_SERVER_ERROR_MESSAGE "Error: druidd: %s.\n"
 
+    #include <stdbool.h>
     #include <stddef.h>
+    #include <stdint.h>
+    #include <time.h>
+    #include <dirent.h>
+    #include <pthread.h>
     #include <systemd/sd-device.h>
+    #include <systemd/sd-event.h>
+    #include "libdruid.h"
 
 /**
- * @brief represents a single entry in the usb device database
+ * @brief view on one field of the database text (not null-terminated)
 */
-typedef struct usb_db_entry_s {
-    char *vendor_id;
-    char *vendor_name;
-    char *product_id;
-    char *product_name;
-} usb_db_entry_t;
+typedef struct usb_db_field_s {
+    uint32_t offset;
+    uint32_t length;
+} usb_db_field_t;
+
+/**
+ * @brief usb device database rows as parallel arrays (struct of arrays):
+ * ids are parsed once to integers, names are views into the text blob
+ * (id_flags tells which ids were valid hexadecimal in the source)
+*/
+typedef struct usb_db_columns_s {
+    uint16_t *vendor_ids;
+    uint16_t *product_ids;
+    uint8_t *id_flags;
+    usb_db_field_t *vendor_names;
+    usb_db_field_t *product_names;
+} usb_db_columns_t;
+
+/**
+ * @brief database names of a matched entry, decoded for display
+*/
+typedef struct usb_db_names_s {
+    const char *vendor_name;
+    int vendor_name_length;
+    const char *product_name;
+    int product_name_length;
+} usb_db_names_t;
 
 /**
  * @brief stores information about a connected usb device
@@ -87,81 +246,979 @@ typedef struct data_usb_con_s {
     const char *product_id;
     const char *product_name;
     const char *path_usb;
+    const char *serial;
+    int hub_depth;
 } usb_device_info_t;
 
 /**
- * @brief holds systemd usb device enumeration tools
+ * @brief state of the sysfs backend: the usb device directory, the
+ * current device name and the attributes read for it
+*/
+typedef struct usb_sysfs_s {
+    DIR *devices;
+    const char *name;
+    char values[SYSFS_ATTRIBUTE_COUNT][SYSFS_VALUE_SIZE];
+} usb_sysfs_t;
+
+/**
+ * @brief state of the device list backend: the file, streamed one line
+ * at a time, and the fields of the current line
+*/
+typedef struct usb_device_list_s {
+    FILE *file;
+    char *line;
+    size_t line_size;
+    const char *fields[USB_PROPERTY_COUNT];
+} usb_device_list_t;
+
+/**
+ * @brief state of the replay backend: the dump, read in REPLAY_BUFFER_SIZE
+ * chunks (unread bytes between start and end), and the values of the
+ * current record, indexed by USB_PROPERTY_*
+*/
+typedef struct usb_replay_s {
+    int fd;
+    char *buffer;
+    size_t start;
+    size_t end;
+    bool eof;
+    bool skip_line;
+    char values[USB_PROPERTY_COUNT][REPLAY_VALUE_SIZE];
+} usb_replay_t;
+
+typedef struct usb_backend_s usb_backend_t;
+
+/**
+ * @brief holds usb device enumeration tools (state of every backend,
+ * only the one behind the backend operations is used)
 */
 typedef struct usb_tools_s {
     sd_device *device;
     sd_device_enumerator *enumerator;
+    const usb_backend_t *backend;
+    usb_sysfs_t sysfs;
+    usb_device_list_t device_list;
+    usb_replay_t replay;
 } usb_tools_t;
 
+/**
+ * @brief operations of a usb enumeration backend: first and next move to
+ * a device (SUCCESS, or UNSEEN at the end), get_property reads one
+ * USB_PROPERTY_* of the current device (NULL if unknown)
+*/
+struct usb_backend_s {
+    int (*open)(usb_tools_t *usb_tools, const char *source);
+    int (*first)(usb_tools_t *usb_tools);
+    int (*next)(usb_tools_t *usb_tools);
+    const char *(*get_property)(usb_tools_t *usb_tools, int property);
+    void (*close)(usb_tools_t *usb_tools);
+};
+
     /* initial allocation size for database entries */
     #define DEFAULT_SIZE 10
     #define INCREASED_SIZE 2
 
+    /* database source files mapped into the text region (update + data) */
+    #define MAX_DB_SOURCES 2
+
+/**
+ * @brief one CSV file mapped in the database text region
+*/
+typedef struct usb_db_source_s {
+    size_t offset;
+    size_t size;
+} usb_db_source_t;
+
+    /* delimiter scan block size (one mask bit per byte) */
+    #define SCAN_BLOCK_SIZE 64
+
+    /* delimiter scan kernels, slowest first */
+    #define SCAN_KERNEL_SCALAR 0
+    #define SCAN_KERNEL_SSE2 1
+    #define SCAN_KERNEL_AVX2 2
+    #define SCAN_KERNEL_COUNT 3
+
+/**
+ * @brief separator positions in one scanned block, one bit per byte
+*/
+typedef struct usb_db_delimiters_s {
+    uint64_t fields;
+    uint64_t lines;
+} usb_db_delimiters_t;
+
+/**
+ * @brief delimiter scan kernel (scalar, SSE2 or AVX2) reading SCAN_BLOCK_SIZE bytes
+*/
+typedef usb_db_delimiters_t (*usb_db_scan_block_t)(const char *block);
+
+/**
+ * @brief state of the CSV parser between two delimiters
+*/
+typedef struct usb_db_parser_s {
+    size_t line_start;
+    size_t field_start;
+    size_t field;
+    usb_db_field_t fields[FIELDS_PER_LINE];
+} usb_db_parser_t;
+
+    /* parallel ingestion: worker limit and smallest chunk worth a worker */
+    #define MAX_JOBS 64
+    #define MIN_CHUNK_SIZE (1 << 20)
+
+/**
+ * @brief newline-aligned slice of the database text parsed by one worker
+*/
+typedef struct usb_db_chunk_s {
+    size_t start;
+    size_t end;
+    usb_db_columns_t columns;
+    size_t count;
+    int status;
+} usb_db_chunk_t;
+
+/**
+ * @brief state shared by the parser workers (chunks are taken in turn)
+*/
+typedef struct usb_db_ingest_s {
+    const char *text;
+    usb_db_chunk_t *chunks;
+    size_t chunk_count;
+    size_t next_chunk;
+    usb_db_scan_block_t scan_block;
+} usb_db_ingest_t;
+
+    /* hash index sizing (slots per entry) and id format */
+    #define INDEX_LOAD_FACTOR 2
+    #define EMPTY_SLOT 0
+    #define HEX_ID_LENGTH 4
+    #define HEX_BASE 16
+
+    /* lookup match levels */
+    #define MATCH_NONE 0
+    #define MATCH_VENDOR_ONLY 1
+    #define MATCH_VENDOR_AND_PRODUCT 2
+
+/**
+ * @brief single slot of the open-addressing lookup index
+ * (entry holds the database row index + 1, 0 marks an empty slot)
+*/
+typedef struct usb_db_slot_s {
+    uint32_t key;
+    uint32_t entry;
+} usb_db_slot_t;
+
+/**
+ * @brief open-addressing hash index over packed vendor/product ids
+*/
+typedef struct usb_db_index_s {
+    usb_db_slot_t *products;
+    size_t mask;
+} usb_db_index_t;
+
+    /* number of distinct 16 bit vendor ids */
+    #define USB_ID_COUNT 0x10000
+
+/**
+ * @brief one vendor of the sorted vendor directory
+ * (entry holds its first database row + 1, its products run from start
+ * to the start of the next vendor)
+*/
+typedef struct usb_db_vendor_s {
+    uint32_t vendor_id;
+    uint32_t entry;
+    uint32_t start;
+} usb_db_vendor_t;
+
+/**
+ * @brief vendors sorted by id, each owning a contiguous span of products
+ * sorted by packed id, one slot per distinct vid/pid (first row wins);
+ * vendors[vendor_count] is a sentinel closing the last span
+*/
+typedef struct usb_db_directory_s {
+    usb_db_vendor_t *vendors;
+    usb_db_slot_t *products;
+    size_t vendor_count;
+    size_t product_count;
+} usb_db_directory_t;
+
+    /* minimal perfect hash of the embedded database (keys per bucket) */
+    #define MPH_BUCKET_SIZE 2
+    #define MPH_MAX_SEED (1U << 24)
+    #define EMBEDDED_TEXT_PIECE 64
+
+    /* lookup engines (--engine) and keys per cache line prefetched ahead */
+    #define LOOKUP_ENGINE_HASH 0
+    #define LOOKUP_ENGINE_EYTZINGER 1
+    #define LOOKUP_ENGINE_HASH_NAME "hash"
+    #define LOOKUP_ENGINE_EYTZINGER_NAME "eytzinger"
+    #define EYTZINGER_PREFETCH 16
+
+/**
+ * @brief sorted keys in Eytzinger (breadth-first) order, 1-indexed:
+ * the children of node k are 2k and 2k + 1 (entries hold the row + 1)
+*/
+typedef struct usb_db_eytzinger_s {
+    uint32_t *keys;
+    uint32_t *entries;
+    size_t count;
+} usb_db_eytzinger_t;
+
+/**
+ * @brief minimal perfect hash: the bucket seed sends every key to its own slot
+ * (slots keep the key so that absent keys are rejected)
+*/
+typedef struct usb_db_mph_s {
+    const uint32_t *seeds;
+    const usb_db_slot_t *slots;
+    uint32_t bucket_count;
+    uint32_t slot_count;
+} usb_db_mph_t;
+
+/**
+ * @brief database table generated at build time by make druid-embedded
+*/
+typedef struct usb_db_embedded_s {
+    const uint16_t *vendor_ids;
+    const uint16_t *product_ids;
+    const uint8_t *id_flags;
+    const usb_db_field_t *vendor_names;
+    const usb_db_field_t *product_names;
+    size_t count;
+    const char *text;
+    size_t text_size;
+    usb_db_mph_t products;
+    const usb_db_vendor_t *directory_vendors;
+    const usb_db_slot_t *directory_products;
+    size_t vendor_count;
+    size_t product_count;
+} usb_db_embedded_t;
+
 /**
  * @brief represents the entire usb device database
+ * (base is the embedded table an --update overlay is layered on)
 */
 typedef struct usb_db_s {
-    usb_db_entry_t *entries;
+    usb_db_columns_t columns;
     size_t count;
+    usb_db_index_t index;
+    usb_db_directory_t directory;
+    usb_db_eytzinger_t eytzinger_products;
+    usb_db_eytzinger_t eytzinger_vendors;
+    const char *text;
+    size_t text_size;
+    void *mapping;
+    size_t mapping_size;
+    void *image;
+    size_t image_size;
+    const usb_db_embedded_t *embedded;
+    struct usb_db_s *base;
 } usb_db_t;
 
+/**
+ * @brief where and how the database is loaded: data_path is the CSV file
+ * (unused by druid-embedded), image_path its compiled image (NULL to
+ * always parse), update_path an optional CSV layered on top
+*/
+typedef struct usb_db_options_s {
+    const char *data_path;
+    const char *image_path;
+    const char *update_path;
+    size_t jobs;
+    int engine;
+} usb_db_options_t;
+
+/**
+ * @brief database behind a libdruid handle, only read once opened
+*/
+struct druid_db_s {
+    usb_db_t usb_db;
+};
+
+/**
+ * @brief database row matched by a lookup, with the database owning it
+*/
+typedef struct usb_db_match_s {
+    usb_db_t *usb_db;
+    size_t row;
+} usb_db_match_t;
+
+/**
+ * @brief growable string blob the names are packed into (image, embedded table)
+*/
+typedef struct usb_db_blob_s {
+    char *data;
+    size_t size;
+    size_t capacity;
+} usb_db_blob_t;
+
+/**
+ * @brief header of the compiled database image
+ * (every offset is in bytes from the start of the image)
+*/
+typedef struct usb_db_image_header_s {
+    char magic[DB_IMAGE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t count;
+    int64_t csv_mtime_sec;
+    int64_t csv_mtime_nsec;
+    uint64_t csv_size;
+    uint64_t csv_checksum;
+    uint64_t index_slots;
+    uint64_t vendor_count;
+    uint64_t product_count;
+    uint64_t vendor_ids_offset;
+    uint64_t product_ids_offset;
+    uint64_t id_flags_offset;
+    uint64_t vendor_names_offset;
+    uint64_t product_names_offset;
+    uint64_t products_offset;
+    uint64_t directory_vendors_offset;
+    uint64_t directory_products_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} usb_db_image_header_t;
+
+    /* usb topology: node kinds and bus-port path syntax (usb1, 1-2.3, 1-2.3:1.0) */
+    #define USB_NODE_HUB 0
+    #define USB_NODE_DEVICE 1
+    #define USB_NODE_INTERFACE 2
+    #define NO_NODE -1
+    #define USB_ROOT_HUB_PREFIX "usb"
+    #define USB_BUS_SEPARATOR '-'
+    #define USB_PORT_SEPARATOR '.'
+    #define USB_INTERFACE_SEPARATOR ':'
+    #define USB_ROOT_HUB_SIZE 32
+    #define USB_TOPOLOGY_SIZE 64
+
+/**
+ * @brief one hub, device or interface of the usb tree; parent, first
+ * child and next sibling are node indices (NO_NODE if none) and depth
+ * counts the tiers below the root hub
+*/
+typedef struct usb_topology_node_s {
+    usb_db_field_t path;
+    int32_t parent;
+    int32_t first_child;
+    int32_t next_sibling;
+    int32_t depth;
+    int kind;
+} usb_topology_node_t;
+
+/**
+ * @brief usb tree built from the bus-port paths of one enumeration pass,
+ * with a hash table from path to node (slots hold the node index + 1)
+*/
+typedef struct usb_topology_s {
+    usb_topology_node_t *nodes;
+    size_t count;
+    size_t capacity;
+    usb_db_blob_t paths;
+    uint32_t *slots;
+    size_t mask;
+} usb_topology_t;
+
+    /* seen set: initial size, key tags (packed vid/pid or hashed string) */
+    #define SEEN_SET_SIZE 64
+    #define SEEN_KEY_ID 0x100000000ULL
+    #define SEEN_KEY_HASH 0x8000000000000000ULL
+
+/**
+ * @brief open-addressing set of the devices already classified, keyed by
+ * packed vid/pid or, in per-port mode, by a hash of the bus-port path
+ * (0 marks an empty slot, no string is copied)
+*/
+typedef struct usb_seen_set_s {
+    uint64_t *keys;
+    size_t count;
+    size_t mask;
+    bool per_port;
+} usb_seen_set_t;
+
+/**
+ * @brief device attached during a watch: hash of its bus-port path, its
+ * key in the seen set and the risk it was given (MATCH_*)
+*/
+typedef struct usb_live_device_s {
+    uint64_t path_key;
+    uint64_t seen_key;
+    int match;
+} usb_live_device_t;
+
+/**
+ * @brief devices attached during a watch, so a removal can undo the
+ * classification of its device
+*/
+typedef struct usb_live_set_s {
+    usb_live_device_t *devices;
+    size_t count;
+    size_t capacity;
+} usb_live_set_t;
+
+    /* metrics file (--metrics-file): vendor ids, latency buckets, watch rate limit and temporary suffix */
+    #define USB_METRICS_VENDOR_COUNT 65536
+    #define USB_METRICS_BUCKET_COUNT 11
+    #define USB_METRICS_INTERVAL 10.0
+    #define USB_METRICS_TEMP_SUFFIX ".tmp"
+
+/**
+ * @brief metrics of a scan or a watch (--metrics-file): devices per
+ * vendor id, classification latency histogram (the last bucket counts
+ * the slower ones), database and enumeration durations; walk_* hold the
+ * start of the current device walk, written the time of the last write
+ * of the file and pending whether the counters changed since
+*/
+typedef struct usb_metrics_s {
+    const char *path;
+    char *temp_path;
+    uint32_t *vendors;
+    size_t invalid_vendors;
+    size_t buckets[USB_METRICS_BUCKET_COUNT + 1];
+    size_t classifications;
+    double classification_seconds;
+    double enumeration_seconds;
+    double db_load_seconds;
+    size_t db_entries;
+    double walk_start;
+    double walk_classification_seconds;
+    double written;
+    bool pending;
+} usb_metrics_t;
+
 /**
  * @brief stores statistics about usb risk levels
+ * (seen_count numbers the classified devices)
 */
 typedef struct usb_risk_stats_s {
     size_t low;
     size_t medium;
     size_t major;
     size_t seen_count;
+    usb_seen_set_t seen;
+    usb_metrics_t *metrics;
 } usb_risk_stats_stats_t;
 
+    /* output sinks: renderers, sink limit, batch size and --output file mode */
+    #define USB_RENDER_ANSI 0
+    #define USB_RENDER_PLAIN 1
+    #define USB_RENDER_JSON 2
+    #define USB_RENDER_BINARY 3
+    #define USB_RENDER_JOURNAL 4
+    #define USB_RENDER_COUNT 5
+    #define USB_OUTPUT_MAX_SINKS 4
+    #define USB_OUTPUT_FLUSH_SIZE (1 << 16)
+    #define OUTPUT_FILE_MODE 0666
+
+    /* output formats (--format-output) and size of the cached json timestamp */
+    #define USB_FORMAT_TEXT 0
+    #define USB_FORMAT_JSON 1
+    #define USB_FORMAT_NDJSON 2
+    #define USB_FORMAT_BINARY 3
+    #define USB_FORMAT_JSON_NAME "json"
+    #define USB_FORMAT_NDJSON_NAME "ndjson"
+    #define USB_FORMAT_BINARY_NAME "binary"
+    #define USB_JSON_TIMESTAMP_SIZE 32
+    #define USB_JSON_REPLACEMENT "\\ufffd"
+
+    /* binary report (--format-output=binary, --read-report): magic, version and record types */
+    #define USB_REPORT_MAGIC "DRUIDRPT"
+    #define USB_REPORT_MAGIC_SIZE 8
+    #define USB_REPORT_VERSION 2
+    #define USB_REPORT_ALIGNMENT 8
+    #define USB_REPORT_DEVICE 1
+    #define USB_REPORT_REMOVED 2
+
+    /* names (and id strings) of a report record, indexes into the string table of the report */
+    #define USB_REPORT_VENDOR_NAME 0
+    #define USB_REPORT_PRODUCT_NAME 1
+    #define USB_REPORT_DB_VENDOR_NAME 2
+    #define USB_REPORT_DB_PRODUCT_NAME 3
+    #define USB_REPORT_SERIAL 4
+    #define USB_REPORT_DEVPATH 5
+    #define USB_REPORT_VENDOR_ID 6
+    #define USB_REPORT_PRODUCT_ID 7
+    #define USB_REPORT_NAME_COUNT 8
+    #define USB_REPORT_NO_NAME UINT32_MAX
+    #define USB_REPORT_STRING_SLOTS 1024
+
+    /* journal sink (--journal): identifier, field and message limits, bound of the queue and message ids */
+    #define USB_JOURNAL_IDENTIFIER "druid"
+    #define USB_JOURNAL_MAX_FIELDS 16
+    #define USB_JOURNAL_MESSAGE_SIZE 512
+    #define USB_JOURNAL_QUEUE_LIMIT (1 << 22)
+    #define USB_JOURNAL_MESSAGE_ID_LOW "0a4e5437cdde4d7b98dd2cef326147a6"
+    #define USB_JOURNAL_MESSAGE_ID_MEDIUM "4771e39f1f104c629df6eb1371601e6d"
+    #define USB_JOURNAL_MESSAGE_ID_MAJOR "3f0cf161b5714c0f88b45e66cd199d1e"
+    #define USB_JOURNAL_MESSAGE_ID_REMOVED "e86430f9bb334760b8667b3186dfd714"
+    #define USB_JOURNAL_MESSAGE_ID_SUMMARY "06036cf1c9274779bbddfca025b1f9be"
+
+/**
+ * @brief one destination of the output and the renderer it is written with
+ * (owned descriptors are closed with the output)
+*/
+typedef struct usb_output_sink_s {
+    int fd;
+    int render;
+    bool owned;
+} usb_output_sink_t;
+
+/**
+ * @brief header of a binary report, followed by its records
+*/
+typedef struct usb_report_header_s {
+    char magic[USB_REPORT_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t created;
+} usb_report_header_t;
+
+/**
+ * @brief record of a binary report, prefixed by its size in bytes so
+ * readers skip the fields a later version appends; ids are numeric
+ * (0 when not 4 hex digits), match is the risk (MATCH_*) and names
+ * index the string table, which also holds the ids as read
+*/
+typedef struct usb_report_record_s {
+    uint16_t size;
+    uint8_t type;
+    uint8_t match;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    int32_t hub_depth;
+    uint32_t names[USB_REPORT_NAME_COUNT];
+} usb_report_record_t;
+
+/**
+ * @brief footer closing a binary report: the risk totals (read without
+ * touching the records), then where the string table lies (the offsets
+ * of its null-terminated strings, followed by the strings)
+*/
+typedef struct usb_report_footer_s {
+    uint64_t record_count;
+    uint64_t low;
+    uint64_t medium;
+    uint64_t major;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint32_t string_count;
+    uint32_t version;
+    char magic[USB_REPORT_MAGIC_SIZE];
+} usb_report_footer_t;
+
+/**
+ * @brief binary report mapped by --read-report, with its validated sections
+*/
+typedef struct usb_report_view_s {
+    const char *data;
+    size_t size;
+    const usb_report_footer_t *footer;
+    const uint32_t *offsets;
+    const char *strings;
+} usb_report_view_t;
+
+/**
+ * @brief binary report being written: its size so far, the strings
+ * interned so far (with their offsets and an open addressing table of
+ * their index + 1), the record count and the risk totals of the footer
+*/
+typedef struct usb_report_s {
+    size_t size;
+    usb_db_blob_t strings;
+    uint32_t *offsets;
+    size_t string_count;
+    size_t string_capacity;
+    uint32_t *slots;
+    size_t slot_count;
+    size_t record_count;
+    size_t low;
+    size_t medium;
+    size_t major;
+} usb_report_t;
+
+/**
+ * @brief journal sink: entries rendered since the last flush are handed
+ * to a sender thread as one batch (appended to its queue under the lock),
+ * the thread submits them to journald outside the lock; a batch that
+ * would overflow the queue waits for it to drain, or when lossy (watch)
+ * is dropped and counted instead
+*/
+typedef struct usb_journal_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t drained;
+    usb_db_blob_t queue;
+    size_t pending;
+    size_t dropped;
+    bool lossy;
+    bool started;
+    bool stopping;
+} usb_journal_t;
+
+/**
+ * @brief scan output: one buffer per renderer, each record formatted once
+ * per renderer in use, then written to every sink of that renderer
+ * (at once on a terminal, by batches otherwise); json records are counted
+ * to separate them, and the second of the last timestamp is kept formatted;
+ * a binary report keeps its string table until it is closed, and the
+ * journal its sender thread
+*/
+typedef struct usb_output_s {
+    usb_db_blob_t buffers[USB_RENDER_COUNT];
+    usb_output_sink_t sinks[USB_OUTPUT_MAX_SINKS];
+    size_t sink_count;
+    bool renders[USB_RENDER_COUNT];
+    bool interactive;
+    int status;
+    int format;
+    size_t records;
+    time_t stamp_second;
+    char stamp[USB_JSON_TIMESTAMP_SIZE];
+    usb_report_t report;
+    usb_journal_t journal;
+} usb_output_t;
+
+/**
+ * @brief state of the hotplug watch loop (--watch)
+*/
+typedef struct usb_watch_s {
+    usb_db_t *usb_db;
+    usb_risk_stats_stats_t *usb_risk_stats;
+    usb_output_t *output;
+    sd_event *event;
+    sd_device_monitor *monitor;
+    usb_topology_t topology;
+    sd_event_source *metrics_timer;
+    usb_live_set_t live;
+} usb_watch_t;
+
 /**
  * @brief holds cli arguments for structured parsing
 */
 typedef struct cli_args_s {
     int ac;
     char **av;
+    size_t jobs;
+    int engine;
+    int backend;
+    const char *backend_source;
+    bool per_port;
+    int output_format;
+    bool journal;
+    const char *metrics_path;
+    const char *output_path;
 } cli_args_t;
 
+    /* fleet audit (--fleet): longest snapshot path */
+    #define FLEET_PATH_SIZE 4096
+
+/**
+ * @brief risk counts of one host snapshot of a fleet audit
+ * (status is EXIT_ERROR when the snapshot could not be read)
+*/
+typedef struct usb_fleet_host_s {
+    const char *name;
+    size_t low;
+    size_t medium;
+    size_t major;
+    int status;
+} usb_fleet_host_t;
+
+/**
+ * @brief state shared by the fleet workers: the read-only database, the
+ * hosts (taken in turn) and one risk accumulator per worker
+*/
+typedef struct usb_fleet_s {
+    usb_db_t *usb_db;
+    cli_args_t *cli_args;
+    const char *directory;
+    usb_fleet_host_t *hosts;
+    size_t host_count;
+    size_t next_host;
+    usb_risk_stats_stats_t *worker_stats;
+    size_t next_worker;
+} usb_fleet_t;
+
+/**
+ * @brief database loaded on a background thread during the enumeration
+ * (published is set once status holds the result of the load, and
+ * seconds how long it took)
+*/
+typedef struct usb_db_loader_s {
+    usb_db_t *usb_db;
+    cli_args_t *cli_args;
+    pthread_t thread;
+    bool started;
+    bool published;
+    int status;
+    double seconds;
+} usb_db_loader_t;
+
+/**
+ * @brief one enumerated device kept until the database is ready; values
+ * hold the offset + 1 of each USB_PROPERTY_* in the strings (0 for NULL)
+*/
+typedef struct usb_device_record_s {
+    uint32_t values[USB_PROPERTY_COUNT];
+    int hub_depth;
+} usb_device_record_t;
+
+/**
+ * @brief devices enumerated before the database was ready, in order
+*/
+typedef struct usb_device_records_s {
+    usb_device_record_t *records;
+    size_t count;
+    size_t capacity;
+    usb_db_blob_t strings;
+} usb_device_records_t;
+
+    /* lookup service (druidd): socket, event loop and line protocol */
+    #define DRUIDD_SOCKET_PATH "/run/druidd.sock"
+    #define DRUIDD_SOCKET_ENV "DRUID_SOCKET"
+    #define DRUIDD_BACKLOG 128
+    #define DRUIDD_MAX_EVENTS 64
+    #define DRUIDD_INPUT_SIZE (1 << 16)
+    #define DRUIDD_LOOKUP_REQUEST 'L'
+    #define DRUIDD_SCAN_REQUEST 'S'
+    #define DRUIDD_END_REPLY '.'
+    #define DRUIDD_ERROR_REPLY '!'
+    #define DRUIDD_REPLY_FIELDS 9
+    #define DRUIDD_UNKNOWN_REQUEST_ERROR "!;unknown request\n"
+    #define DRUIDD_SCAN_ERROR "!;cannot enumerate usb devices\n"
+    #define DRUIDD_END_REPLY_FORMAT ".;%lu;%lu;%lu\n"
+
+/**
+ * @brief one connection to druidd: received bytes not answered yet
+ * (at most one partial request after a batch) and replies not sent yet
+*/
+typedef struct usb_lookup_client_s {
+    int fd;
+    char *input;
+    size_t input_size;
+    usb_db_blob_t output;
+    size_t output_sent;
+    uint32_t events;
+    struct usb_lookup_client_s *prev;
+    struct usb_lookup_client_s *next;
+} usb_lookup_client_t;
+
+/**
+ * @brief state of the druidd event loop: the resident database, the
+ * listening socket, the epoll instance, the signal descriptor stopping
+ * the loop and the open connections
+*/
+typedef struct usb_lookup_server_s {
+    usb_db_t *usb_db;
+    cli_args_t *cli_args;
+    int listen_fd;
+    int epoll_fd;
+    int signal_fd;
+    bool running;
+    usb_lookup_client_t *clients;
+} usb_lookup_server_t;
+
+    /* benchmarks (druid-bench): generated csv, lookup keys, rounds kept at their fastest */
+    #define BENCH_CSV_SIZE (64 << 20)
+    #define BENCH_CSV_ROW_SIZE 128
+    #define BENCH_CSV_FILLER "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMN"
+    #define BENCH_SEED 0x5eed
+    #define BENCH_ROUNDS 5
+    #define BENCH_LOOKUP_COUNT 1000000
+    #define BENCH_ALL_ENGINES -1
+
 /* init all */
 void init_struct_usb_tools(usb_tools_t *usb_tools);
 void init_struct_usb_device_info(usb_device_info_t *usb_device_info);
-int init_struct_usb_db(usb_db_t *usb_db, size_t allocated_capacity);
-void init_struct_usb_db_entry(usb_db_entry_t *usb_db_entry);
-void init_struct_unknown_usb_db_entry(usb_db_entry_t *unknown);
-int init_usb_enumerator(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info);
+void init_struct_usb_db(usb_db_t *usb_db);
+void init_struct_unknown_usb_db_names(usb_db_names_t *unknown);
+int init_usb_enumerator(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info,
+    cli_args_t *cli_args);
+int first_usb_device(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info);
+int next_usb_device(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info);
+void close_usb_enumerator(usb_tools_t *usb_tools);
+
+/* usb enumeration backends */
+extern const usb_backend_t systemd_usb_backend;
+extern const usb_backend_t sysfs_usb_backend;
+extern const usb_backend_t device_list_usb_backend;
+extern const usb_backend_t replay_usb_backend;
 
 /* fill database struct */
-int load_usb_db_from_file(usb_db_t *usb_db, usb_db_entry_t *usb_db_entry,
-    cli_args_t *cli_args);
+int open_usb_db(usb_db_t *usb_db, const usb_db_options_t *options);
+int load_usb_db_from_file(usb_db_t *usb_db, cli_args_t *cli_args);
+int load_usb_db_from_csv(usb_db_t *usb_db, const usb_db_options_t *options);
+int map_usb_db_sources(usb_db_t *usb_db, const char **paths,
+    size_t count, usb_db_source_t *sources);
+int parse_usb_db_chunks(usb_db_t *usb_db, usb_db_source_t *sources,
+    size_t source_count, size_t jobs);
+usb_db_scan_block_t get_usb_db_scan_kernel(int kernel);
+usb_db_scan_block_t select_usb_db_scan_block(void);
+usb_db_delimiters_t scan_usb_db_block(usb_db_scan_block_t scan_block,
+    const char *pos, const char *end);
+int parse_usb_id(const char *str, uint16_t *id);
+int parse_usb_id_field(const char *str, size_t length, uint16_t *id);
+int alloc_usb_db_columns(usb_db_columns_t *columns, size_t count);
+void free_usb_db_columns(usb_db_columns_t *columns);
+int pack_usb_db_names(usb_db_t *usb_db, usb_db_field_t *vendor_names,
+    usb_db_field_t *product_names, usb_db_blob_t *blob);
+void decode_usb_db_entry(usb_db_t *usb_db, size_t row,
+    usb_db_names_t *usb_db_names);
+
+/* compiled database image */
+int load_usb_db_from_image(usb_db_t *usb_db, const char *image_path,
+    const char *csv_path);
+int check_usb_db_image_fresh(const usb_db_image_header_t *header,
+    const char *csv_path);
+uint64_t checksum_usb_db_file(const char *path);
+int handle_compile_db_flag(cli_args_t *cli_args);
+
+/* hash index over database entries */
+int build_usb_db_index(usb_db_t *usb_db);
+int lookup_usb_db_ids(usb_db_t *usb_db, uint16_t vendor_id, uint16_t product_id,
+    bool has_product, usb_db_match_t *match);
+int lookup_usb_db_index(usb_db_t *usb_db, usb_device_info_t *usb_device_info,
+    usb_db_match_t *match);
+
+/* eytzinger lookup engine */
+int build_usb_db_eytzinger(usb_db_t *usb_db);
+uint32_t find_usb_db_eytzinger(const usb_db_eytzinger_t *eytzinger, uint32_t key);
+void free_usb_db_eytzinger(usb_db_eytzinger_t *eytzinger);
+
+/* sorted vendor directory */
+int build_usb_db_directory(usb_db_t *usb_db);
+usb_db_vendor_t *find_usb_db_vendor(usb_db_directory_t *directory, uint16_t vendor_id);
+int compare_usb_db_slots(const void *a, const void *b);
+int handle_vendor_flag(cli_args_t *cli_args);
+
+/* embedded database (only linked into druid-embedded) */
+extern const usb_db_embedded_t embedded_usb_db __attribute__((weak));
+bool check_embedded_usb_db(void);
+int load_usb_db_from_embedded(usb_db_t *usb_db);
+int attach_embedded_usb_db(usb_db_t *usb_db);
+uint32_t hash_usb_db_mph(uint32_t key, uint32_t seed);
+uint32_t find_usb_db_mph(const usb_db_mph_t *mph, uint32_t key);
+
+/* pipelined scan: background database load and pending devices */
+int start_usb_db_loader(usb_db_loader_t *loader);
+bool check_usb_db_loader(usb_db_loader_t *loader);
+int wait_usb_db_loader(usb_db_loader_t *loader);
+int add_usb_device_record(usb_device_records_t *records, usb_device_info_t *usb_device_info);
+void get_usb_device_record(usb_device_records_t *records, size_t i,
+    usb_device_info_t *usb_device_info);
+void free_usb_device_records(usb_device_records_t *records);
+
+/* usb topology */
+int add_usb_topology_node(usb_topology_t *topology, usb_device_info_t *usb_device_info);
+void free_usb_topology(usb_topology_t *topology);
+
+/* lookup service (druidd) and its client (--query) */
+const char *get_usb_lookup_socket_path(void);
+int serve_usb_lookups(usb_db_t *usb_db, cli_args_t *cli_args);
+int answer_usb_lookup_requests(usb_lookup_server_t *server, usb_lookup_client_t *client);
+int handle_query_flag(cli_args_t *cli_args);
+
+/* metrics file */
+double get_usb_metrics_clock(void);
+int open_usb_metrics(usb_metrics_t *metrics, const char *path);
+void set_usb_metrics_db(usb_metrics_t *metrics, usb_db_t *usb_db, double seconds);
+void begin_usb_metrics_walk(usb_metrics_t *metrics);
+void end_usb_metrics_walk(usb_metrics_t *metrics);
+void observe_usb_classification(usb_metrics_t *metrics, usb_device_info_t *usb_device_info,
+    double start);
+void forget_usb_classification(usb_metrics_t *metrics, usb_device_info_t *usb_device_info);
+int write_usb_metrics(usb_metrics_t *metrics, usb_risk_stats_stats_t *usb_risk_stats);
+double update_usb_metrics(usb_metrics_t *metrics, usb_risk_stats_stats_t *usb_risk_stats);
+void close_usb_metrics(usb_metrics_t *metrics);
+
+/* set of already classified devices */
+int check_usb_seen(usb_seen_set_t *seen, usb_device_info_t *usb_device_info);
+int add_usb_seen(usb_seen_set_t *seen, usb_device_info_t *usb_device_info);
+uint64_t get_usb_seen_key(usb_seen_set_t *seen, usb_device_info_t *usb_device_info);
+void remove_usb_seen_key(usb_seen_set_t *seen, uint64_t key);
+void free_usb_seen_set(usb_seen_set_t *seen);
+
+/* devices attached during a watch */
+usb_live_device_t *find_usb_live_device(usb_live_set_t *live, const char *path);
+usb_live_device_t *find_usb_live_seen(usb_live_set_t *live, uint64_t seen_key);
+int add_usb_live_device(usb_live_set_t *live, const char *path, uint64_t seen_key,
+    int match);
+int take_usb_live_device(usb_live_set_t *live, const char *path, usb_live_device_t *device);
+void free_usb_live_set(usb_live_set_t *live);
 
 /* free all */
-void free_unknown_usb_db_entry(usb_db_entry_t *unknown);
 void free_usb_db(usb_db_t *usb_db);
 
 /* display risk case */
 void display_known_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file);
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output);
 void display_partially_known_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file);
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output);
 void display_unknown_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file);
-void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, FILE *output_file);
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output);
+void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output);
+
+/* output sinks */
+int open_usb_output(usb_output_t *output, const char *path, int format);
+int add_usb_output_sink(usb_output_t *output, int fd, int render, bool owned);
+int reserve_usb_output(usb_output_t *output, usb_db_blob_t *buffer, size_t length);
+void print_usb_output(usb_output_t *output, int render, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void end_usb_output_record(usb_output_t *output);
+int flush_usb_output(usb_output_t *output);
+int close_usb_output(usb_output_t *output);
+void print_usb_json_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match, size_t number);
+void print_usb_json_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath);
+void print_usb_json_fleet_host(usb_output_t *output, usb_fleet_host_t *host);
+void print_usb_json_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats);
+void end_usb_json_output(usb_output_t *output);
+void begin_usb_report_output(usb_output_t *output);
+void print_usb_report_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match);
+void print_usb_report_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath);
+void print_usb_report_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats);
+void end_usb_report_output(usb_output_t *output);
+void free_usb_report(usb_report_t *report);
+void open_usb_journal(usb_output_t *output, bool lossy);
+void print_usb_journal_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match);
+void print_usb_journal_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath);
+void print_usb_journal_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats);
+void flush_usb_journal(usb_output_t *output);
+void close_usb_journal(usb_output_t *output);
 
 /* option */
 int handle_cli_info_flags(int ac, char **av);
+int handle_jobs_flag(cli_args_t *cli_args);
+int handle_engine_flag(cli_args_t *cli_args);
+int handle_format_output_flag(cli_args_t *cli_args);
+int handle_output_flag(cli_args_t *cli_args);
+int handle_backend_flag(cli_args_t *cli_args);
+int handle_per_port_flag(cli_args_t *cli_args);
+int handle_journal_flag(cli_args_t *cli_args);
+int handle_metrics_file_flag(cli_args_t *cli_args);
+int handle_watch_flag(cli_args_t *cli_args);
+int handle_fleet_flag(cli_args_t *cli_args);
+int filter_fleet_entry(const struct dirent *entry);
+int display_fleet_hosts(usb_fleet_t *fleet, usb_output_t *output);
+int handle_read_report_flag(cli_args_t *cli_args);
 int display_file(int ac, char **av, const char *flag,
     const char *optional_flag, const char *path_file);
 
 /* core comparison function */
 int scan_connected_usb_and_check_risks(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, cli_args_t *cli_args);
+    cli_args_t *cli_args);
+void scan_usb_devices(usb_db_t *usb_db, usb_tools_t *usb_tools,
+    usb_device_info_t *usb_device_info, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output);
+void get_vendor_product_device(sd_device *device, usb_device_info_t *usb_device_info);
+int check_usb_exist(usb_db_t *usb_db, usb_device_info_t *usb_device_info,
+    usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output);
 
 #endif /* DRUID_H */
@@ -0,0 +1,59 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file libdruid.h
+ * @brief public API of libdruid: classifies usb ids in-process against the druid database
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#ifndef LIBDRUID_H
+    #define LIBDRUID_H
+
+    /* version of this API, raised on incompatible changes only */
+    #define DRUID_API_VERSION 1
+
+    /* symbols exported by libdruid.so (everything else stays hidden) */
+    #define DRUID_API __attribute__((visibility("default")))
+
+    /* match levels of druid_classify: low, medium and major risk */
+    #define DRUID_MATCH_VENDOR_AND_PRODUCT 2
+    #define DRUID_MATCH_VENDOR_ONLY 1
+    #define DRUID_MATCH_NONE 0
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+/**
+ * @brief database opened by druid_db_open (opaque)
+*/
+typedef struct druid_db_s druid_db_t;
+
+/**
+ * @brief classification of one vid/pid: match level (DRUID_MATCH_*) and
+ * database names of the matched entry, "Unknown" when there is none
+ * (not null-terminated, valid until druid_db_close)
+*/
+typedef struct druid_result_s {
+    int match;
+    const char *vendor_name;
+    size_t vendor_name_length;
+    const char *product_name;
+    size_t product_name_length;
+} druid_result_t;
+
+/* database handle: open once, share it between threads, close once */
+DRUID_API druid_db_t *druid_db_open(const char *path);
+DRUID_API int druid_classify(const druid_db_t *db, uint16_t vendor_id, uint16_t product_id,
+    druid_result_t *result);
+DRUID_API void druid_db_close(druid_db_t *db);
+
+#endif /* LIBDRUID_H */
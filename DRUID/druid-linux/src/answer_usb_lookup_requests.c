@@ -0,0 +1,309 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file answer_usb_lookup_requests.c
+ * @brief answers the line protocol of druidd (lookups and scans)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Makes room for a reply at the end of the output of a client
+ *
+ * @details static char *reserve_reply(usb_db_blob_t *output, size_t length)
+ * @param output Replies not sent yet
+ * @param length Number of bytes about to be appended
+ * @return Pointer to the end of the output, or NULL if memory allocation fails
+ */
+static char *reserve_reply(usb_db_blob_t *output, size_t length)
+{
+    size_t capacity = output->capacity;
+    char *data = NULL;
+
+    while (output->size + length > capacity)
+        capacity = capacity > 0 ? capacity * INCREASED_SIZE : DRUIDD_INPUT_SIZE;
+    if (capacity != output->capacity) {
+        data = realloc(output->data, capacity);
+        if (data == NULL)
+            return NULL;
+        output->data = data;
+        output->capacity = capacity;
+    }
+    return output->data + output->size;
+}
+
+/**
+ * @brief Appends raw bytes to the output of a client
+ *
+ * @details static int append_reply(usb_db_blob_t *output, const char *bytes, size_t length)
+ * @param output Replies not sent yet
+ * @param bytes Bytes to append
+ * @param length Number of bytes
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int append_reply(usb_db_blob_t *output, const char *bytes, size_t length)
+{
+    char *end = reserve_reply(output, length);
+
+    if (end == NULL)
+        return EXIT_ERROR;
+    memcpy(end, bytes, length);
+    output->size += length;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Appends one field of a reply, preceded by its separator
+ *
+ * system names come from the devices themselves, so separators and
+ * line breaks inside a value are turned into spaces to keep one reply
+ * per line and DRUIDD_REPLY_FIELDS fields per reply
+ *
+ * @details static int append_reply_field(
+ *             usb_db_blob_t *output,
+ *             const char *value,
+ *             size_t length)
+ * @param output Replies not sent yet
+ * @param value Field value (not null-terminated, may be NULL when empty)
+ * @param length Length of the value
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int append_reply_field(usb_db_blob_t *output, const char *value, size_t length)
+{
+    char *end = reserve_reply(output, length + 1);
+
+    if (end == NULL)
+        return EXIT_ERROR;
+    end[0] = FIELD_SEPARATOR;
+    for (size_t i = 0; i < length; ++i)
+        end[i + 1] = value[i] == FIELD_SEPARATOR || value[i] == LINE_SEPARATOR ||
+            value[i] == '\r' ? ' ' : value[i];
+    output->size += length + 1;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Classifies a device and appends its reply
+ *
+ * a reply is the match level (MATCH_*) followed by the vendor and
+ * product ids, the database names, the system names, the bus-port path
+ * and the hub depth; unknown values are left empty
+ *
+ * @details static int append_device_reply(
+ *             usb_db_t *usb_db,
+ *             usb_db_blob_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param usb_db Pointer to the resident database
+ * @param output Replies not sent yet
+ * @param usb_device_info Pointer to the device to classify
+ * @param usb_risk_stats Pointer to the risk counters to update
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int append_device_reply(usb_db_t *usb_db, usb_db_blob_t *output,
+    usb_device_info_t *usb_device_info, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    usb_db_match_t usb_db_match = {NULL, 0};
+    usb_db_names_t usb_db_names = {0};
+    int match = lookup_usb_db_index(usb_db, usb_device_info, &usb_db_match);
+    const char *values[] = {usb_device_info->vendor_id, usb_device_info->product_id};
+    const char *names[] = {usb_device_info->vendor_name, usb_device_info->product_name,
+        usb_device_info->path_usb};
+    char level = '0' + match;
+    char depth[16] = {0};
+    int status = append_reply(output, &level, 1);
+
+    if (match == MATCH_NONE)
+        init_struct_unknown_usb_db_names(&usb_db_names);
+    else
+        decode_usb_db_entry(usb_db_match.usb_db, usb_db_match.row, &usb_db_names);
+    for (size_t i = 0; i < 2 && status == EXIT_SUCCESS; ++i)
+        status = append_reply_field(output, values[i], strlen(values[i]));
+    if (status == EXIT_SUCCESS)
+        status = append_reply_field(output, usb_db_names.vendor_name,
+            usb_db_names.vendor_name_length);
+    if (status == EXIT_SUCCESS)
+        status = append_reply_field(output, usb_db_names.product_name,
+            usb_db_names.product_name_length);
+    for (size_t i = 0; i < 3 && status == EXIT_SUCCESS; ++i)
+        status = append_reply_field(output, names[i], names[i] != NULL ? strlen(names[i]) : 0);
+    if (usb_device_info->hub_depth >= 0)
+        snprintf(depth, sizeof(depth), "%d", usb_device_info->hub_depth);
+    if (status == EXIT_SUCCESS)
+        status = append_reply_field(output, depth, strlen(depth));
+    if (match == MATCH_VENDOR_AND_PRODUCT)
+        ++usb_risk_stats->low;
+    else if (match == MATCH_VENDOR_ONLY)
+        ++usb_risk_stats->medium;
+    else
+        ++usb_risk_stats->major;
+    return status == EXIT_SUCCESS ? append_reply(output, "\n", 1) : EXIT_ERROR;
+}
+
+/**
+ * @brief Answers a lookup request (L;vendor id;product id)
+ *
+ * @details static int answer_lookup_request(
+ *             usb_lookup_server_t *server,
+ *             usb_db_blob_t *output,
+ *             char *fields)
+ * @param server Pointer to the server holding the database
+ * @param output Replies not sent yet
+ * @param fields Request after its command (modified in place)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int answer_lookup_request(usb_lookup_server_t *server, usb_db_blob_t *output,
+    char *fields)
+{
+    usb_device_info_t usb_device_info = {0};
+    usb_risk_stats_stats_t usb_risk_stats = {0};
+
+    init_struct_usb_device_info(&usb_device_info);
+    usb_device_info.vendor_id = strsep(&fields, FILE_SEPARATOR);
+    usb_device_info.product_id = strsep(&fields, FILE_SEPARATOR);
+    if (usb_device_info.vendor_id == NULL || usb_device_info.product_id == NULL ||
+        fields != NULL)
+        return append_reply(output, DRUIDD_UNKNOWN_REQUEST_ERROR,
+            sizeof(DRUIDD_UNKNOWN_REQUEST_ERROR) - 1);
+    return append_device_reply(server->usb_db, output, &usb_device_info, &usb_risk_stats);
+}
+
+/**
+ * @brief Answers a scan request (S): classifies the devices of the host
+ *
+ * same walk and dedupe as scan_usb_devices, through the backend druidd
+ * was started with; one reply per device, then an end reply holding the
+ * low, medium and major counts
+ *
+ * @details static int answer_scan_request(
+ *             usb_lookup_server_t *server,
+ *             usb_db_blob_t *output)
+ * @param server Pointer to the server holding the database and the backend
+ * @param output Replies not sent yet
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int answer_scan_request(usb_lookup_server_t *server, usb_db_blob_t *output)
+{
+    usb_tools_t usb_tools = {0};
+    usb_device_info_t usb_device_info = {0};
+    usb_topology_t usb_topology = {0};
+    usb_risk_stats_stats_t usb_risk_stats = {0};
+    char end[64] = {0};
+    int written = 0;
+    int status = UNSEEN;
+    int result = EXIT_SUCCESS;
+
+    usb_risk_stats.seen.per_port = server->cli_args->per_port;
+    if (init_usb_enumerator(&usb_tools, &usb_device_info, server->cli_args) == EXIT_ERROR) {
+        close_usb_enumerator(&usb_tools);
+        return append_reply(output, DRUIDD_SCAN_ERROR, sizeof(DRUIDD_SCAN_ERROR) - 1);
+    }
+    status = first_usb_device(&usb_tools, &usb_device_info);
+    for (; status == SUCCESS && result == EXIT_SUCCESS;
+        status = next_usb_device(&usb_tools, &usb_device_info)) {
+        if (add_usb_topology_node(&usb_topology, &usb_device_info) == USB_NODE_INTERFACE ||
+            usb_device_info.vendor_id == NULL || usb_device_info.product_id == NULL ||
+            check_usb_seen(&usb_risk_stats.seen, &usb_device_info) == SUCCESS)
+            continue;
+        result = append_device_reply(server->usb_db, output, &usb_device_info, &usb_risk_stats);
+        add_usb_seen(&usb_risk_stats.seen, &usb_device_info);
+    }
+    close_usb_enumerator(&usb_tools);
+    free_usb_topology(&usb_topology);
+    free_usb_seen_set(&usb_risk_stats.seen);
+    written = snprintf(end, sizeof(end), DRUIDD_END_REPLY_FORMAT,
+        usb_risk_stats.low, usb_risk_stats.medium, usb_risk_stats.major);
+    return result == EXIT_SUCCESS ? append_reply(output, end, written) : EXIT_ERROR;
+}
+
+/**
+ * @brief Answers one request line
+ *
+ * @details static int answer_request(
+ *             usb_lookup_server_t *server,
+ *             usb_db_blob_t *output,
+ *             char *line)
+ * @param server Pointer to the server
+ * @param output Replies not sent yet
+ * @param line Request (null-terminated, without its line break)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int answer_request(usb_lookup_server_t *server, usb_db_blob_t *output, char *line)
+{
+    if (line[0] == DRUIDD_LOOKUP_REQUEST && line[1] == FIELD_SEPARATOR)
+        return answer_lookup_request(server, output, line + 2);
+    if (line[0] == DRUIDD_SCAN_REQUEST && line[1] == '\0')
+        return answer_scan_request(server, output);
+    if (line[0] == '\0')
+        return EXIT_SUCCESS;
+    return append_reply(output, DRUIDD_UNKNOWN_REQUEST_ERROR,
+        sizeof(DRUIDD_UNKNOWN_REQUEST_ERROR) - 1);
+}
+
+/**
+ * @brief Answers every complete request received from a client
+ *
+ * requests are batched: all the lines of one read are answered into the
+ * output of the client, which the server then sends in one write; a
+ * trailing partial line is moved to the front of the input for the
+ * next read
+ *
+ * @details int answer_usb_lookup_requests(
+ *             usb_lookup_server_t *server,
+ *             usb_lookup_client_t *client)
+ * @param server Pointer to the server holding the database
+ * @param client Pointer to the client whose input is answered
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails or a request
+ *                  does not fit in DRUIDD_INPUT_SIZE bytes
+ */
+int answer_usb_lookup_requests(usb_lookup_server_t *server, usb_lookup_client_t *client)
+{
+    char *line = client->input;
+    char *input_end = client->input + client->input_size;
+    char *line_end = NULL;
+
+    while ((line_end = memchr(line, LINE_SEPARATOR, input_end - line)) != NULL) {
+        *line_end = '\0';
+        if (line_end > line && line_end[-1] == '\r')
+            line_end[-1] = '\0';
+        if (answer_request(server, &client->output, line) == EXIT_ERROR)
+            return EXIT_ERROR;
+        line = line_end + 1;
+    }
+    client->input_size = input_end - line;
+    if (client->input_size >= DRUIDD_INPUT_SIZE)
+        return EXIT_ERROR;
+    memmove(client->input, line, client->input_size);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,387 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file druid_bench.c
+ * @brief benchmarks of the database load and lookup hot paths (druid-bench)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* names of the delimiter scan kernels (SCAN_KERNEL_*), which count ';' and '\n' */
+static const char *const bench_kernel_names[SCAN_KERNEL_COUNT] = {
+    "scalar delimiters", "sse2 delimiters", "avx2 delimiters"
+};
+
+/**
+ * @brief Generates a csv database of BENCH_CSV_SIZE bytes
+ *
+ * rows look like the shipped database ("046d;Vendor;c52b;Product\n")
+ * with names of varying length, from a fixed seed so every run scans
+ * the same text
+ *
+ * @details static char *generate_bench_csv(size_t *size)
+ * @param size Receives the length of the text
+ * @return The null-terminated text, or NULL if memory allocation fails
+ */
+static char *generate_bench_csv(size_t *size)
+{
+    char *csv = malloc(BENCH_CSV_SIZE + BENCH_CSV_ROW_SIZE);
+    uint32_t seed = BENCH_SEED;
+    size_t length = 0;
+
+    if (csv == NULL)
+        return NULL;
+    while (length < BENCH_CSV_SIZE) {
+        seed = seed * 1103515245U + 12345U;
+        length += snprintf(csv + length, BENCH_CSV_ROW_SIZE, "%04x;Vendor %.*s Inc.;%04x;Product %.*s\n",
+            seed >> 16, (int)(seed % 24), BENCH_CSV_FILLER, seed & 0xffff,
+            (int)((seed >> 8) % 40), BENCH_CSV_FILLER);
+    }
+    *size = length;
+    return csv;
+}
+
+/**
+ * @brief Scans the whole csv with one kernel, as the loader does
+ *
+ * @details static size_t scan_bench_csv(
+ *             usb_db_scan_block_t scan_block,
+ *             char *csv,
+ *             size_t size)
+ * @param scan_block Kernel to run
+ * @param csv Generated text
+ * @param size Length of the text
+ * @return Number of ';' and '\n' found
+ */
+static size_t scan_bench_csv(usb_db_scan_block_t scan_block, char *csv, size_t size)
+{
+    usb_db_delimiters_t delimiters = {0, 0};
+    size_t found = 0;
+
+    for (size_t pos = 0; pos < size; pos += SCAN_BLOCK_SIZE) {
+        delimiters = scan_usb_db_block(scan_block, csv + pos, csv + size);
+        found += __builtin_popcountll(delimiters.fields) + __builtin_popcountll(delimiters.lines);
+    }
+    return found;
+}
+
+/**
+ * @brief Counts the newlines of the csv with memchr
+ *
+ * @details static size_t count_bench_lines(
+ *             usb_db_scan_block_t scan_block,
+ *             char *csv,
+ *             size_t size)
+ * @param scan_block Unused (same signature as scan_bench_csv)
+ * @param csv Generated text
+ * @param size Length of the text
+ * @return Number of '\n' found
+ */
+static size_t count_bench_lines(usb_db_scan_block_t scan_block, char *csv, size_t size)
+{
+    const char *end = csv + size;
+    size_t found = 0;
+
+    (void)scan_block;
+    for (const char *pos = csv; (pos = memchr(pos, LINE_SEPARATOR, end - pos)) != NULL; ++pos)
+        ++found;
+    return found;
+}
+
+/**
+ * @brief Splits the csv like the former loader: getline, then strtok
+ *
+ * reads a copy of the text through a memory stream and cuts each line
+ * into its four fields; the strdup of every field done by the former
+ * loader is left out, so this is a lower bound of its cost
+ *
+ * @details static size_t split_bench_csv(
+ *             usb_db_scan_block_t scan_block,
+ *             char *csv,
+ *             size_t size)
+ * @param scan_block Unused (same signature as scan_bench_csv)
+ * @param csv Generated text
+ * @param size Length of the text
+ * @return Number of fields found
+ */
+static size_t split_bench_csv(usb_db_scan_block_t scan_block, char *csv, size_t size)
+{
+    FILE *stream = fmemopen(csv, size, READ_MODE);
+    char *line = NULL;
+    size_t n = 0;
+    size_t found = 0;
+
+    (void)scan_block;
+    if (stream == NULL)
+        return 0;
+    while (getline(&line, &n, stream) != EOF) {
+        for (char *field = strtok(line, FILE_SEPARATOR); field != NULL;
+            field = strtok(NULL, FILE_SEPARATOR))
+            ++found;
+    }
+    free(line);
+    fclose(stream);
+    return found;
+}
+
+/**
+ * @brief Runs one path BENCH_ROUNDS times and prints its fastest pass
+ *
+ * @details static void time_bench_csv(
+ *             const char *name,
+ *             size_t (*pass)(usb_db_scan_block_t, char *, size_t),
+ *             usb_db_scan_block_t scan_block,
+ *             char *csv,
+ *             size_t size)
+ * @param name Name of the measured path and of what it counts
+ * @param pass Function running the path once over the csv
+ * @param scan_block Kernel given to the path
+ * @param csv Generated text
+ * @param size Length of the text
+ */
+static void time_bench_csv(const char *name,
+    size_t (*pass)(usb_db_scan_block_t, char *, size_t),
+    usb_db_scan_block_t scan_block, char *csv, size_t size)
+{
+    double best = 0;
+    double seconds = 0;
+    size_t found = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        seconds = get_usb_metrics_clock();
+        found = pass(scan_block, csv, size);
+        seconds = get_usb_metrics_clock() - seconds;
+        if (round == 0 || seconds < best)
+            best = seconds;
+    }
+    printf(BENCH_RATE_FORMAT, name, size / best / 1e9, found);
+}
+
+/**
+ * @brief Times the delimiter scan kernels against the former strtok path
+ *
+ * every path runs over the same generated csv; kernels this CPU lacks
+ * are reported as such
+ *
+ * @details static int bench_usb_db_delimiters(void)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int bench_usb_db_delimiters(void)
+{
+    size_t size = 0;
+    char *csv = generate_bench_csv(&size);
+    usb_db_scan_block_t scan_block = NULL;
+
+    if (csv == NULL)
+        return EXIT_ERROR;
+    printf(BENCH_DELIMITERS_MESSAGE, size / 1e6, BENCH_ROUNDS);
+    for (int kernel = 0; kernel < SCAN_KERNEL_COUNT; ++kernel) {
+        scan_block = get_usb_db_scan_kernel(kernel);
+        if (scan_block != NULL)
+            time_bench_csv(bench_kernel_names[kernel], scan_bench_csv, scan_block, csv, size);
+        else
+            printf(BENCH_UNSUPPORTED_FORMAT, bench_kernel_names[kernel]);
+    }
+    time_bench_csv("memchr lines", count_bench_lines, NULL, csv, size);
+    time_bench_csv("strtok fields", split_bench_csv, NULL, csv, size);
+    free(csv);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Looks up ids by reading the whole database, like druid used to
+ *
+ * baseline of the lookup benchmark: the first row holding both ids is
+ * a known device, else the first row holding the vendor id, exactly
+ * the rows the engines return
+ *
+ * @details static int find_bench_linear(
+ *             usb_db_t *usb_db,
+ *             uint16_t vendor_id,
+ *             uint16_t product_id,
+ *             usb_db_match_t *match)
+ * @param usb_db Pointer to the loaded database
+ * @param vendor_id Vendor id looked up
+ * @param product_id Product id looked up
+ * @param match Receives the matching row (unchanged on MATCH_NONE)
+ * @return Match level (MATCH_*)
+ */
+static int find_bench_linear(usb_db_t *usb_db, uint16_t vendor_id, uint16_t product_id,
+    usb_db_match_t *match)
+{
+    usb_db_columns_t *columns = &usb_db->columns;
+    int level = MATCH_NONE;
+
+    for (size_t i = 0; i < usb_db->count; ++i) {
+        if (!(columns->id_flags[i] & ID_FLAG_VENDOR) || columns->vendor_ids[i] != vendor_id)
+            continue;
+        if ((columns->id_flags[i] & ID_FLAG_PRODUCT) && columns->product_ids[i] == product_id) {
+            *match = (usb_db_match_t){usb_db, i};
+            return MATCH_VENDOR_AND_PRODUCT;
+        }
+        if (level == MATCH_NONE)
+            *match = (usb_db_match_t){usb_db, i};
+        level = MATCH_VENDOR_ONLY;
+    }
+    return level;
+}
+
+/**
+ * @brief Builds the key set shared by every lookup path
+ *
+ * one key in two is the vid/pid of a random row holding both ids, the
+ * other a random pair, which is mostly unknown or vendor only
+ *
+ * @details static uint32_t *generate_bench_keys(usb_db_t *usb_db)
+ * @param usb_db Pointer to the loaded database
+ * @return BENCH_LOOKUP_COUNT packed keys (vid << 16 | pid), or NULL if
+ *         memory allocation fails
+ */
+static uint32_t *generate_bench_keys(usb_db_t *usb_db)
+{
+    usb_db_columns_t *columns = &usb_db->columns;
+    uint32_t *keys = malloc(sizeof(uint32_t) * BENCH_LOOKUP_COUNT);
+    uint32_t seed = BENCH_SEED;
+    size_t row = 0;
+    size_t tries = 0;
+
+    if (keys == NULL || usb_db->count == 0)
+        return keys;
+    for (size_t i = 0; i < BENCH_LOOKUP_COUNT; ++i) {
+        seed = seed * 1103515245U + 12345U;
+        keys[i] = seed;
+        for (tries = 0; i % 2 == 0 && tries < usb_db->count; ++tries) {
+            row = (seed + tries) % usb_db->count;
+            if ((columns->id_flags[row] & (ID_FLAG_VENDOR | ID_FLAG_PRODUCT)) ==
+                (ID_FLAG_VENDOR | ID_FLAG_PRODUCT)) {
+                keys[i] = ((uint32_t)columns->vendor_ids[row] << 16) | columns->product_ids[row];
+                break;
+            }
+        }
+    }
+    return keys;
+}
+
+/**
+ * @brief Runs every key through one lookup path and prints its mean latency
+ *
+ * the engines run BENCH_ROUNDS times and keep their fastest pass; the
+ * linear baseline, a thousand times slower, runs once
+ *
+ * @details static void time_bench_lookups(
+ *             const char *name,
+ *             usb_db_t *usb_db,
+ *             const uint32_t *keys,
+ *             bool linear)
+ * @param name Name of the measured path
+ * @param usb_db Pointer to the loaded database, with the engine to measure
+ * @param keys BENCH_LOOKUP_COUNT packed keys
+ * @param linear true to read the whole database for each key instead
+ */
+static void time_bench_lookups(const char *name, usb_db_t *usb_db, const uint32_t *keys,
+    bool linear)
+{
+    usb_db_match_t match = {NULL, 0};
+    size_t levels[MATCH_VENDOR_AND_PRODUCT + 1] = {0};
+    double best = 0;
+    double seconds = 0;
+
+    for (int round = 0; round < (linear ? 1 : BENCH_ROUNDS); ++round) {
+        memset(levels, 0, sizeof(levels));
+        seconds = get_usb_metrics_clock();
+        for (size_t i = 0; i < BENCH_LOOKUP_COUNT; ++i)
+            ++levels[linear ? find_bench_linear(usb_db, keys[i] >> 16, keys[i] & 0xffff, &match) :
+                lookup_usb_db_ids(usb_db, keys[i] >> 16, keys[i] & 0xffff, true, &match)];
+        seconds = get_usb_metrics_clock() - seconds;
+        if (round == 0 || seconds < best)
+            best = seconds;
+    }
+    printf(BENCH_LOOKUP_FORMAT, name, best / BENCH_LOOKUP_COUNT * 1e9,
+        levels[MATCH_VENDOR_AND_PRODUCT], levels[MATCH_VENDOR_ONLY], levels[MATCH_NONE]);
+}
+
+/**
+ * @brief Times the lookup engines against a linear scan of the database
+ *
+ * loads the shipped csv once with the hash index, then builds the
+ * Eytzinger trees, which take over the lookups once they exist; every
+ * path gets the same keys, so their match counts must be equal
+ *
+ * @details static int bench_usb_db_lookups(int engine)
+ * @param engine LOOKUP_ENGINE_HASH or LOOKUP_ENGINE_EYTZINGER, or
+ *        BENCH_ALL_ENGINES for both
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the database cannot be loaded
+ */
+static int bench_usb_db_lookups(int engine)
+{
+    usb_db_options_t options = {DATA_FILE_PATH, NULL, NULL, 0, LOOKUP_ENGINE_HASH};
+    usb_db_t usb_db = {0};
+    uint32_t *keys = NULL;
+    int result = EXIT_ERROR;
+
+    if (open_usb_db(&usb_db, &options) == EXIT_SUCCESS &&
+        (keys = generate_bench_keys(&usb_db)) != NULL) {
+        printf(BENCH_LOOKUPS_MESSAGE, (size_t)BENCH_LOOKUP_COUNT, usb_db.count, BENCH_ROUNDS);
+        time_bench_lookups("linear", &usb_db, keys, true);
+        if (engine != LOOKUP_ENGINE_EYTZINGER)
+            time_bench_lookups(LOOKUP_ENGINE_HASH_NAME, &usb_db, keys, false);
+        if (engine != LOOKUP_ENGINE_HASH && build_usb_db_eytzinger(&usb_db) == EXIT_SUCCESS)
+            time_bench_lookups(LOOKUP_ENGINE_EYTZINGER_NAME, &usb_db, keys, false);
+        result = EXIT_SUCCESS;
+    }
+    free(keys);
+    free_usb_db(&usb_db);
+    return result;
+}
+
+/**
+ * @brief Main function of druid-bench
+ *
+ * generates its own csv and key set and prints one line per measured
+ * path; "-e NAME" / "--engine NAME" restricts the lookups to one engine
+ * (both by default); used by the bench Makefile target
+ *
+ * @details int main(int ac, char **av)
+ * @param ac Argument count
+ * @param av Argument values
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) on failure
+ */
+int main(int ac, char **av)
+{
+    cli_args_t cli_args = {ac, av, 0, BENCH_ALL_ENGINES, USB_BACKEND_SYSTEMD, NULL, false,
+        USB_FORMAT_TEXT, false, NULL, NULL};
+
+    if (handle_engine_flag(&cli_args) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (cli_args.ac != 1) {
+        dprintf(STDERR_FILENO, BENCH_USAGE_MESSAGE);
+        return EXIT_ERROR;
+    }
+    if (bench_usb_db_delimiters() == EXIT_ERROR)
+        return EXIT_ERROR;
+    return bench_usb_db_lookups(cli_args.engine);
+}
@@ -0,0 +1,183 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file build_usb_db_directory.c
+ * @brief builds and searches the sorted vendor directory of the usb database
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Orders slots by key, then by row, so the first row of a key comes first
+ *
+ * @details int compare_usb_db_slots(const void *a, const void *b)
+ * @param a First usb_db_slot_t
+ * @param b Second usb_db_slot_t
+ * @return Negative, zero or positive like strcmp
+ */
+int compare_usb_db_slots(const void *a, const void *b)
+{
+    const usb_db_slot_t *first = a;
+    const usb_db_slot_t *second = b;
+
+    if (first->key != second->key)
+        return first->key < second->key ? -1 : 1;
+    return (first->entry > second->entry) - (first->entry < second->entry);
+}
+
+/**
+ * @brief Records the first row of every vendor and counts its products
+ *
+ * @details static size_t count_vendor_rows(
+ *             usb_db_t *usb_db,
+ *             uint32_t *firsts,
+ *             uint32_t *starts)
+ * @param usb_db Pointer to the loaded database
+ * @param firsts Receives the first row + 1 of every vendor id (USB_ID_COUNT elements)
+ * @param starts Receives the product count of vendor v in starts[v + 1]
+ * @return Number of distinct vendors
+ */
+static size_t count_vendor_rows(usb_db_t *usb_db, uint32_t *firsts, uint32_t *starts)
+{
+    usb_db_columns_t *columns = &usb_db->columns;
+    size_t vendor_count = 0;
+
+    for (size_t i = 0; i < usb_db->count; ++i) {
+        if (!(columns->id_flags[i] & ID_FLAG_VENDOR))
+            continue;
+        if (firsts[columns->vendor_ids[i]] == EMPTY_SLOT) {
+            firsts[columns->vendor_ids[i]] = (uint32_t)i + 1;
+            ++vendor_count;
+        }
+        if (columns->id_flags[i] & ID_FLAG_PRODUCT)
+            ++starts[columns->vendor_ids[i] + 1];
+    }
+    for (size_t v = 0; v < USB_ID_COUNT; ++v)
+        starts[v + 1] += starts[v];
+    return vendor_count;
+}
+
+/**
+ * @brief Distributes the product rows into their vendor spans
+ *
+ * counting sort on the vendor id: rows keep the database order inside
+ * a span, which is then sorted by product id and stripped of duplicate
+ * ids, so every vid/pid keeps its first row like the hash index
+ *
+ * @details static void fill_directory(
+ *             usb_db_t *usb_db,
+ *             const uint32_t *firsts,
+ *             uint32_t *starts)
+ * @param usb_db Pointer to the database holding the allocated directory
+ * @param firsts First row + 1 of every vendor id
+ * @param starts First product of every vendor id (consumed)
+ */
+static void fill_directory(usb_db_t *usb_db, const uint32_t *firsts, uint32_t *starts)
+{
+    usb_db_columns_t *columns = &usb_db->columns;
+    usb_db_directory_t *directory = &usb_db->directory;
+    size_t begin = 0;
+    size_t written = 0;
+    size_t vendor = 0;
+
+    for (size_t i = 0; i < usb_db->count; ++i) {
+        if ((columns->id_flags[i] & (ID_FLAG_VENDOR | ID_FLAG_PRODUCT)) !=
+            (ID_FLAG_VENDOR | ID_FLAG_PRODUCT))
+            continue;
+        directory->products[starts[columns->vendor_ids[i]]++] = (usb_db_slot_t){
+            ((uint32_t)columns->vendor_ids[i] << 16) | columns->product_ids[i], (uint32_t)i + 1};
+    }
+    for (size_t v = 0; v < USB_ID_COUNT; begin = starts[v++]) {
+        if (firsts[v] == EMPTY_SLOT)
+            continue;
+        directory->vendors[vendor++] = (usb_db_vendor_t){(uint32_t)v, firsts[v], (uint32_t)written};
+        qsort(&directory->products[begin], starts[v] - begin, sizeof(usb_db_slot_t),
+            compare_usb_db_slots);
+        for (size_t i = begin; i < starts[v]; ++i) {
+            if (i == begin || directory->products[i].key != directory->products[i - 1].key)
+                directory->products[written++] = directory->products[i];
+        }
+    }
+    directory->vendors[vendor] = (usb_db_vendor_t){0, EMPTY_SLOT, (uint32_t)written};
+    directory->product_count = written;
+}
+
+/**
+ * @brief Builds the sorted vendor directory over the numeric id columns
+ *
+ * one pass counts the vendors and their products, a second one places
+ * every product in its vendor span; rows whose vendor id is not
+ * hexadecimal are left out, rows with only a valid vendor id still make
+ * their vendor known
+ *
+ * @details int build_usb_db_directory(usb_db_t *usb_db)
+ * @param usb_db Pointer to the loaded usb_db_t structure
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int build_usb_db_directory(usb_db_t *usb_db)
+{
+    usb_db_directory_t *directory = &usb_db->directory;
+    uint32_t *firsts = calloc(USB_ID_COUNT, sizeof(uint32_t));
+    uint32_t *starts = calloc(USB_ID_COUNT + 1, sizeof(uint32_t));
+    int result = EXIT_ERROR;
+
+    if (firsts != NULL && starts != NULL) {
+        directory->vendor_count = count_vendor_rows(usb_db, firsts, starts);
+        directory->vendors = malloc(sizeof(usb_db_vendor_t) * (directory->vendor_count + 1));
+        directory->products = malloc(sizeof(usb_db_slot_t) * (starts[USB_ID_COUNT] + 1));
+    }
+    if (directory->vendors != NULL && directory->products != NULL) {
+        fill_directory(usb_db, firsts, starts);
+        result = EXIT_SUCCESS;
+    }
+    free(firsts);
+    free(starts);
+    return result;
+}
+
+/**
+ * @brief Finds a vendor in the directory with a binary search
+ *
+ * @details usb_db_vendor_t *find_usb_db_vendor(
+ *             usb_db_directory_t *directory,
+ *             uint16_t vendor_id)
+ * @param directory Pointer to the sorted vendor directory
+ * @param vendor_id Vendor id to look for
+ * @return Pointer to the vendor, or NULL if it is absent
+ */
+usb_db_vendor_t *find_usb_db_vendor(usb_db_directory_t *directory, uint16_t vendor_id)
+{
+    size_t low = 0;
+    size_t high = directory->vendor_count;
+    size_t middle = 0;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (directory->vendors[middle].vendor_id < vendor_id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < directory->vendor_count && directory->vendors[low].vendor_id == vendor_id)
+        return &directory->vendors[low];
+    return NULL;
+}
@@ -0,0 +1,174 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file build_usb_db_eytzinger.c
+ * @brief builds and searches the Eytzinger ordered lookup engine
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Lays sorted slots out in Eytzinger order
+ *
+ * an in-order walk of the implicit tree visits its nodes in key order,
+ * so the sorted slots are consumed one by one
+ *
+ * @details static size_t fill_eytzinger(
+ *             usb_db_eytzinger_t *eytzinger,
+ *             const usb_db_slot_t *sorted,
+ *             size_t next,
+ *             size_t node)
+ * @param eytzinger Tree being filled
+ * @param sorted Slots sorted by key
+ * @param next Next sorted slot to place
+ * @param node Current node (1 is the root)
+ * @return Next sorted slot to place after this subtree
+ */
+static size_t fill_eytzinger(usb_db_eytzinger_t *eytzinger,
+    const usb_db_slot_t *sorted, size_t next, size_t node)
+{
+    if (node > eytzinger->count)
+        return next;
+    next = fill_eytzinger(eytzinger, sorted, next, 2 * node);
+    eytzinger->keys[node] = sorted[next].key;
+    eytzinger->entries[node] = sorted[next].entry;
+    return fill_eytzinger(eytzinger, sorted, next + 1, 2 * node + 1);
+}
+
+/**
+ * @brief Allocates and fills one tree from sorted slots
+ *
+ * @details static int build_tree(
+ *             usb_db_eytzinger_t *eytzinger,
+ *             const usb_db_slot_t *sorted,
+ *             size_t count)
+ * @param eytzinger Tree to build
+ * @param sorted Slots sorted by key, without duplicate keys
+ * @param count Number of slots
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int build_tree(usb_db_eytzinger_t *eytzinger, const usb_db_slot_t *sorted,
+    size_t count)
+{
+    eytzinger->count = count;
+    eytzinger->keys = malloc(sizeof(uint32_t) * (count + 1));
+    eytzinger->entries = malloc(sizeof(uint32_t) * (count + 1));
+    if (eytzinger->keys == NULL || eytzinger->entries == NULL)
+        return EXIT_ERROR;
+    eytzinger->keys[0] = 0;
+    eytzinger->entries[0] = EMPTY_SLOT;
+    fill_eytzinger(eytzinger, sorted, 0, 1);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Builds the vid/pid and vendor trees of one database
+ *
+ * both come from the vendor directory, already sorted and holding the
+ * first row of every key, so the engine answers exactly like the hash
+ *
+ * @details static int build_database_trees(usb_db_t *usb_db)
+ * @param usb_db Pointer to the database
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int build_database_trees(usb_db_t *usb_db)
+{
+    usb_db_directory_t *directory = &usb_db->directory;
+    usb_db_slot_t *vendors = malloc(sizeof(usb_db_slot_t) * (directory->vendor_count + 1));
+    int result = EXIT_ERROR;
+
+    if (vendors == NULL)
+        return EXIT_ERROR;
+    for (size_t i = 0; i < directory->vendor_count; ++i)
+        vendors[i] = (usb_db_slot_t){directory->vendors[i].vendor_id, directory->vendors[i].entry};
+    if (build_tree(&usb_db->eytzinger_products, directory->products,
+        directory->product_count) == EXIT_SUCCESS &&
+        build_tree(&usb_db->eytzinger_vendors, vendors, directory->vendor_count) == EXIT_SUCCESS)
+        result = EXIT_SUCCESS;
+    free(vendors);
+    return result;
+}
+
+/**
+ * @brief Builds the Eytzinger lookup engine of a database and its base
+ *
+ * the trees are built in memory from the vendor directory whatever the
+ * source (CSV, compiled image or embedded table), in linear time
+ *
+ * @details int build_usb_db_eytzinger(usb_db_t *usb_db)
+ * @param usb_db Pointer to the loaded usb_db_t structure
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int build_usb_db_eytzinger(usb_db_t *usb_db)
+{
+    for (usb_db_t *db = usb_db; db != NULL; db = db->base) {
+        if (build_database_trees(db) == EXIT_ERROR)
+            return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Searches a key in an Eytzinger tree
+ *
+ * branchless descent computing the lower bound of the key: every step
+ * goes to 2k or 2k + 1 from the comparison, and the node EYTZINGER_PREFETCH
+ * times deeper (the cache line holding the four next levels) is fetched
+ * ahead; the trailing right turns are then undone to reach the lower bound
+ *
+ * @details uint32_t find_usb_db_eytzinger(
+ *             const usb_db_eytzinger_t *eytzinger,
+ *             uint32_t key)
+ * @param eytzinger Tree to search
+ * @param key Packed identifier (vid << 16 | pid, or vid for the vendor tree)
+ * @return The database row + 1, or EMPTY_SLOT if the key is absent
+ */
+uint32_t find_usb_db_eytzinger(const usb_db_eytzinger_t *eytzinger, uint32_t key)
+{
+    size_t node = 1;
+
+    while (node <= eytzinger->count) {
+        __builtin_prefetch(eytzinger->keys + node * EYTZINGER_PREFETCH);
+        node = 2 * node + (eytzinger->keys[node] < key);
+    }
+    node >>= __builtin_ffsll(~node);
+    if (node == 0 || eytzinger->keys[node] != key)
+        return EMPTY_SLOT;
+    return eytzinger->entries[node];
+}
+
+/**
+ * @brief Frees one Eytzinger tree
+ *
+ * @details void free_usb_db_eytzinger(usb_db_eytzinger_t *eytzinger)
+ * @param eytzinger Pointer to the tree to free
+ */
+void free_usb_db_eytzinger(usb_db_eytzinger_t *eytzinger)
+{
+    free(eytzinger->keys);
+    free(eytzinger->entries);
+    *eytzinger = (usb_db_eytzinger_t){NULL, NULL, 0};
+}
@@ -0,0 +1,320 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file build_usb_db_index.c
+ * @brief builds and queries the hash index over usb database entries
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Parses a 4 digit hexadecimal USB identifier from a field view
+ *
+ * converts fields such as "046d" to their numeric value, rejecting
+ * anything that is not exactly four hex digits ("Unknown", "#")
+ *
+ * @details int parse_usb_id_field(
+ *             const char *str,
+ *             size_t length,
+ *             uint16_t *id)
+ * @param str First character of the field (not null-terminated)
+ * @param length Length of the field
+ * @param id Pointer receiving the parsed identifier
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the identifier was parsed
+ *         - -1     (UNSEEN) if the field is not a valid identifier
+ */
+int parse_usb_id_field(const char *str, size_t length, uint16_t *id)
+{
+    uint16_t value = 0;
+    int digit = 0;
+
+    if (length != HEX_ID_LENGTH)
+        return UNSEEN;
+    for (size_t i = 0; i < HEX_ID_LENGTH; ++i) {
+        if (str[i] >= '0' && str[i] <= '9')
+            digit = str[i] - '0';
+        else if (str[i] >= 'a' && str[i] <= 'f')
+            digit = str[i] - 'a' + 10;
+        else if (str[i] >= 'A' && str[i] <= 'F')
+            digit = str[i] - 'A' + 10;
+        else
+            return UNSEEN;
+        value = (value * HEX_BASE) + digit;
+    }
+    *id = value;
+    return SUCCESS;
+}
+
+/**
+ * @brief Parses a null-terminated 4 digit hexadecimal USB identifier
+ *
+ * @details int parse_usb_id(const char *str, uint16_t *id)
+ * @param str Null-terminated identifier string (may be NULL)
+ * @param id Pointer receiving the parsed identifier
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the identifier was parsed
+ *         - -1     (UNSEEN) if the string is not a valid identifier
+ */
+int parse_usb_id(const char *str, uint16_t *id)
+{
+    if (str == NULL)
+        return UNSEEN;
+    return parse_usb_id_field(str, strnlen(str, HEX_ID_LENGTH + 1), id);
+}
+
+/**
+ * @brief Scrambles a packed key into a well distributed slot position
+ *
+ * packed ids are highly clustered (consecutive product ids of one vendor),
+ * so the key goes through a multiply/xor-shift finalizer before masking
+ *
+ * @details static size_t hash_key(uint32_t key, size_t mask)
+ * @param key Packed identifier (vid << 16 | pid)
+ * @param mask Table size minus one (table size is a power of two)
+ * @return Starting slot position for the key
+ */
+static size_t hash_key(uint32_t key, size_t mask)
+{
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return key & mask;
+}
+
+/**
+ * @brief Inserts a key in an open-addressing table, keeping the first row
+ *
+ * probes linearly from the hashed position; when the key is already present
+ * the existing slot is kept so that the earliest database row wins,
+ * exactly like the former sequential scan did; a full table (never built
+ * by build_usb_db_index) drops the key rather than probing forever
+ *
+ * @details static void insert_slot(
+ *             usb_db_slot_t *slots,
+ *             size_t mask,
+ *             uint32_t key,
+ *             size_t row)
+ * @param slots Table to insert into
+ * @param mask Table size minus one
+ * @param key Packed identifier
+ * @param row Index of the database entry
+ */
+static void insert_slot(usb_db_slot_t *slots, size_t mask, uint32_t key, size_t row)
+{
+    size_t pos = hash_key(key, mask);
+    size_t step = 0;
+
+    while (slots[pos].entry != EMPTY_SLOT) {
+        if (slots[pos].key == key || step++ == mask)
+            return;
+        pos = (pos + 1) & mask;
+    }
+    slots[pos].key = key;
+    slots[pos].entry = (uint32_t)row + 1;
+}
+
+/**
+ * @brief Finds a key in an open-addressing table
+ *
+ * probes at most every slot once, so a table without any empty slot
+ * (corrupted image) ends in a miss instead of an endless loop
+ *
+ * @details static usb_db_slot_t *find_slot(
+ *             usb_db_slot_t *slots,
+ *             size_t mask,
+ *             uint32_t key)
+ * @param slots Table to search
+ * @param mask Table size minus one
+ * @param key Packed identifier
+ * @return Pointer to the matching slot, or NULL if the key is absent
+ */
+static usb_db_slot_t *find_slot(usb_db_slot_t *slots, size_t mask, uint32_t key)
+{
+    size_t pos = hash_key(key, mask);
+
+    for (size_t step = 0; step <= mask && slots[pos].entry != EMPTY_SLOT; ++step) {
+        if (slots[pos].key == key)
+            return &slots[pos];
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Builds the hash index over all loaded database entries
+ *
+ * allocates a power-of-two table of packed vendor+product ids with at
+ * least INDEX_LOAD_FACTOR slots per entry, then inserts every row in
+ * database order from the numeric id columns; rows whose ids were not
+ * both hexadecimal ("Unknown") are left to the vendor directory
+ *
+ * @details int build_usb_db_index(usb_db_t *usb_db)
+ * @param usb_db Pointer to the loaded usb_db_t structure
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int build_usb_db_index(usb_db_t *usb_db)
+{
+    size_t size = 1;
+    usb_db_columns_t *columns = &usb_db->columns;
+
+    while (size < usb_db->count * INDEX_LOAD_FACTOR)
+        size <<= 1;
+    usb_db->index.mask = size - 1;
+    usb_db->index.products = calloc(size, sizeof(usb_db_slot_t));
+    if (usb_db->index.products == NULL)
+        return EXIT_ERROR;
+    for (size_t i = 0; i < usb_db->count; ++i) {
+        if ((columns->id_flags[i] & (ID_FLAG_VENDOR | ID_FLAG_PRODUCT)) !=
+            (ID_FLAG_VENDOR | ID_FLAG_PRODUCT))
+            continue;
+        insert_slot(usb_db->index.products, usb_db->index.mask,
+            ((uint32_t)columns->vendor_ids[i] << 16) | columns->product_ids[i], i);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Finds the first row of one database holding a key
+ *
+ * with the Eytzinger engine both levels search its trees; otherwise
+ * vid/pid keys go to the minimal perfect hash of the embedded table or
+ * to the open-addressing index of a loaded database, vendor keys to a
+ * binary search in the vendor directory; rows pointing past the columns
+ * (corrupted image) are treated as misses
+ *
+ * @details static int find_entry(
+ *             usb_db_t *usb_db,
+ *             bool product,
+ *             uint32_t key,
+ *             size_t *row)
+ * @param usb_db Pointer to the database to search
+ * @param product true for a vid/pid key, false for a vendor key
+ * @param key Packed identifier
+ * @param row Receives the matching row
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the key was found
+ *         - -1     (UNSEEN) if the key is absent
+ */
+static int find_entry(usb_db_t *usb_db, bool product, uint32_t key, size_t *row)
+{
+    usb_db_slot_t *slot = NULL;
+    usb_db_vendor_t *vendor = NULL;
+    uint32_t entry = EMPTY_SLOT;
+
+    if (usb_db->eytzinger_products.keys != NULL) {
+        entry = find_usb_db_eytzinger(product ? &usb_db->eytzinger_products :
+            &usb_db->eytzinger_vendors, key);
+    } else if (!product) {
+        vendor = find_usb_db_vendor(&usb_db->directory, (uint16_t)key);
+        entry = vendor != NULL ? vendor->entry : EMPTY_SLOT;
+    } else if (usb_db->embedded != NULL) {
+        entry = find_usb_db_mph(&usb_db->embedded->products, key);
+    } else if (usb_db->index.products != NULL) {
+        slot = find_slot(usb_db->index.products, usb_db->index.mask, key);
+        entry = slot != NULL ? slot->entry : EMPTY_SLOT;
+    }
+    if (entry == EMPTY_SLOT || entry > usb_db->count)
+        return UNSEEN;
+    *row = entry - 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief Looks up parsed ids in the database index
+ *
+ * a full vendor+product hit is a known device; otherwise the first
+ * database row sharing the vendor id, found in the vendor directory,
+ * makes it partially known; an update
+ * overlay is searched before the embedded table it is layered on, at
+ * each of the two levels; only reads the database, so any number of
+ * threads may look up at once
+ *
+ * @details int lookup_usb_db_ids(
+ *             usb_db_t *usb_db,
+ *             uint16_t vendor_id,
+ *             uint16_t product_id,
+ *             bool has_product,
+ *             usb_db_match_t *match)
+ * @param usb_db Pointer to the indexed usb_db_t structure
+ * @param vendor_id Vendor id of the device
+ * @param product_id Product id of the device
+ * @param has_product false if the product id of the device is not valid
+ * @param match Receives the matching row and its database (unchanged on MATCH_NONE)
+ * @return Match level:
+ *         - 2      (MATCH_VENDOR_AND_PRODUCT) known device
+ *         - 1      (MATCH_VENDOR_ONLY) vendor known, product unknown
+ *         - 0      (MATCH_NONE) unknown device
+ */
+int lookup_usb_db_ids(usb_db_t *usb_db, uint16_t vendor_id, uint16_t product_id,
+    bool has_product, usb_db_match_t *match)
+{
+    size_t row = 0;
+
+    for (usb_db_t *db = usb_db; has_product && db != NULL; db = db->base) {
+        if (find_entry(db, true, ((uint32_t)vendor_id << 16) | product_id, &row) == SUCCESS) {
+            *match = (usb_db_match_t){db, row};
+            return MATCH_VENDOR_AND_PRODUCT;
+        }
+    }
+    for (usb_db_t *db = usb_db; db != NULL; db = db->base) {
+        if (find_entry(db, false, vendor_id, &row) == SUCCESS) {
+            *match = (usb_db_match_t){db, row};
+            return MATCH_VENDOR_ONLY;
+        }
+    }
+    return MATCH_NONE;
+}
+
+/**
+ * @brief Looks up a connected device in the database index
+ *
+ * parses the ids read from the system, then see lookup_usb_db_ids; a
+ * device without a valid vendor id is unknown
+ *
+ * @details int lookup_usb_db_index(
+ *             usb_db_t *usb_db,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_db_match_t *match)
+ * @param usb_db Pointer to the indexed usb_db_t structure
+ * @param usb_device_info Pointer to the device to classify
+ * @param match Receives the matching row and its database (unchanged on MATCH_NONE)
+ * @return Match level:
+ *         - 2      (MATCH_VENDOR_AND_PRODUCT) known device
+ *         - 1      (MATCH_VENDOR_ONLY) vendor known, product unknown
+ *         - 0      (MATCH_NONE) unknown device
+ */
+int lookup_usb_db_index(usb_db_t *usb_db, usb_device_info_t *usb_device_info,
+    usb_db_match_t *match)
+{
+    uint16_t vendor_id = 0;
+    uint16_t product_id = 0;
+    bool has_product = false;
+
+    if (parse_usb_id(usb_device_info->vendor_id, &vendor_id) != SUCCESS)
+        return MATCH_NONE;
+    has_product = parse_usb_id(usb_device_info->product_id, &product_id) == SUCCESS;
+    return lookup_usb_db_ids(usb_db, vendor_id, product_id, has_product, match);
+}
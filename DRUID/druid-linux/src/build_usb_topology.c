@@ -0,0 +1,289 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file build_usb_topology.c
+ * @brief builds the tree of usb hubs, devices and interfaces from their bus-port paths
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Hashes a path (FNV-1a)
+ *
+ * @details static size_t hash_path(const char *path, size_t length, size_t mask)
+ * @param path First character of the path (not null-terminated)
+ * @param length Length of the path
+ * @param mask Table size minus one
+ * @return Starting slot position for the path
+ */
+static size_t hash_path(const char *path, size_t length, size_t mask)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)path[i];
+        hash *= FNV_PRIME;
+    }
+    return (hash ^ (hash >> 32)) & mask;
+}
+
+/**
+ * @brief Finds the slot of a path, or the empty slot where it belongs
+ *
+ * @details static uint32_t *find_path_slot(
+ *             usb_topology_t *topology,
+ *             const char *path,
+ *             size_t length)
+ * @param topology Pointer to the tree
+ * @param path First character of the path
+ * @param length Length of the path
+ * @return Pointer to the slot holding the node or to an empty slot
+ */
+static uint32_t *find_path_slot(usb_topology_t *topology, const char *path, size_t length)
+{
+    size_t pos = hash_path(path, length, topology->mask);
+    usb_topology_node_t *node = NULL;
+
+    while (topology->slots[pos] != EMPTY_SLOT) {
+        node = &topology->nodes[topology->slots[pos] - 1];
+        if (node->path.length == length &&
+            memcmp(topology->paths.data + node->path.offset, path, length) == SUCCESS)
+            break;
+        pos = (pos + 1) & topology->mask;
+    }
+    return &topology->slots[pos];
+}
+
+/**
+ * @brief Makes room for one more node, its path and its slot
+ *
+ * the node array and the path blob grow geometrically, the hash table
+ * is doubled and refilled once it would be half full
+ *
+ * @details static int grow_topology(usb_topology_t *topology, size_t length)
+ * @param topology Pointer to the tree
+ * @param length Length of the path about to be added
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails (the tree is kept)
+ */
+static int grow_topology(usb_topology_t *topology, size_t length)
+{
+    void *data = NULL;
+    size_t size = topology->slots != NULL ? (topology->mask + 1) * INCREASED_SIZE : USB_TOPOLOGY_SIZE;
+    size_t capacity = topology->capacity > 0 ? topology->capacity * INCREASED_SIZE : DEFAULT_SIZE;
+    size_t paths_capacity = topology->paths.capacity;
+
+    if (topology->count >= topology->capacity) {
+        data = realloc(topology->nodes, sizeof(usb_topology_node_t) * capacity);
+        if (data == NULL)
+            return EXIT_ERROR;
+        topology->nodes = data;
+        topology->capacity = capacity;
+    }
+    while (topology->paths.size + length > paths_capacity)
+        paths_capacity = paths_capacity > 0 ? paths_capacity * INCREASED_SIZE : USB_TOPOLOGY_SIZE;
+    if (paths_capacity != topology->paths.capacity) {
+        data = realloc(topology->paths.data, paths_capacity);
+        if (data == NULL)
+            return EXIT_ERROR;
+        topology->paths.data = data;
+        topology->paths.capacity = paths_capacity;
+    }
+    if (topology->slots != NULL && (topology->count + 1) * INDEX_LOAD_FACTOR <= topology->mask + 1)
+        return EXIT_SUCCESS;
+    data = calloc(size, sizeof(uint32_t));
+    if (data == NULL)
+        return EXIT_ERROR;
+    free(topology->slots);
+    topology->slots = data;
+    topology->mask = size - 1;
+    for (size_t i = 0; i < topology->count; ++i)
+        *find_path_slot(topology, topology->paths.data + topology->nodes[i].path.offset,
+            topology->nodes[i].path.length) = (uint32_t)i + 1;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Computes the path of the parent of a node
+ *
+ * an interface (1-2.3:1.0) hangs under its device (1-2.3), a device
+ * under the hub of its last port (1-2.3 under 1-2) and a device on a
+ * root port under the root hub of its bus (1-2 under usb1)
+ *
+ * @details static size_t get_parent_path(
+ *             const char *path,
+ *             size_t length,
+ *             char *root_hub,
+ *             const char **parent)
+ * @param path First character of the path
+ * @param length Length of the path
+ * @param root_hub Buffer of USB_ROOT_HUB_SIZE bytes for a root hub name
+ * @param parent Receives the first character of the parent path
+ * @return Length of the parent path, 0 for a root hub
+ */
+static size_t get_parent_path(const char *path, size_t length, char *root_hub,
+    const char **parent)
+{
+    const char *separator = memchr(path, USB_INTERFACE_SEPARATOR, length);
+    int written = 0;
+
+    *parent = path;
+    if (separator != NULL)
+        return separator - path;
+    for (size_t i = length; i > 0; --i) {
+        if (path[i - 1] == USB_PORT_SEPARATOR)
+            return i - 1;
+    }
+    separator = memchr(path, USB_BUS_SEPARATOR, length);
+    if (separator == NULL)
+        return 0;
+    written = snprintf(root_hub, USB_ROOT_HUB_SIZE, "%s%.*s", USB_ROOT_HUB_PREFIX,
+        (int)(separator - path), path);
+    if (written <= 0 || written >= USB_ROOT_HUB_SIZE)
+        return 0;
+    *parent = root_hub;
+    return written;
+}
+
+/**
+ * @brief Appends a new node and links it under its parent
+ *
+ * @details static int32_t append_node(
+ *             usb_topology_t *topology,
+ *             const char *path,
+ *             size_t length,
+ *             int32_t parent)
+ * @param topology Pointer to the tree, with room for the node
+ * @param path First character of the path
+ * @param length Length of the path
+ * @param parent Index of the parent node, or NO_NODE
+ * @return Index of the new node
+ */
+static int32_t append_node(usb_topology_t *topology, const char *path, size_t length,
+    int32_t parent)
+{
+    int32_t index = (int32_t)topology->count;
+    usb_topology_node_t *node = &topology->nodes[index];
+
+    node->path = (usb_db_field_t){(uint32_t)topology->paths.size, (uint32_t)length};
+    memcpy(topology->paths.data + topology->paths.size, path, length);
+    topology->paths.size += length;
+    node->parent = parent;
+    node->first_child = NO_NODE;
+    node->next_sibling = NO_NODE;
+    node->depth = 0;
+    if (memchr(path, USB_INTERFACE_SEPARATOR, length) != NULL)
+        node->kind = USB_NODE_INTERFACE;
+    else if (memchr(path, USB_BUS_SEPARATOR, length) == NULL)
+        node->kind = USB_NODE_HUB;
+    else
+        node->kind = USB_NODE_DEVICE;
+    if (parent != NO_NODE) {
+        node->depth = topology->nodes[parent].depth + (node->kind != USB_NODE_INTERFACE);
+        node->next_sibling = topology->nodes[parent].first_child;
+        topology->nodes[parent].first_child = index;
+        if (node->kind == USB_NODE_DEVICE)
+            topology->nodes[parent].kind = USB_NODE_HUB;
+    }
+    *find_path_slot(topology, path, length) = (uint32_t)index + 1;
+    ++topology->count;
+    return index;
+}
+
+/**
+ * @brief Finds the node of a path, creating it and its missing ancestors
+ *
+ * ancestors not enumerated (yet) are created from the path alone, so
+ * every node has its parent index cached whatever the enumeration order
+ *
+ * @details static int32_t insert_node(
+ *             usb_topology_t *topology,
+ *             const char *path,
+ *             size_t length)
+ * @param topology Pointer to the tree
+ * @param path First character of the path
+ * @param length Length of the path
+ * @return Index of the node, or NO_NODE if memory allocation fails
+ */
+static int32_t insert_node(usb_topology_t *topology, const char *path, size_t length)
+{
+    char root_hub[USB_ROOT_HUB_SIZE] = {0};
+    const char *parent_path = NULL;
+    size_t parent_length = 0;
+    int32_t parent = NO_NODE;
+
+    if (topology->slots != NULL && *find_path_slot(topology, path, length) != EMPTY_SLOT)
+        return (int32_t)*find_path_slot(topology, path, length) - 1;
+    parent_length = get_parent_path(path, length, root_hub, &parent_path);
+    if (parent_length > 0) {
+        parent = insert_node(topology, parent_path, parent_length);
+        if (parent == NO_NODE)
+            return NO_NODE;
+    }
+    if (grow_topology(topology, length) == EXIT_ERROR)
+        return NO_NODE;
+    return append_node(topology, path, length, parent);
+}
+
+/**
+ * @brief Adds an enumerated device to the usb tree
+ *
+ * one pass over the enumeration builds the tree: each node is found or
+ * created from its bus-port path and its hub depth is read from the
+ * cached parent chain; interfaces hang under their device so the caller
+ * classifies the physical device only once
+ *
+ * @details int add_usb_topology_node(
+ *             usb_topology_t *topology,
+ *             usb_device_info_t *usb_device_info)
+ * @param topology Pointer to the tree (zeroed before the first call)
+ * @param usb_device_info Pointer to the device, receives its hub depth
+ * @return USB_NODE_HUB, USB_NODE_DEVICE or USB_NODE_INTERFACE, or
+ *         -1 (UNSEEN) if the device has no path or memory allocation fails
+ */
+int add_usb_topology_node(usb_topology_t *topology, usb_device_info_t *usb_device_info)
+{
+    int32_t index = NO_NODE;
+
+    usb_device_info->hub_depth = UNSEEN;
+    if (usb_device_info->path_usb == NULL || usb_device_info->path_usb[0] == '\0')
+        return UNSEEN;
+    index = insert_node(topology, usb_device_info->path_usb, strlen(usb_device_info->path_usb));
+    if (index == NO_NODE)
+        return UNSEEN;
+    usb_device_info->hub_depth = topology->nodes[index].depth;
+    return topology->nodes[index].kind;
+}
+
+/**
+ * @brief Frees the usb tree
+ *
+ * @details void free_usb_topology(usb_topology_t *topology)
+ * @param topology Pointer to the tree (may be empty)
+ */
+void free_usb_topology(usb_topology_t *topology)
+{
+    free(topology->nodes);
+    free(topology->paths.data);
+    free(topology->slots);
+    *topology = (usb_topology_t){0};
+}
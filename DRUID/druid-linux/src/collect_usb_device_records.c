@@ -0,0 +1,151 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file collect_usb_device_records.c
+ * @brief keeps enumerated usb devices until the database is ready
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Copies one value into the strings of the records
+ *
+ * @details static int add_record_string(
+ *             usb_db_blob_t *strings,
+ *             const char *value,
+ *             uint32_t *offset)
+ * @param strings Strings of the records (null-terminated values)
+ * @param value Value to copy (may be NULL)
+ * @param offset Receives the offset of the copy + 1, or 0 for NULL
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int add_record_string(usb_db_blob_t *strings, const char *value, uint32_t *offset)
+{
+    size_t length = 0;
+    size_t capacity = strings->capacity;
+    char *data = NULL;
+
+    *offset = 0;
+    if (value == NULL)
+        return EXIT_SUCCESS;
+    length = strlen(value) + 1;
+    if (strings->size + length >= UINT32_MAX)
+        return EXIT_ERROR;
+    while (strings->size + length > capacity)
+        capacity = capacity > 0 ? capacity * INCREASED_SIZE : USB_TOPOLOGY_SIZE;
+    if (capacity != strings->capacity) {
+        data = realloc(strings->data, capacity);
+        if (data == NULL)
+            return EXIT_ERROR;
+        strings->data = data;
+        strings->capacity = capacity;
+    }
+    memcpy(strings->data + strings->size, value, length);
+    *offset = (uint32_t)strings->size + 1;
+    strings->size += length;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Keeps a copy of an enumerated device
+ *
+ * the values of a backend only live until its next move, so they are
+ * copied next to each other in one growing buffer
+ *
+ * @details int add_usb_device_record(
+ *             usb_device_records_t *records,
+ *             usb_device_info_t *usb_device_info)
+ * @param records Pointer to the pending records
+ * @param usb_device_info Pointer to the device to keep
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int add_usb_device_record(usb_device_records_t *records, usb_device_info_t *usb_device_info)
+{
+    const char *values[USB_PROPERTY_COUNT] = {usb_device_info->vendor_id,
+        usb_device_info->vendor_name, usb_device_info->product_id,
+        usb_device_info->product_name, usb_device_info->serial,
+        usb_device_info->path_usb};
+    usb_device_record_t *record = NULL;
+    size_t capacity = records->capacity > 0 ? records->capacity * INCREASED_SIZE : DEFAULT_SIZE;
+    void *data = NULL;
+
+    if (records->count >= records->capacity) {
+        data = realloc(records->records, sizeof(usb_device_record_t) * capacity);
+        if (data == NULL)
+            return EXIT_ERROR;
+        records->records = data;
+        records->capacity = capacity;
+    }
+    record = &records->records[records->count];
+    for (int i = 0; i < USB_PROPERTY_COUNT; ++i) {
+        if (add_record_string(&records->strings, values[i], &record->values[i]) == EXIT_ERROR)
+            return EXIT_ERROR;
+    }
+    record->hub_depth = usb_device_info->hub_depth;
+    ++records->count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads back a kept device
+ *
+ * @details void get_usb_device_record(
+ *             usb_device_records_t *records,
+ *             size_t i,
+ *             usb_device_info_t *usb_device_info)
+ * @param records Pointer to the pending records
+ * @param i Position of the device
+ * @param usb_device_info Pointer to the device info to fill (valid until the records are freed)
+ */
+void get_usb_device_record(usb_device_records_t *records, size_t i,
+    usb_device_info_t *usb_device_info)
+{
+    usb_device_record_t *record = &records->records[i];
+    const char *values[USB_PROPERTY_COUNT] = {NULL};
+
+    for (int j = 0; j < USB_PROPERTY_COUNT; ++j)
+        values[j] = record->values[j] != 0 ?
+            records->strings.data + record->values[j] - 1 : NULL;
+    usb_device_info->vendor_id = values[USB_PROPERTY_VENDOR_ID];
+    usb_device_info->vendor_name = values[USB_PROPERTY_VENDOR_NAME];
+    usb_device_info->product_id = values[USB_PROPERTY_PRODUCT_ID];
+    usb_device_info->product_name = values[USB_PROPERTY_PRODUCT_NAME];
+    usb_device_info->serial = values[USB_PROPERTY_SERIAL];
+    usb_device_info->path_usb = values[USB_PROPERTY_PATH];
+    usb_device_info->hub_depth = record->hub_depth;
+}
+
+/**
+ * @brief Frees the pending records
+ *
+ * @details void free_usb_device_records(usb_device_records_t *records)
+ * @param records Pointer to the pending records (may be empty)
+ */
+void free_usb_device_records(usb_device_records_t *records)
+{
+    free(records->records);
+    free(records->strings.data);
+    *records = (usb_device_records_t){0};
+}
@@ -0,0 +1,283 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file compile_usb_db_image.c
+ * @brief compiles the CSV usb database into a mappable binary image
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request a database compilation
+ *
+ * @details static int check_for_compile_db_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the compile flag is present
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_compile_db_flag(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 2 &&
+        (strcmp(cli_args->av[1], COMPILE_DB_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], COMPILE_DB_FLAG_OPTION) == SUCCESS)) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Rounds an image offset up to the section alignment
+ *
+ * @details static uint64_t align_offset(uint64_t offset)
+ * @param offset Offset to align
+ * @return The aligned offset
+ */
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + DB_IMAGE_ALIGNMENT - 1) & ~(uint64_t)(DB_IMAGE_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Writes one section to the image followed by alignment padding
+ *
+ * @details static int write_section(
+ *             FILE *image_file,
+ *             const void *data,
+ *             size_t size)
+ * @param image_file Image being written
+ * @param data Section content
+ * @param size Section size in bytes
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if writing fails
+ */
+static int write_section(FILE *image_file, const void *data, size_t size)
+{
+    static const char padding[DB_IMAGE_ALIGNMENT] = {0};
+    size_t padding_size = align_offset(size) - size;
+
+    if (size > 0 && fwrite(data, size, 1, image_file) != 1)
+        return EXIT_ERROR;
+    if (padding_size > 0 && fwrite(padding, padding_size, 1, image_file) != 1)
+        return EXIT_ERROR;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Fills the image header: source stamp and section layout
+ *
+ * @details static void fill_image_header(
+ *             usb_db_image_header_t *header,
+ *             usb_db_t *usb_db,
+ *             struct stat *csv_stat,
+ *             size_t strings_size)
+ * @param header Pointer to the header to fill
+ * @param usb_db Pointer to the loaded database
+ * @param csv_stat Status of the CSV source taken before parsing
+ * @param strings_size Size of the string blob
+ */
+static void fill_image_header(usb_db_image_header_t *header, usb_db_t *usb_db,
+    struct stat *csv_stat, size_t strings_size)
+{
+    uint64_t slots = usb_db->index.mask + 1;
+
+    memcpy(header->magic, DB_IMAGE_MAGIC, DB_IMAGE_MAGIC_SIZE);
+    header->version = DB_IMAGE_VERSION;
+    header->count = (uint32_t)usb_db->count;
+    header->csv_mtime_sec = csv_stat->st_mtim.tv_sec;
+    header->csv_mtime_nsec = csv_stat->st_mtim.tv_nsec;
+    header->csv_size = csv_stat->st_size;
+    header->csv_checksum = checksum_usb_db_file(DATA_FILE_PATH);
+    header->index_slots = slots;
+    header->vendor_count = usb_db->directory.vendor_count;
+    header->product_count = usb_db->directory.product_count;
+    header->vendor_ids_offset = align_offset(sizeof(usb_db_image_header_t));
+    header->product_ids_offset = header->vendor_ids_offset +
+        align_offset(usb_db->count * sizeof(uint16_t));
+    header->id_flags_offset = header->product_ids_offset +
+        align_offset(usb_db->count * sizeof(uint16_t));
+    header->vendor_names_offset = header->id_flags_offset +
+        align_offset(usb_db->count * sizeof(uint8_t));
+    header->product_names_offset = header->vendor_names_offset +
+        align_offset(usb_db->count * sizeof(usb_db_field_t));
+    header->products_offset = header->product_names_offset +
+        align_offset(usb_db->count * sizeof(usb_db_field_t));
+    header->directory_vendors_offset = header->products_offset +
+        align_offset(slots * sizeof(usb_db_slot_t));
+    header->directory_products_offset = header->directory_vendors_offset +
+        align_offset((header->vendor_count + 1) * sizeof(usb_db_vendor_t));
+    header->strings_offset = header->directory_products_offset +
+        align_offset(header->product_count * sizeof(usb_db_slot_t));
+    header->strings_size = strings_size;
+}
+
+/**
+ * @brief Writes the header and every section of the image
+ *
+ * the id columns are written as they were parsed, only the names are
+ * re-packed into a compact blob
+ *
+ * @details static int write_image_sections(
+ *             FILE *image_file,
+ *             usb_db_t *usb_db,
+ *             usb_db_image_header_t *header,
+ *             usb_db_field_t *vendor_names,
+ *             usb_db_field_t *product_names,
+ *             usb_db_blob_t *blob)
+ * @param image_file Image being written
+ * @param usb_db Pointer to the loaded and indexed database
+ * @param header Pointer to the filled header
+ * @param vendor_names Vendor name views into the blob
+ * @param product_names Product name views into the blob
+ * @param blob Pointer to the packed names
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if writing fails
+ */
+static int write_image_sections(FILE *image_file, usb_db_t *usb_db,
+    usb_db_image_header_t *header, usb_db_field_t *vendor_names,
+    usb_db_field_t *product_names, usb_db_blob_t *blob)
+{
+    size_t count = usb_db->count;
+    size_t slots_size = header->index_slots * sizeof(usb_db_slot_t);
+
+    if (write_section(image_file, header, sizeof(usb_db_image_header_t)) == EXIT_ERROR ||
+        write_section(image_file, usb_db->columns.vendor_ids, count * sizeof(uint16_t)) == EXIT_ERROR ||
+        write_section(image_file, usb_db->columns.product_ids, count * sizeof(uint16_t)) == EXIT_ERROR ||
+        write_section(image_file, usb_db->columns.id_flags, count * sizeof(uint8_t)) == EXIT_ERROR ||
+        write_section(image_file, vendor_names, count * sizeof(usb_db_field_t)) == EXIT_ERROR ||
+        write_section(image_file, product_names, count * sizeof(usb_db_field_t)) == EXIT_ERROR ||
+        write_section(image_file, usb_db->index.products, slots_size) == EXIT_ERROR ||
+        write_section(image_file, usb_db->directory.vendors,
+            (header->vendor_count + 1) * sizeof(usb_db_vendor_t)) == EXIT_ERROR ||
+        write_section(image_file, usb_db->directory.products,
+            header->product_count * sizeof(usb_db_slot_t)) == EXIT_ERROR ||
+        write_section(image_file, blob->data, blob->size) == EXIT_ERROR)
+        return EXIT_ERROR;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Serializes a loaded database into an image file
+ *
+ * @details static int write_usb_db_image(
+ *             usb_db_t *usb_db,
+ *             struct stat *csv_stat,
+ *             const char *image_path)
+ * @param usb_db Pointer to the loaded and indexed database
+ * @param csv_stat Status of the CSV source taken before parsing
+ * @param image_path Path of the image to write
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if allocation or writing fails
+ */
+static int write_usb_db_image(usb_db_t *usb_db, struct stat *csv_stat,
+    const char *image_path)
+{
+    usb_db_image_header_t header = {0};
+    usb_db_blob_t blob = {NULL, 0, 0};
+    usb_db_field_t *vendor_names = malloc(sizeof(usb_db_field_t) * (usb_db->count + 1));
+    usb_db_field_t *product_names = malloc(sizeof(usb_db_field_t) * (usb_db->count + 1));
+    FILE *image_file = NULL;
+    int result = EXIT_ERROR;
+
+    if (vendor_names != NULL && product_names != NULL &&
+        pack_usb_db_names(usb_db, vendor_names, product_names, &blob) == EXIT_SUCCESS)
+        image_file = fopen(image_path, WRITE_BINARY_MODE);
+    if (image_file != NULL) {
+        fill_image_header(&header, usb_db, csv_stat, blob.size);
+        result = write_image_sections(image_file, usb_db, &header,
+            vendor_names, product_names, &blob);
+        if (fclose(image_file) != SUCCESS)
+            result = EXIT_ERROR;
+    }
+    free(blob.data);
+    free(vendor_names);
+    free(product_names);
+    return result;
+}
+
+/**
+ * @brief Compiles the CSV database into the binary image if it changed
+ *
+ * an image that still matches the CSV (same mtime, or same checksum)
+ * is left untouched; otherwise the CSV is parsed, indexed and written
+ * to a temporary file that atomically replaces the image, so druid
+ * processes mapping the old image are never disturbed
+ *
+ * @details static int compile_usb_db_image(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the image is up to date or was written
+ *         - 84     (EXIT_ERROR) on failure
+ */
+static int compile_usb_db_image(cli_args_t *cli_args)
+{
+    usb_db_t usb_db = {0};
+    usb_db_options_t options = {DATA_FILE_PATH, NULL, NULL, cli_args->jobs, LOOKUP_ENGINE_HASH};
+    struct stat csv_stat = {0};
+    int result = EXIT_ERROR;
+
+    if (load_usb_db_from_image(&usb_db, DATA_IMAGE_PATH, DATA_FILE_PATH) == SUCCESS) {
+        free_usb_db(&usb_db);
+        printf(COMPILE_DB_UP_TO_DATE_MESSAGE, DATA_IMAGE_PATH);
+        return EXIT_SUCCESS;
+    }
+    if (stat(DATA_FILE_PATH, &csv_stat) < 0) {
+        dprintf(STDERR_FILENO, UNKNOWN_FILE_MESSAGE);
+        return EXIT_ERROR;
+    }
+    if (load_usb_db_from_csv(&usb_db, &options) == EXIT_SUCCESS &&
+        write_usb_db_image(&usb_db, &csv_stat, DATA_IMAGE_TEMP_PATH) == EXIT_SUCCESS &&
+        rename(DATA_IMAGE_TEMP_PATH, DATA_IMAGE_PATH) == SUCCESS)
+        result = EXIT_SUCCESS;
+    if (result == EXIT_SUCCESS) {
+        printf(COMPILE_DB_DONE_MESSAGE, DATA_IMAGE_PATH, usb_db.count);
+    } else {
+        unlink(DATA_IMAGE_TEMP_PATH);
+        dprintf(STDERR_FILENO, COMPILE_DB_ERROR_MESSAGE);
+    }
+    free_usb_db(&usb_db);
+    return result;
+}
+
+/**
+ * @brief Handles the database compilation CLI flag
+ *
+ * @details int handle_compile_db_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the image is up to date or was written
+ *         - 84     (EXIT_ERROR) if the compilation failed
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_compile_db_flag(cli_args_t *cli_args)
+{
+    if (check_for_compile_db_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    if (check_embedded_usb_db()) {
+        dprintf(STDERR_FILENO, EMBEDDED_DB_COMPILE_MESSAGE);
+        return EXIT_ERROR;
+    }
+    return compile_usb_db_image(cli_args);
+}
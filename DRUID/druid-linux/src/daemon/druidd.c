@@ -0,0 +1,82 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file druidd.c
+ * @brief lookup server keeping the usb database resident (druidd)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks that only flags druidd understands were given
+ *
+ * @details static int check_druidd_args(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure left after the shared flags
+ * @return Exit code:
+ *         - 0      (SUCCESS) if nothing, or an update file, is left
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_druidd_args(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 1)
+        return SUCCESS;
+    if (cli_args->ac == 3 &&
+        (strcmp(cli_args->av[1], UPDATE_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], UPDATE_FLAG_OPTION) == SUCCESS))
+        return SUCCESS;
+    return UNSEEN;
+}
+
+/**
+ * @brief Main function of druidd
+ *
+ * takes the database flags of druid (--update, --jobs, --engine) and its
+ * enumeration flags (--backend, --sysfs-root, --devices, --replay,
+ * --per-port, used by scan requests), loads the database once and
+ * serves lookups on the DRUID_SOCKET socket until SIGINT or SIGTERM;
+ * used by the druidd Makefile target
+ *
+ * @details int main(int ac, char **av)
+ * @param ac Argument count
+ * @param av Argument values
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) when stopped by a signal
+ *         - 84     (EXIT_ERROR) on failure
+ */
+int main(int ac, char **av)
+{
+    cli_args_t cli_args = {ac, av, 0, LOOKUP_ENGINE_HASH, USB_BACKEND_SYSTEMD, NULL, false,
+        USB_FORMAT_TEXT, false, NULL, NULL};
+    usb_db_t usb_db = {0};
+    int result = EXIT_ERROR;
+
+    if (handle_jobs_flag(&cli_args) == EXIT_ERROR ||
+        handle_engine_flag(&cli_args) == EXIT_ERROR ||
+        handle_backend_flag(&cli_args) == EXIT_ERROR ||
+        handle_per_port_flag(&cli_args) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (check_druidd_args(&cli_args) == UNSEEN) {
+        dprintf(STDERR_FILENO, DRUIDD_USAGE_MESSAGE);
+        return EXIT_ERROR;
+    }
+    if (load_usb_db_from_file(&usb_db, &cli_args) == EXIT_SUCCESS)
+        result = serve_usb_lookups(&usb_db, &cli_args);
+    free_usb_db(&usb_db);
+    return result;
+}
@@ -0,0 +1,75 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file decode_usb_db_entry.c
+ * @brief decodes the name views of a database entry for display
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Resolves one field view against the database text
+ *
+ * a view that does not fit in the text (corrupted image) decodes
+ * to an empty string instead of reading out of bounds
+ *
+ * @details static void decode_field(
+ *             usb_db_t *usb_db,
+ *             usb_db_field_t *field,
+ *             const char **str,
+ *             int *length)
+ * @param usb_db Pointer to the usb_db_t structure holding the text
+ * @param field View to resolve
+ * @param str Receives the first character of the field
+ * @param length Receives the length of the field
+ */
+static void decode_field(usb_db_t *usb_db, usb_db_field_t *field,
+    const char **str, int *length)
+{
+    if ((size_t)field->offset + field->length > usb_db->text_size) {
+        *str = "";
+        *length = 0;
+        return;
+    }
+    *str = usb_db->text + field->offset;
+    *length = (int)field->length;
+}
+
+/**
+ * @brief Decodes the vendor and product names of a matched row
+ *
+ * fields are only resolved when a device is displayed; the result points
+ * into the mapped database text and is printed with "%.*s"
+ *
+ * @details void decode_usb_db_entry(
+ *             usb_db_t *usb_db,
+ *             size_t row,
+ *             usb_db_names_t *usb_db_names)
+ * @param usb_db Pointer to the usb_db_t structure holding the text
+ * @param row Matched database row
+ * @param usb_db_names Pointer to the usb_db_names_t structure to fill
+ */
+void decode_usb_db_entry(usb_db_t *usb_db, size_t row,
+    usb_db_names_t *usb_db_names)
+{
+    decode_field(usb_db, &usb_db->columns.vendor_names[row],
+        &usb_db_names->vendor_name, &usb_db_names->vendor_name_length);
+    decode_field(usb_db, &usb_db->columns.product_names[row],
+        &usb_db_names->product_name, &usb_db_names->product_name_length);
+}
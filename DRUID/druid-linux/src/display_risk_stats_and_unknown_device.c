@@ -24,6 +24,35 @@
 #include <systemd/sd-device.h>
 #include "druid.h"
 
+/**
+ * @brief Closes a device box, after its location in the usb tree
+ *
+ * the port and hub depth line is only printed when the backend gave a
+ * bus-port path, so boxes of devices without one are unchanged
+ *
+ * @details static void display_usb_device_footer(
+ *             usb_device_info_t *usb_device_info,
+ *             usb_output_t *output)
+ * @param usb_device_info Pointer to the structure containing current USB device info
+ * @param output Pointer to the output the box is rendered to
+ */
+static void display_usb_device_footer(usb_device_info_t *usb_device_info,
+    usb_output_t *output)
+{
+    if (usb_device_info->path_usb != NULL && usb_device_info->hub_depth >= 0) {
+        print_usb_output(output, USB_RENDER_ANSI,
+            "│ Port (\e[1;36m%s\e[0m)   │   Hub depth (\e[1;36m%d\e[0m)\n│\n",
+            usb_device_info->path_usb, usb_device_info->hub_depth);
+        print_usb_output(output, USB_RENDER_PLAIN,
+            "│ Port (%s)   │   Hub depth (%d)\n│\n",
+            usb_device_info->path_usb, usb_device_info->hub_depth);
+    }
+    print_usb_output(output, USB_RENDER_ANSI,
+        "\e[1;37m╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\e[0m\n\n");
+    print_usb_output(output, USB_RENDER_PLAIN,
+        "╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\n\n");
+}
+
 /**
  * @brief Displays detailed information for a fully known USB device
  *
@@ -32,19 +61,19 @@
  *
  * @details void display_known_usb_device(
  *             usb_device_info_t *usb_device_info,
- *             usb_db_entry_t *usb_db_entry,
+ *             usb_db_names_t *usb_db_names,
  *             usb_risk_stats_stats_t *usb_risk_stats,
- *             FILE *output_file)
+ *             usb_output_t *output)
  * @param usb_device_info Pointer to the structure containing current USB device info
- * @param usb_db_entry Pointer to the matching USB database entry (vendor and product matched)
+ * @param usb_db_names Pointer to the decoded names of the matching database entry (vendor and product matched)
  * @param usb_risk_stats Pointer to the risk statistics structure to update the low risk counter
- * @param output_file Optional file pointer to write output (if not NULL)
+ * @param output Pointer to the output the box is rendered to (console, --output file)
  */
 void display_known_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file)
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output)
 {
-    printf(
+    print_usb_output(output, USB_RENDER_ANSI,
         "\e[1;37m╭───────────────────────────────────────────────── Device n°""\e[1;32m%lu\e[0m ""\e[1;37m─────────────────────────────────────────────────╮\e[0m\n"
         "│ VendorID  (\e[1;32m%s\e[0m)   │   ProductID (\e[1;32m%s\e[0m)\n"
         "│\n"
@@ -52,19 +81,16 @@ void display_known_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (\e[1;34m%s\e[0m)   │   Product Name (\e[1;34m%s\e[0m)\n"
         "│\n"
         "│ \e[1;36mFrom Database\e[0m:\n"
-        "│     Vendor Name (\e[1;34m%s\e[0m)   │   Product Name (\e[1;34m%s\e[0m)\n"
-        "│\n"
-        "\e[1;37m╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\e[0m\n\n",
+        "│     Vendor Name (\e[1;34m%.*s\e[0m)   │   Product Name (\e[1;34m%.*s\e[0m)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    ++usb_risk_stats->low;
-    if (output_file != NULL) {
-        fprintf(output_file, 
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    print_usb_output(output, USB_RENDER_PLAIN,
         "╭──────────────────────────────────────────── Known USB Device n°%lu ────────────────────────────────────────────╮\n"
         "│ VendorID  (%s)   │   ProductID (%s)\n"
         "│\n"
@@ -72,17 +98,22 @@ void display_known_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (%s)   │   Product Name (%s)\n"
         "│\n"
         "│ From Database:\n"
-        "│     Vendor Name (%s)   │   Product Name (%s)\n"
-        "│\n"
-        "╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\n\n",
+        "│     Vendor Name (%.*s)   │   Product Name (%.*s)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    }
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    display_usb_device_footer(usb_device_info, output);
+    print_usb_json_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_AND_PRODUCT,
+        usb_risk_stats->seen_count);
+    print_usb_report_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_AND_PRODUCT);
+    print_usb_journal_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_AND_PRODUCT);
+    ++usb_risk_stats->low;
+    end_usb_output_record(output);
 }
 
 /**
@@ -94,19 +125,19 @@ void display_known_usb_device(usb_device_info_t *usb_device_info,
  *
  * @details void display_partially_known_usb_device(
  *             usb_device_info_t *usb_device_info,
- *             usb_db_entry_t *usb_db_entry,
+ *             usb_db_names_t *usb_db_names,
  *             usb_risk_stats_stats_t *usb_risk_stats,
- *             FILE *output_file)
+ *             usb_output_t *output)
  * @param usb_device_info Pointer to the structure containing current USB device info
- * @param usb_db_entry Pointer to the partially matching USB database entry (vendor matched only)
+ * @param usb_db_names Pointer to the decoded names of the partially matching database entry (vendor matched only)
  * @param usb_risk_stats Pointer to the risk statistics structure to update the medium risk counter
- * @param output_file Optional file pointer to write output (if not NULL)
+ * @param output Pointer to the output the box is rendered to (console, --output file)
  */
 void display_partially_known_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file)
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output)
 {
-    printf(
+    print_usb_output(output, USB_RENDER_ANSI,
         "\e[1;37m╭───────────────────────────────────────────────── Device n°""\e[1;33m%lu\e[0m ""\e[1;37m─────────────────────────────────────────────────╮\e[0m\n"
         "│ VendorID  (\e[1;32m%s\e[0m)   │   ProductID (\e[1;31mUnknown : %s\e[0m)\n"
         "│\n"
@@ -114,19 +145,16 @@ void display_partially_known_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (\e[1;34m%s\e[0m)   │   Product Name (\e[1;34m%s\e[0m)\n"
         "│\n"
         "│ \e[1;36mFrom Database\e[0m:\n"
-        "│     Vendor Name (\e[1;31m%s\e[0m)   │   Product Name (\e[1;31m%s\e[0m)\n"
-        "│\n"
-        "\e[1;37m╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\e[0m\n\n",
+        "│     Vendor Name (\e[1;31m%.*s\e[0m)   │   Product Name (\e[1;31m%.*s\e[0m)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    ++usb_risk_stats->medium;
-    if (output_file != NULL) {
-        fprintf(output_file, 
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    print_usb_output(output, USB_RENDER_PLAIN,
         "╭──────────────────────────────────────────── Partially Known USB Device n°%lu ──────────────────────────────────╮\n"
         "│ VendorID  (%s)   │   ProductID (Unknown : %s)\n"
         "│\n"
@@ -134,17 +162,22 @@ void display_partially_known_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (%s)   │   Product Name (%s)\n"
         "│\n"
         "│ From Database:\n"
-        "│     Vendor Name (%s)   │   Product Name (%s)\n"
-        "│\n"
-        "╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\n\n",
+        "│     Vendor Name (%.*s)   │   Product Name (%.*s)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    }
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    display_usb_device_footer(usb_device_info, output);
+    print_usb_json_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_ONLY,
+        usb_risk_stats->seen_count);
+    print_usb_report_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_ONLY);
+    print_usb_journal_device(output, usb_device_info, usb_db_names, MATCH_VENDOR_ONLY);
+    ++usb_risk_stats->medium;
+    end_usb_output_record(output);
 }
 
 /**
@@ -155,19 +188,19 @@ void display_partially_known_usb_device(usb_device_info_t *usb_device_info,
  *
  * @details void display_unknown_usb_device(
  *             usb_device_info_t *usb_device_info,
- *             usb_db_entry_t *usb_db_entry,
+ *             usb_db_names_t *usb_db_names,
  *             usb_risk_stats_stats_t *usb_risk_stats,
- *             FILE *output_file)
+ *             usb_output_t *output)
  * @param usb_device_info Pointer to the structure containing current USB device info
- * @param usb_db_entry Pointer to the database entry (likely empty/placeholder)
+ * @param usb_db_names Pointer to the placeholder names of the unknown device
  * @param usb_risk_stats Pointer to the risk statistics structure to update the major risk counter
- * @param output_file Optional file pointer to write output (if not NULL)
+ * @param output Pointer to the output the box is rendered to (console, --output file)
  */
 void display_unknown_usb_device(usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file)
+    usb_db_names_t *usb_db_names, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output)
 {
-    printf(
+    print_usb_output(output, USB_RENDER_ANSI,
         "\e[1;37m╭───────────────────────────────────────────────── Device n°""\e[1;31m%lu\e[0m ""\e[1;37m─────────────────────────────────────────────────╮\e[0m\n"
         "│ VendorID  (\e[1;31mUnknown : %s\e[0m)   │   ProductID (\e[1;31mUnknown : %s\e[0m)\n"
         "│\n"
@@ -175,19 +208,16 @@ void display_unknown_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (\e[1;31m%s\e[0m)   │   Product Name (\e[1;31m%s\e[0m)\n"
         "│\n"
         "│ \e[1;36mFrom Database\e[0m:\n"
-        "│     Vendor Name (\e[1;31m%s\e[0m)   │   Product Name (\e[1;31m%s\e[0m)\n"
-        "│\n"
-        "\e[1;37m╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\e[0m\n\n",
+        "│     Vendor Name (\e[1;31m%.*s\e[0m)   │   Product Name (\e[1;31m%.*s\e[0m)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    ++usb_risk_stats->major;
-    if (output_file != NULL) {
-        fprintf(output_file, 
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    print_usb_output(output, USB_RENDER_PLAIN,
         "╭──────────────────────────────────────────── Unknown USB Device n°%lu ──────────────────────────────────────────╮\n"
         "│ VendorID  (Unknown : %s)   │   ProductID (Unknown : %s)\n"
         "│\n"
@@ -195,34 +225,40 @@ void display_unknown_usb_device(usb_device_info_t *usb_device_info,
         "│     Vendor Name (%s)   │   Product Name (%s)\n"
         "│\n"
         "│ From Database:\n"
-        "│     Vendor Name (%s)   │   Product Name (%s)\n"
-        "│\n"
-        "╰────────────────────────────────────────────────────────────────────────────────────────────────────────────╯\n\n",
+        "│     Vendor Name (%.*s)   │   Product Name (%.*s)\n"
+        "│\n",
         usb_risk_stats->seen_count,
         usb_device_info->vendor_id,
         usb_device_info->product_id,
         usb_device_info->vendor_name,
         usb_device_info->product_name,
-        usb_db_entry->vendor_name,
-        usb_db_entry->product_name);
-    }
+        usb_db_names->vendor_name_length, usb_db_names->vendor_name,
+        usb_db_names->product_name_length, usb_db_names->product_name);
+    display_usb_device_footer(usb_device_info, output);
+    print_usb_json_device(output, usb_device_info, usb_db_names, MATCH_NONE,
+        usb_risk_stats->seen_count);
+    print_usb_report_device(output, usb_device_info, usb_db_names, MATCH_NONE);
+    print_usb_journal_device(output, usb_device_info, usb_db_names, MATCH_NONE);
+    ++usb_risk_stats->major;
+    end_usb_output_record(output);
 }
 
 /**
  * @brief Displays a summary table of detected USB risk levels
  *
  * Prints the count of devices categorized as low, medium, and major risk
- * Output is printed to the console and optionally written to an output file
+ * Output is rendered for the console and, with --output, for the output file
+ * (as the summary record in json and ndjson, in the footer of a binary report)
  *
  * @details void display_risk_table(
  *             usb_risk_stats_stats_t *usb_risk_stats,
- *             FILE *output_file)
+ *             usb_output_t *output)
  * @param usb_risk_stats Pointer to the structure containing aggregated risk counters
- * @param output_file Optional file pointer to write output (if not NULL)
+ * @param output Pointer to the output the box is rendered to (console, --output file)
  */
-void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, FILE *output_file)
+void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output)
 {
-    printf(
+    print_usb_output(output, USB_RENDER_ANSI,
         "\e[1;37m╭───────── Risk table ─────────╮\e[0m\n"
         "│ Number Low Risk    :  \e[1;32m%lu\e[0m \n"
         "│\n"
@@ -231,8 +267,7 @@ void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, FILE *output_fil
         "│ Number Major Risk  :  \e[1;31m%lu\e[0m \n"
         "\e[1;37m╰─────────────────────────────╯\e[0m\n\n",
     usb_risk_stats->low, usb_risk_stats->medium, usb_risk_stats->major);
-    if (output_file != NULL) {
-        fprintf(output_file,
+    print_usb_output(output, USB_RENDER_PLAIN,
         "╭───────── Risk table ─────────╮\n"
         "│ Number Low Risk    :  %lu \n"
         "│\n"
@@ -241,5 +276,8 @@ void display_risk_table(usb_risk_stats_stats_t *usb_risk_stats, FILE *output_fil
         "│ Number Major Risk  :  %lu \n"
         "╰─────────────────────────────╯\n\n",
     usb_risk_stats->low, usb_risk_stats->medium, usb_risk_stats->major);
-    }
+    print_usb_json_risk_table(output, usb_risk_stats);
+    print_usb_report_risk_table(output, usb_risk_stats);
+    print_usb_journal_risk_table(output, usb_risk_stats);
+    end_usb_output_record(output);
 }
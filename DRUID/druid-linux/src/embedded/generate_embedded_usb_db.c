@@ -0,0 +1,438 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file generate_embedded_usb_db.c
+ * @brief build-time generator of the database table embedded in druid-embedded
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Orders buckets by decreasing size (packed as size << 32 | bucket)
+ *
+ * @details static int compare_buckets(const void *a, const void *b)
+ * @param a First packed bucket
+ * @param b Second packed bucket
+ * @return Negative, zero or positive like strcmp
+ */
+static int compare_buckets(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *)a;
+    uint64_t second = *(const uint64_t *)b;
+
+    return (first < second) - (first > second);
+}
+
+/**
+ * @brief Tries one seed for a bucket and places its keys if it fits
+ *
+ * @details static bool place_bucket(
+ *             usb_db_slot_t *slots,
+ *             uint32_t slot_count,
+ *             const usb_db_slot_t *keys,
+ *             size_t size,
+ *             uint32_t seed)
+ * @param slots Slots of the perfect hash (entry 0 means free)
+ * @param slot_count Number of slots
+ * @param keys Keys of the bucket
+ * @param size Number of keys in the bucket
+ * @param seed Seed to try
+ * @return true if every key landed in a distinct free slot
+ */
+static bool place_bucket(usb_db_slot_t *slots, uint32_t slot_count,
+    const usb_db_slot_t *keys, size_t size, uint32_t seed)
+{
+    uint32_t positions[MPH_BUCKET_SIZE * 8] = {0};
+
+    if (size > sizeof(positions) / sizeof(positions[0]))
+        return false;
+    for (size_t i = 0; i < size; ++i) {
+        positions[i] = hash_usb_db_mph(keys[i].key, seed) % slot_count;
+        if (slots[positions[i]].entry != EMPTY_SLOT)
+            return false;
+        for (size_t j = 0; j < i; ++j) {
+            if (positions[j] == positions[i])
+                return false;
+        }
+    }
+    for (size_t i = 0; i < size; ++i)
+        slots[positions[i]] = keys[i];
+    return true;
+}
+
+/**
+ * @brief Finds the smallest seed placing a whole bucket
+ *
+ * @details static int place_bucket_with_seed(
+ *             usb_db_slot_t *slots,
+ *             uint32_t slot_count,
+ *             const usb_db_slot_t *keys,
+ *             size_t size,
+ *             uint32_t *seed)
+ * @param slots Slots of the perfect hash (entry 0 means free)
+ * @param slot_count Number of slots
+ * @param keys Keys of the bucket
+ * @param size Number of keys in the bucket
+ * @param seed Receives the seed of the bucket
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if a seed was found
+ *         - 84     (EXIT_ERROR) if no seed below MPH_MAX_SEED fits
+ */
+static int place_bucket_with_seed(usb_db_slot_t *slots, uint32_t slot_count,
+    const usb_db_slot_t *keys, size_t size, uint32_t *seed)
+{
+    for (*seed = 1; *seed < MPH_MAX_SEED; ++(*seed)) {
+        if (place_bucket(slots, slot_count, keys, size, *seed))
+            return EXIT_SUCCESS;
+    }
+    return EXIT_ERROR;
+}
+
+/**
+ * @brief Groups the keys by bucket and orders the buckets by size
+ *
+ * counting sort on the bucket of every key; order receives the buckets
+ * packed as size << 32 | bucket, largest first
+ *
+ * @details static void group_keys(
+ *             const usb_db_slot_t *keys,
+ *             uint32_t count,
+ *             uint32_t buckets,
+ *             usb_db_slot_t *grouped,
+ *             size_t *starts,
+ *             uint64_t *order)
+ * @param keys Distinct keys with their rows
+ * @param count Number of keys
+ * @param buckets Number of buckets
+ * @param grouped Receives the keys, bucket after bucket
+ * @param starts Receives the first key of every bucket (buckets + 1 elements)
+ * @param order Receives the buckets, largest first
+ */
+static void group_keys(const usb_db_slot_t *keys, uint32_t count, uint32_t buckets,
+    usb_db_slot_t *grouped, size_t *starts, uint64_t *order)
+{
+    uint32_t bucket = 0;
+
+    for (uint32_t i = 0; i < count; ++i)
+        ++starts[hash_usb_db_mph(keys[i].key, 0) % buckets + 1];
+    for (uint32_t i = 0; i < buckets; ++i) {
+        order[i] = ((uint64_t)starts[i + 1] << 32) | i;
+        starts[i + 1] += starts[i];
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        bucket = hash_usb_db_mph(keys[i].key, 0) % buckets;
+        grouped[starts[bucket]++] = keys[i];
+    }
+    for (uint32_t i = buckets; i > 0; --i)
+        starts[i] = starts[i - 1];
+    starts[0] = 0;
+    qsort(order, buckets, sizeof(uint64_t), compare_buckets);
+}
+
+/**
+ * @brief Builds a minimal perfect hash over distinct keys
+ *
+ * hash and displace: keys are grouped in buckets of MPH_BUCKET_SIZE on
+ * average, then the largest buckets first take the smallest seed that
+ * sends all their keys to free slots; there are exactly as many slots
+ * as keys, so the table has no hole and lookups never probe
+ *
+ * @details static int build_mph(
+ *             const usb_db_slot_t *keys,
+ *             uint32_t count,
+ *             usb_db_mph_t *mph)
+ * @param keys Distinct keys with their rows
+ * @param count Number of keys
+ * @param mph Receives the seeds and slots (allocated, freed by the caller)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) on allocation failure or if no seed fits
+ */
+static int build_mph(const usb_db_slot_t *keys, uint32_t count, usb_db_mph_t *mph)
+{
+    uint32_t buckets = count / MPH_BUCKET_SIZE + 1;
+    uint64_t *order = calloc(buckets, sizeof(uint64_t));
+    size_t *starts = calloc(buckets + 1, sizeof(size_t));
+    usb_db_slot_t *grouped = calloc(count + 1, sizeof(usb_db_slot_t));
+    uint32_t *seeds = calloc(buckets, sizeof(uint32_t));
+    usb_db_slot_t *slots = calloc(count + 1, sizeof(usb_db_slot_t));
+    uint32_t bucket = 0;
+    int result = EXIT_ERROR;
+
+    *mph = (usb_db_mph_t){seeds, slots, buckets, count};
+    if (order != NULL && starts != NULL && grouped != NULL && seeds != NULL && slots != NULL) {
+        group_keys(keys, count, buckets, grouped, starts, order);
+        result = EXIT_SUCCESS;
+    }
+    for (uint32_t i = 0; result == EXIT_SUCCESS && i < buckets && (order[i] >> 32) > 0; ++i) {
+        bucket = (uint32_t)order[i];
+        result = place_bucket_with_seed(slots, count, &grouped[starts[bucket]],
+            order[i] >> 32, &seeds[bucket]);
+    }
+    free(order);
+    free(starts);
+    free(grouped);
+    return result;
+}
+
+/**
+ * @brief Writes a run of packed names as a C string literal piece
+ *
+ * quotes, backslashes, question marks (trigraphs) and non printable
+ * bytes are escaped in octal so the literal is byte-exact
+ *
+ * @details static void write_c_string(FILE *out, const char *str, size_t length)
+ * @param out Generated file
+ * @param str First byte to write
+ * @param length Number of bytes to write
+ */
+static void write_c_string(FILE *out, const char *str, size_t length)
+{
+    unsigned char c = 0;
+
+    fputs("    \"", out);
+    for (size_t i = 0; i < length; ++i) {
+        c = (unsigned char)str[i];
+        if (c == '"' || c == '\\' || c == '?' || c < ' ' || c > '~')
+            fprintf(out, "\\%03o", c);
+        else
+            fputc(c, out);
+    }
+    fputs("\"\n", out);
+}
+
+/**
+ * @brief Writes one numeric column as a C array
+ *
+ * @details static void write_column(
+ *             FILE *out,
+ *             const char *declaration,
+ *             const void *column,
+ *             size_t width,
+ *             size_t count)
+ * @param out Generated file
+ * @param declaration Type and name of the generated array
+ * @param column First element of the column
+ * @param width Size of one element (sizeof(uint16_t) or sizeof(uint8_t))
+ * @param count Number of elements
+ */
+static void write_column(FILE *out, const char *declaration, const void *column,
+    size_t width, size_t count)
+{
+    unsigned int value = 0;
+
+    fprintf(out, "static const %s[] = {", declaration);
+    for (size_t i = 0; i < count; ++i) {
+        value = width == sizeof(uint16_t) ? ((const uint16_t *)column)[i] :
+            ((const uint8_t *)column)[i];
+        fprintf(out, "%s0x%0*x,", i % 12 == 0 ? "\n    " : " ", (int)width * 2, value);
+    }
+    if (count == 0)
+        fprintf(out, "\n    0,");
+    fprintf(out, "\n};\n\n");
+}
+
+/**
+ * @brief Writes one column of name views
+ *
+ * @details static void write_names(
+ *             FILE *out,
+ *             const char *name,
+ *             const usb_db_field_t *names,
+ *             size_t count)
+ * @param out Generated file
+ * @param name Name of the generated array
+ * @param names Views into the packed names
+ * @param count Number of views
+ */
+static void write_names(FILE *out, const char *name, const usb_db_field_t *names,
+    size_t count)
+{
+    fprintf(out, "static const usb_db_field_t %s[] = {", name);
+    for (size_t i = 0; i < count; ++i)
+        fprintf(out, "%s{%u, %u},", i % 6 == 0 ? "\n    " : " ",
+            names[i].offset, names[i].length);
+    if (count == 0)
+        fprintf(out, "\n    {0, 0},");
+    fprintf(out, "\n};\n\n");
+}
+
+/**
+ * @brief Writes the numeric columns, the name views and the packed names
+ *
+ * only the names reach the generated text, repeated vendor names once,
+ * so the table is much smaller than the CSV it comes from
+ *
+ * @details static int write_columns(FILE *out, usb_db_t *usb_db)
+ * @param out Generated file
+ * @param usb_db Pointer to the loaded database
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int write_columns(FILE *out, usb_db_t *usb_db)
+{
+    usb_db_blob_t blob = {NULL, 0, 0};
+    usb_db_field_t *vendor_names = malloc(sizeof(usb_db_field_t) * (usb_db->count + 1));
+    usb_db_field_t *product_names = malloc(sizeof(usb_db_field_t) * (usb_db->count + 1));
+    int result = EXIT_ERROR;
+
+    if (vendor_names != NULL && product_names != NULL &&
+        pack_usb_db_names(usb_db, vendor_names, product_names, &blob) == EXIT_SUCCESS) {
+        write_column(out, "uint16_t vendor_ids", usb_db->columns.vendor_ids,
+            sizeof(uint16_t), usb_db->count);
+        write_column(out, "uint16_t product_ids", usb_db->columns.product_ids,
+            sizeof(uint16_t), usb_db->count);
+        write_column(out, "uint8_t id_flags", usb_db->columns.id_flags,
+            sizeof(uint8_t), usb_db->count);
+        write_names(out, "vendor_names", vendor_names, usb_db->count);
+        write_names(out, "product_names", product_names, usb_db->count);
+        fprintf(out, "static const char text[] =\n");
+        for (size_t pos = 0; pos < blob.size; pos += EMBEDDED_TEXT_PIECE)
+            write_c_string(out, blob.data + pos, blob.size - pos < EMBEDDED_TEXT_PIECE ?
+                blob.size - pos : EMBEDDED_TEXT_PIECE);
+        fprintf(out, "    \"\";\n\n");
+        result = EXIT_SUCCESS;
+    }
+    free(blob.data);
+    free(vendor_names);
+    free(product_names);
+    return result;
+}
+
+/**
+ * @brief Writes the seeds and slots of one perfect hash
+ *
+ * @details static void write_mph(FILE *out, const char *name, usb_db_mph_t *mph)
+ * @param out Generated file
+ * @param name Prefix of the generated arrays
+ * @param mph Perfect hash to write
+ */
+static void write_mph(FILE *out, const char *name, usb_db_mph_t *mph)
+{
+    fprintf(out, "static const uint32_t %s_seeds[] = {", name);
+    for (uint32_t i = 0; i < mph->bucket_count; ++i)
+        fprintf(out, "%s%u,", i % 16 == 0 ? "\n    " : " ", mph->seeds[i]);
+    fprintf(out, "\n};\n\nstatic const usb_db_slot_t %s_slots[] = {", name);
+    for (uint32_t i = 0; i < mph->slot_count; ++i)
+        fprintf(out, "%s{0x%08x, %u},", i % 4 == 0 ? "\n    " : " ",
+            mph->slots[i].key, mph->slots[i].entry);
+    if (mph->slot_count == 0)
+        fprintf(out, "\n    {0, 0},");
+    fprintf(out, "\n};\n\n");
+}
+
+/**
+ * @brief Writes the sorted vendor directory
+ *
+ * @details static void write_directory(FILE *out, usb_db_directory_t *directory)
+ * @param out Generated file
+ * @param directory Vendor directory built by the loader
+ */
+static void write_directory(FILE *out, usb_db_directory_t *directory)
+{
+    fprintf(out, "static const usb_db_vendor_t directory_vendors[] = {");
+    for (size_t i = 0; i <= directory->vendor_count; ++i)
+        fprintf(out, "%s{0x%04x, %u, %u},", i % 4 == 0 ? "\n    " : " ",
+            directory->vendors[i].vendor_id, directory->vendors[i].entry,
+            directory->vendors[i].start);
+    fprintf(out, "\n};\n\nstatic const usb_db_slot_t directory_products[] = {");
+    for (size_t i = 0; i < directory->product_count; ++i)
+        fprintf(out, "%s{0x%08x, %u},", i % 4 == 0 ? "\n    " : " ",
+            directory->products[i].key, directory->products[i].entry);
+    if (directory->product_count == 0)
+        fprintf(out, "\n    {0, 0},");
+    fprintf(out, "\n};\n\n");
+}
+
+/**
+ * @brief Writes the whole generated translation unit
+ *
+ * @details static int write_embedded_usb_db(
+ *             FILE *out,
+ *             usb_db_t *usb_db,
+ *             usb_db_mph_t *products)
+ * @param out Generated file
+ * @param usb_db Pointer to the loaded database
+ * @param products Perfect hash over vid/pid keys
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int write_embedded_usb_db(FILE *out, usb_db_t *usb_db, usb_db_mph_t *products)
+{
+    fprintf(out, "/* generated by make druid-embedded from %s, do not edit */\n\n"
+        "#include <stdio.h>\n#include <stdbool.h>\n#include <stddef.h>\n"
+        "#include <stdint.h>\n#include <systemd/sd-device.h>\n"
+        "#include \"druid.h\"\n\n", DATA_FILE_PATH);
+    if (write_columns(out, usb_db) == EXIT_ERROR)
+        return EXIT_ERROR;
+    write_mph(out, "product", products);
+    write_directory(out, &usb_db->directory);
+    fprintf(out, "const usb_db_embedded_t embedded_usb_db = {\n"
+        "    vendor_ids, product_ids, id_flags, vendor_names, product_names,\n"
+        "    %lu, text, sizeof(text) - 1,\n"
+        "    {product_seeds, product_slots, %u, %u},\n"
+        "    directory_vendors, directory_products, %lu, %lu\n};\n",
+        usb_db->count, products->bucket_count, products->slot_count,
+        usb_db->directory.vendor_count, usb_db->directory.product_count);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Generates the embedded database translation unit
+ *
+ * parses DATA_FILE_PATH with the regular loader (same rows, same
+ * precedence), builds the perfect hash over the distinct vid/pid keys
+ * of the vendor directory and writes the C file given as argument;
+ * used by the druid-embedded Makefile target
+ *
+ * @details int main(int ac, char **av)
+ * @param ac Argument count
+ * @param av Argument values (av[1] is the file to generate)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) on failure
+ */
+int main(int ac, char **av)
+{
+    usb_db_options_t options = {DATA_FILE_PATH, NULL, NULL, 0, LOOKUP_ENGINE_HASH};
+    usb_db_t usb_db = {0};
+    usb_db_mph_t products = {0};
+    FILE *out = NULL;
+    int result = EXIT_ERROR;
+
+    if (ac != 2 || load_usb_db_from_csv(&usb_db, &options) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (build_mph(usb_db.directory.products, usb_db.directory.product_count,
+        &products) == EXIT_SUCCESS &&
+        (out = fopen(av[1], WRITE_BINARY_MODE)) != NULL) {
+        result = write_embedded_usb_db(out, &usb_db, &products);
+        if (fclose(out) != SUCCESS)
+            result = EXIT_ERROR;
+    }
+    if (result == EXIT_ERROR)
+        unlink(av[1]);
+    free((void *)products.seeds);
+    free((void *)products.slots);
+    free_usb_db(&usb_db);
+    return result;
+}
@@ -0,0 +1,157 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file enumerate_usb_device_list.c
+ * @brief replays usb devices listed in a file (--devices)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Opens the device list file
+ *
+ * @details static int open_usb_device_list(usb_tools_t *usb_tools, const char *path)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the list state
+ * @param path Path of the device list
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the file cannot be opened
+ */
+static int open_usb_device_list(usb_tools_t *usb_tools, const char *path)
+{
+    if (path != NULL)
+        usb_tools->device_list.file = fopen(path, READ_MODE);
+    if (usb_tools->device_list.file == NULL) {
+        dprintf(STDERR_FILENO, DEVICE_LIST_ERROR_MESSAGE, path);
+        return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Splits a device list line in place into its fields
+ *
+ * fields are separated like the database (VendorID;VendorName;ProductID;
+ * ProductName) and may be followed by the serial number and the bus-port
+ * path; missing or empty fields are left NULL
+ *
+ * @details static void split_device_list_line(
+ *             usb_device_list_t *device_list,
+ *             char *line)
+ * @param device_list Pointer to the usb_device_list_t state receiving the fields
+ * @param line Line without its newline
+ */
+static void split_device_list_line(usb_device_list_t *device_list, char *line)
+{
+    char *field = NULL;
+
+    for (int i = 0; i < USB_PROPERTY_COUNT; ++i) {
+        field = strsep(&line, FILE_SEPARATOR);
+        device_list->fields[i] = field != NULL && field[0] != '\0' ? field : NULL;
+    }
+}
+
+/**
+ * @brief Moves to the next device of the list
+ *
+ * the file is streamed one line at a time, so memory does not grow with
+ * the number of devices; empty lines and lines starting with '#' are
+ * skipped
+ *
+ * @details static int next_usb_device_list_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the list state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) at the end of the file
+ */
+static int next_usb_device_list_device(usb_tools_t *usb_tools)
+{
+    usb_device_list_t *device_list = &usb_tools->device_list;
+    ssize_t length = 0;
+
+    while ((length = getline(&device_list->line, &device_list->line_size,
+        device_list->file)) >= 0) {
+        while (length > 0 && (device_list->line[length - 1] == LINE_SEPARATOR ||
+            device_list->line[length - 1] == '\r'))
+            --length;
+        device_list->line[length] = '\0';
+        if (length == 0 || device_list->line[0] == DEVICE_LIST_COMMENT)
+            continue;
+        split_device_list_line(device_list, device_list->line);
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Restarts the list at its first device
+ *
+ * @details static int first_usb_device_list_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the list state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) if the list is empty
+ */
+static int first_usb_device_list_device(usb_tools_t *usb_tools)
+{
+    rewind(usb_tools->device_list.file);
+    return next_usb_device_list_device(usb_tools);
+}
+
+/**
+ * @brief Reads a property of the current listed device
+ *
+ * @details static const char *get_usb_device_list_property(
+ *             usb_tools_t *usb_tools,
+ *             int property)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the list state
+ * @param property USB_PROPERTY_* to read
+ * @return The field, or NULL if the line does not have it
+ */
+static const char *get_usb_device_list_property(usb_tools_t *usb_tools, int property)
+{
+    if (property < 0 || property >= USB_PROPERTY_COUNT)
+        return NULL;
+    return usb_tools->device_list.fields[property];
+}
+
+/**
+ * @brief Closes the device list and frees the line buffer
+ *
+ * @details static void close_usb_device_list(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure (list may be unopened)
+ */
+static void close_usb_device_list(usb_tools_t *usb_tools)
+{
+    usb_device_list_t *device_list = &usb_tools->device_list;
+
+    if (device_list->file != NULL)
+        fclose(device_list->file);
+    free(device_list->line);
+    *device_list = (usb_device_list_t){0};
+}
+
+/* device list backend operations (--devices) */
+const usb_backend_t device_list_usb_backend = {
+    open_usb_device_list,
+    first_usb_device_list_device,
+    next_usb_device_list_device,
+    get_usb_device_list_property,
+    close_usb_device_list
+};
@@ -0,0 +1,361 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file enumerate_usb_replay.c
+ * @brief replays usb devices from udevadm or lsusb dumps (--replay)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* udev properties of an export-db record, indexed by USB_PROPERTY_* */
+static const char *const replay_properties[USB_PROPERTY_PATH] = {
+    VENDOR_ID, VENDOR_NAME, PRODUCT_ID, PRODUCT_NAME, SERIAL_NUMBER
+};
+
+/**
+ * @brief Opens the dump and allocates its read buffer
+ *
+ * "-" replays the standard input, so a dump can be piped from another
+ * host or from a decompressor
+ *
+ * @details static int open_usb_replay(usb_tools_t *usb_tools, const char *path)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the replay state
+ * @param path Path of the dump, or "-" for the standard input
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the dump cannot be opened
+ */
+static int open_usb_replay(usb_tools_t *usb_tools, const char *path)
+{
+    usb_replay_t *replay = &usb_tools->replay;
+
+    replay->fd = -1;
+    if (path != NULL)
+        replay->fd = strcmp(path, REPLAY_STDIN) == SUCCESS ?
+            STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (replay->fd >= 0)
+        replay->buffer = malloc(REPLAY_BUFFER_SIZE);
+    if (replay->buffer == NULL) {
+        dprintf(STDERR_FILENO, REPLAY_ERROR_MESSAGE, path);
+        return EXIT_ERROR;
+    }
+    posix_fadvise(replay->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Refills the read buffer after the unread bytes
+ *
+ * the unread bytes are moved to the front first; when a whole buffer
+ * holds no newline, the line is too long to be a record line and is
+ * dropped up to its newline
+ *
+ * @details static void fill_replay_buffer(usb_replay_t *replay)
+ * @param replay Pointer to the replay state
+ */
+static void fill_replay_buffer(usb_replay_t *replay)
+{
+    ssize_t length = 0;
+
+    if (replay->start > 0) {
+        memmove(replay->buffer, replay->buffer + replay->start, replay->end - replay->start);
+        replay->end -= replay->start;
+        replay->start = 0;
+    }
+    if (replay->end == REPLAY_BUFFER_SIZE) {
+        replay->end = 0;
+        replay->skip_line = true;
+    }
+    do {
+        length = read(replay->fd, replay->buffer + replay->end, REPLAY_BUFFER_SIZE - replay->end);
+    } while (length < 0 && errno == EINTR);
+    if (length <= 0)
+        replay->eof = true;
+    else
+        replay->end += length;
+}
+
+/**
+ * @brief Reads the next line of the dump, without its line ending
+ *
+ * lines are returned in place in the read buffer, so memory stays at one
+ * buffer whatever the size of the dump
+ *
+ * @details static char *read_replay_line(usb_replay_t *replay, size_t *length)
+ * @param replay Pointer to the replay state
+ * @param length Receives the length of the line
+ * @return The first character of the line (valid until the next read),
+ *         or NULL at the end of the dump
+ */
+static char *read_replay_line(usb_replay_t *replay, size_t *length)
+{
+    char *line = NULL;
+    char *newline = NULL;
+
+    while (true) {
+        line = replay->buffer + replay->start;
+        newline = memchr(line, LINE_SEPARATOR, replay->end - replay->start);
+        if (newline == NULL && replay->eof && replay->start < replay->end)
+            newline = replay->buffer + replay->end;
+        if (newline != NULL) {
+            replay->start = newline - replay->buffer + (newline < replay->buffer + replay->end);
+            if (replay->skip_line) {
+                replay->skip_line = false;
+                continue;
+            }
+            *length = newline - line;
+            if (*length > 0 && line[*length - 1] == '\r')
+                --*length;
+            return line;
+        }
+        if (replay->eof)
+            return NULL;
+        fill_replay_buffer(replay);
+    }
+}
+
+/**
+ * @brief Copies a value of the current record, truncated to its slot
+ *
+ * @details static void copy_replay_value(char *value, const char *str, size_t length)
+ * @param value Slot of REPLAY_VALUE_SIZE bytes
+ * @param str First character of the value (not null-terminated)
+ * @param length Length of the value
+ */
+static void copy_replay_value(char *value, const char *str, size_t length)
+{
+    if (length >= REPLAY_VALUE_SIZE)
+        length = REPLAY_VALUE_SIZE - 1;
+    memcpy(value, str, length);
+    value[length] = '\0';
+}
+
+/**
+ * @brief Reads one lsusb line
+ *
+ * "Bus 001 Device 003: ID 046d:c52b Logitech, Inc. Unifying Receiver";
+ * lsusb joins the vendor and product names, so the description is kept
+ * as the product name and there is no bus-port path
+ *
+ * @details static int parse_lsusb_line(
+ *             usb_replay_t *replay,
+ *             const char *line,
+ *             size_t length)
+ * @param replay Pointer to the replay state receiving the values
+ * @param line First character of the line
+ * @param length Length of the line
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the line holds a vendor and a product id
+ *         - -1     (UNSEEN) otherwise
+ */
+static int parse_lsusb_line(usb_replay_t *replay, const char *line, size_t length)
+{
+    const char *id = memchr(line, REPLAY_LSUSB_ID[0], length);
+    const char *end = line + length;
+
+    if (id == NULL || (size_t)(end - id) < sizeof(REPLAY_LSUSB_ID) - 1 ||
+        memcmp(id, REPLAY_LSUSB_ID, sizeof(REPLAY_LSUSB_ID) - 1) != SUCCESS)
+        return UNSEEN;
+    id += sizeof(REPLAY_LSUSB_ID) - 1;
+    if (end - id < REPLAY_LSUSB_ID_SIZE || id[4] != ':')
+        return UNSEEN;
+    copy_replay_value(replay->values[USB_PROPERTY_VENDOR_ID], id, 4);
+    copy_replay_value(replay->values[USB_PROPERTY_PRODUCT_ID], id + 5, 4);
+    id += REPLAY_LSUSB_ID_SIZE;
+    while (id < end && *id == ' ')
+        ++id;
+    copy_replay_value(replay->values[USB_PROPERTY_PRODUCT_NAME], id, end - id);
+    return SUCCESS;
+}
+
+/**
+ * @brief Reads one property line ("E: KEY=VALUE") of an export-db record
+ *
+ * @details static void parse_export_db_property(
+ *             usb_replay_t *replay,
+ *             const char *line,
+ *             size_t length,
+ *             bool *usb_device)
+ * @param replay Pointer to the replay state receiving the values
+ * @param line First character of the property (after "E: ")
+ * @param length Length of the property
+ * @param usb_device Set when the record is a whole usb device
+ */
+static void parse_export_db_property(usb_replay_t *replay, const char *line,
+    size_t length, bool *usb_device)
+{
+    const char *equal = memchr(line, '=', length);
+    size_t key_length = 0;
+
+    if (equal == NULL)
+        return;
+    key_length = equal - line;
+    ++equal;
+    length -= key_length + 1;
+    if (key_length == sizeof(REPLAY_DEVTYPE_KEY) - 1 &&
+        memcmp(line, REPLAY_DEVTYPE_KEY, key_length) == SUCCESS) {
+        *usb_device = length == sizeof(USB_DEVICE_DEVTYPE) - 1 &&
+            memcmp(equal, USB_DEVICE_DEVTYPE, length) == SUCCESS;
+        return;
+    }
+    for (int i = 0; i < USB_PROPERTY_PATH; ++i) {
+        if (strlen(replay_properties[i]) == key_length &&
+            memcmp(line, replay_properties[i], key_length) == SUCCESS) {
+            copy_replay_value(replay->values[i], equal, length);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Moves to the next usb device of the dump
+ *
+ * an export-db record (lines up to an empty line) is a device when its
+ * DEVTYPE is usb_device, so interfaces and every other subsystem are
+ * skipped; its path is the last component of its "P:" line (bus-port
+ * path). A lsusb line is a device on its own
+ *
+ * @details static int next_usb_replay_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the replay state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) at the end of the dump
+ */
+static int next_usb_replay_device(usb_tools_t *usb_tools)
+{
+    usb_replay_t *replay = &usb_tools->replay;
+    bool usb_device = false;
+    char *line = NULL;
+    char *name = NULL;
+    size_t length = 0;
+
+    for (int i = 0; i < USB_PROPERTY_COUNT; ++i)
+        replay->values[i][0] = '\0';
+    while ((line = read_replay_line(replay, &length)) != NULL) {
+        if (length == 0) {
+            if (usb_device && replay->values[USB_PROPERTY_VENDOR_ID][0] != '\0' &&
+                replay->values[USB_PROPERTY_PRODUCT_ID][0] != '\0')
+                return SUCCESS;
+            for (int i = 0; i < USB_PROPERTY_COUNT; ++i)
+                replay->values[i][0] = '\0';
+            usb_device = false;
+        } else if (length > REPLAY_PREFIX_SIZE &&
+            memcmp(line, REPLAY_PROPERTY_PREFIX, REPLAY_PREFIX_SIZE) == SUCCESS) {
+            parse_export_db_property(replay, line + REPLAY_PREFIX_SIZE,
+                length - REPLAY_PREFIX_SIZE, &usb_device);
+        } else if (length > REPLAY_PREFIX_SIZE &&
+            memcmp(line, REPLAY_DEVICE_PREFIX, REPLAY_PREFIX_SIZE) == SUCCESS) {
+            name = line + length;
+            while (name > line + REPLAY_PREFIX_SIZE && name[-1] != '/')
+                --name;
+            copy_replay_value(replay->values[USB_PROPERTY_PATH], name, line + length - name);
+        } else if (length > sizeof(REPLAY_LSUSB_PREFIX) - 1 &&
+            memcmp(line, REPLAY_LSUSB_PREFIX, sizeof(REPLAY_LSUSB_PREFIX) - 1) == SUCCESS &&
+            parse_lsusb_line(replay, line, length) == SUCCESS) {
+            return SUCCESS;
+        }
+    }
+    if (usb_device && replay->values[USB_PROPERTY_VENDOR_ID][0] != '\0' &&
+        replay->values[USB_PROPERTY_PRODUCT_ID][0] != '\0')
+        return SUCCESS;
+    return UNSEEN;
+}
+
+/**
+ * @brief Restarts the dump at its first device
+ *
+ * a dump read from a pipe cannot be rewound and simply goes on, which
+ * is what the single pass of a scan needs
+ *
+ * @details static int first_usb_replay_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the replay state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) if the dump holds no usb device
+ */
+static int first_usb_replay_device(usb_tools_t *usb_tools)
+{
+    usb_replay_t *replay = &usb_tools->replay;
+
+    if (lseek(replay->fd, 0, SEEK_SET) == 0) {
+        replay->start = 0;
+        replay->end = 0;
+        replay->eof = false;
+        replay->skip_line = false;
+    }
+    return next_usb_replay_device(usb_tools);
+}
+
+/**
+ * @brief Reads a property of the current replayed device
+ *
+ * like udev, the vendor and product names fall back to the ids when the
+ * dump does not have them; values stay valid until the next move
+ *
+ * @details static const char *get_usb_replay_property(
+ *             usb_tools_t *usb_tools,
+ *             int property)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the replay state
+ * @param property USB_PROPERTY_* to read
+ * @return The value, or NULL if the record does not have it
+ */
+static const char *get_usb_replay_property(usb_tools_t *usb_tools, int property)
+{
+    usb_replay_t *replay = &usb_tools->replay;
+
+    if (property < 0 || property >= USB_PROPERTY_COUNT)
+        return NULL;
+    if (replay->values[property][0] != '\0')
+        return replay->values[property];
+    if (property == USB_PROPERTY_VENDOR_NAME)
+        return replay->values[USB_PROPERTY_VENDOR_ID];
+    if (property == USB_PROPERTY_PRODUCT_NAME)
+        return replay->values[USB_PROPERTY_PRODUCT_ID];
+    return NULL;
+}
+
+/**
+ * @brief Closes the dump and frees the read buffer
+ *
+ * @details static void close_usb_replay(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure (dump may be unopened)
+ */
+static void close_usb_replay(usb_tools_t *usb_tools)
+{
+    usb_replay_t *replay = &usb_tools->replay;
+
+    if (replay->fd > STDIN_FILENO)
+        close(replay->fd);
+    free(replay->buffer);
+    replay->fd = -1;
+    replay->buffer = NULL;
+    replay->start = 0;
+    replay->end = 0;
+}
+
+/* replay backend operations (--replay) */
+const usb_backend_t replay_usb_backend = {
+    open_usb_replay,
+    first_usb_replay_device,
+    next_usb_replay_device,
+    get_usb_replay_property,
+    close_usb_replay
+};
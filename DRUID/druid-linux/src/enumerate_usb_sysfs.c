@@ -0,0 +1,225 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file enumerate_usb_sysfs.c
+ * @brief enumerates usb devices directly from sysfs (--backend sysfs)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* attribute files read for each device, indexed by USB_PROPERTY_* */
+static const char *const sysfs_attributes[SYSFS_ATTRIBUTE_COUNT] = {
+    "idVendor", "manufacturer", "idProduct", "product", "serial"
+};
+
+/**
+ * @brief Opens the usb device directory of a sysfs tree
+ *
+ * the root defaults to /sys and can point to any copy of a sysfs tree
+ * (container without udev, fixture); devices are then opened relative
+ * to the directory fd
+ *
+ * @details static int open_usb_sysfs(usb_tools_t *usb_tools, const char *root)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the sysfs state
+ * @param root Sysfs mount point, or NULL for the default one
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the directory cannot be opened
+ */
+static int open_usb_sysfs(usb_tools_t *usb_tools, const char *root)
+{
+    usb_sysfs_t *sysfs = &usb_tools->sysfs;
+    int root_fd = -1;
+    int devices_fd = -1;
+
+    root = root != NULL ? root : SYSFS_DEFAULT_ROOT;
+    root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd >= 0) {
+        devices_fd = openat(root_fd, SYSFS_USB_DEVICES_PATH,
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        close(root_fd);
+    }
+    if (devices_fd >= 0)
+        sysfs->devices = fdopendir(devices_fd);
+    if (sysfs->devices == NULL) {
+        if (devices_fd >= 0)
+            close(devices_fd);
+        dprintf(STDERR_FILENO, SYSFS_ERROR_MESSAGE, root);
+        return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads one attribute file of a device, without its trailing newline
+ *
+ * @details static int read_sysfs_attribute(
+ *             int device_fd,
+ *             const char *name,
+ *             char *value)
+ * @param device_fd Directory fd of the device
+ * @param name Attribute file name
+ * @param value Buffer of SYSFS_VALUE_SIZE bytes (empty string if unreadable)
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a non-empty value was read
+ *         - -1     (UNSEEN) if the attribute is missing or empty
+ */
+static int read_sysfs_attribute(int device_fd, const char *name, char *value)
+{
+    int fd = openat(device_fd, name, O_RDONLY | O_CLOEXEC);
+    ssize_t length = 0;
+
+    value[0] = '\0';
+    if (fd < 0)
+        return UNSEEN;
+    length = read(fd, value, SYSFS_VALUE_SIZE - 1);
+    close(fd);
+    if (length <= 0)
+        return UNSEEN;
+    while (length > 0 && value[length - 1] == LINE_SEPARATOR)
+        --length;
+    value[length] = '\0';
+    return length > 0 ? SUCCESS : UNSEEN;
+}
+
+/**
+ * @brief Reads the attributes of one device directory
+ *
+ * @details static int read_sysfs_device(usb_sysfs_t *sysfs, const char *name)
+ * @param sysfs Pointer to the usb_sysfs_t state receiving the values
+ * @param name Device directory name (bus-port path, e.g. 1-2.3)
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the device has a vendor and a product id
+ *         - -1     (UNSEEN) otherwise (interfaces, vanished devices)
+ */
+static int read_sysfs_device(usb_sysfs_t *sysfs, const char *name)
+{
+    int device_fd = openat(dirfd(sysfs->devices), name,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int result = SUCCESS;
+
+    if (device_fd < 0)
+        return UNSEEN;
+    for (int i = 0; i < SYSFS_ATTRIBUTE_COUNT; ++i) {
+        if (read_sysfs_attribute(device_fd, sysfs_attributes[i], sysfs->values[i]) == UNSEEN &&
+            (i == USB_PROPERTY_VENDOR_ID || i == USB_PROPERTY_PRODUCT_ID)) {
+            result = UNSEEN;
+            break;
+        }
+    }
+    close(device_fd);
+    return result;
+}
+
+/**
+ * @brief Moves to the next usb device of the sysfs tree
+ *
+ * interface directories (names holding ':') are skipped
+ *
+ * @details static int next_usb_sysfs_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the sysfs state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) once every device has been read
+ */
+static int next_usb_sysfs_device(usb_tools_t *usb_tools)
+{
+    usb_sysfs_t *sysfs = &usb_tools->sysfs;
+    struct dirent *entry = readdir(sysfs->devices);
+
+    for (; entry != NULL; entry = readdir(sysfs->devices)) {
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, ':') != NULL ||
+            read_sysfs_device(sysfs, entry->d_name) == UNSEEN)
+            continue;
+        sysfs->name = entry->d_name;
+        return SUCCESS;
+    }
+    sysfs->name = NULL;
+    return UNSEEN;
+}
+
+/**
+ * @brief Restarts the sysfs enumeration at its first device
+ *
+ * @details static int first_usb_sysfs_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the sysfs state
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) if there is no device
+ */
+static int first_usb_sysfs_device(usb_tools_t *usb_tools)
+{
+    rewinddir(usb_tools->sysfs.devices);
+    return next_usb_sysfs_device(usb_tools);
+}
+
+/**
+ * @brief Reads a property of the current sysfs device
+ *
+ * like udev, the vendor and product names fall back to the ids when the
+ * device has no string descriptor; values stay valid until the next move
+ *
+ * @details static const char *get_usb_sysfs_property(
+ *             usb_tools_t *usb_tools,
+ *             int property)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the sysfs state
+ * @param property USB_PROPERTY_* to read
+ * @return The value, or NULL if the device does not have it
+ */
+static const char *get_usb_sysfs_property(usb_tools_t *usb_tools, int property)
+{
+    usb_sysfs_t *sysfs = &usb_tools->sysfs;
+
+    if (property == USB_PROPERTY_PATH)
+        return sysfs->name;
+    if (property < 0 || property >= SYSFS_ATTRIBUTE_COUNT)
+        return NULL;
+    if (sysfs->values[property][0] != '\0')
+        return sysfs->values[property];
+    if (property == USB_PROPERTY_VENDOR_NAME)
+        return sysfs->values[USB_PROPERTY_VENDOR_ID];
+    if (property == USB_PROPERTY_PRODUCT_NAME)
+        return sysfs->values[USB_PROPERTY_PRODUCT_ID];
+    return NULL;
+}
+
+/**
+ * @brief Closes the usb device directory of the sysfs backend
+ *
+ * @details static void close_usb_sysfs(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure (sysfs state may be unopened)
+ */
+static void close_usb_sysfs(usb_tools_t *usb_tools)
+{
+    if (usb_tools->sysfs.devices != NULL)
+        closedir(usb_tools->sysfs.devices);
+    usb_tools->sysfs.devices = NULL;
+    usb_tools->sysfs.name = NULL;
+}
+
+/* sysfs backend operations (--backend sysfs, --sysfs-root) */
+const usb_backend_t sysfs_usb_backend = {
+    open_usb_sysfs,
+    first_usb_sysfs_device,
+    next_usb_sysfs_device,
+    get_usb_sysfs_property,
+    close_usb_sysfs
+};
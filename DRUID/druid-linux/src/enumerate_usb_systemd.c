@@ -0,0 +1,128 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file enumerate_usb_systemd.c
+ * @brief enumerates usb devices through libsystemd (default backend)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* udev properties read for each device, indexed by USB_PROPERTY_* */
+static const char *const systemd_properties[USB_PROPERTY_PATH] = {
+    VENDOR_ID, VENDOR_NAME, PRODUCT_ID, PRODUCT_NAME, SERIAL_NUMBER
+};
+
+/**
+ * @brief Creates the systemd enumerator targeting the USB subsystem
+ *
+ * @details static int open_usb_systemd(usb_tools_t *usb_tools, const char *source)
+ * @param usb_tools Pointer to the usb_tools_t structure receiving the enumerator
+ * @param source Unused (udev decides where devices come from)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the enumerator could not be created
+ */
+static int open_usb_systemd(usb_tools_t *usb_tools, const char *source)
+{
+    (void)source;
+    if (sd_device_enumerator_new(&usb_tools->enumerator) < 0)
+        return EXIT_ERROR;
+    sd_device_enumerator_add_match_subsystem(usb_tools->enumerator, SEARCH_DEVICE_TYPE, 1);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Restarts the enumeration at its first device
+ *
+ * @details static int first_usb_systemd_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the enumerator
+ * @return Exit code:
+ *         - 0      (SUCCESS) if there is a device
+ *         - -1     (UNSEEN) otherwise
+ */
+static int first_usb_systemd_device(usb_tools_t *usb_tools)
+{
+    usb_tools->device = sd_device_enumerator_get_device_first(
+        usb_tools->enumerator);
+    return usb_tools->device != NULL ? SUCCESS : UNSEEN;
+}
+
+/**
+ * @brief Moves to the next device of the enumeration
+ *
+ * @details static int next_usb_systemd_device(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the enumerator
+ * @return Exit code:
+ *         - 0      (SUCCESS) if there is a device
+ *         - -1     (UNSEEN) once every device has been read
+ */
+static int next_usb_systemd_device(usb_tools_t *usb_tools)
+{
+    usb_tools->device = sd_device_enumerator_get_device_next(
+        usb_tools->enumerator);
+    return usb_tools->device != NULL ? SUCCESS : UNSEEN;
+}
+
+/**
+ * @brief Reads a property of the current systemd device
+ *
+ * the path is the device sysname (bus-port path, e.g. 1-2.3)
+ *
+ * @details static const char *get_usb_systemd_property(
+ *             usb_tools_t *usb_tools,
+ *             int property)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the current device
+ * @param property USB_PROPERTY_* to read
+ * @return The value, or NULL if the device does not have it
+ */
+static const char *get_usb_systemd_property(usb_tools_t *usb_tools, int property)
+{
+    const char *value = NULL;
+
+    if (property == USB_PROPERTY_PATH) {
+        if (sd_device_get_sysname(usb_tools->device, &value) < 0)
+            return NULL;
+        return value;
+    }
+    if (property < 0 || property >= USB_PROPERTY_PATH ||
+        sd_device_get_property_value(usb_tools->device,
+        systemd_properties[property], &value) < 0)
+        return NULL;
+    return value;
+}
+
+/**
+ * @brief Releases the systemd enumerator
+ *
+ * @details static void close_usb_systemd(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure (enumerator may be NULL)
+ */
+static void close_usb_systemd(usb_tools_t *usb_tools)
+{
+    usb_tools->enumerator = sd_device_enumerator_unref(usb_tools->enumerator);
+    usb_tools->device = NULL;
+}
+
+/* systemd backend operations (default) */
+const usb_backend_t systemd_usb_backend = {
+    open_usb_systemd,
+    first_usb_systemd_device,
+    next_usb_systemd_device,
+    get_usb_systemd_property,
+    close_usb_systemd
+};
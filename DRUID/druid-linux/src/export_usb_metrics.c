@@ -0,0 +1,331 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file export_usb_metrics.c
+ * @brief metrics file: risk, vendor and timing metrics for the Prometheus textfile collector
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* upper bounds (seconds) of the classification latency buckets, +Inf excluded */
+static const double metrics_buckets[USB_METRICS_BUCKET_COUNT] = {
+    0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005,
+    0.0001, 0.00025, 0.0005, 0.001, 0.01
+};
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @details double get_usb_metrics_clock(void)
+ * @return Seconds elapsed since an arbitrary point, unaffected by clock changes
+ */
+double get_usb_metrics_clock(void)
+{
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prepares the metrics of a scan or a watch
+ *
+ * @details int open_usb_metrics(usb_metrics_t *metrics, const char *path)
+ * @param metrics Pointer to the metrics to prepare
+ * @param path Metrics file, replaced by each write
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int open_usb_metrics(usb_metrics_t *metrics, const char *path)
+{
+    size_t length = strlen(path);
+
+    *metrics = (usb_metrics_t){0};
+    metrics->path = path;
+    metrics->temp_path = malloc(length + sizeof(USB_METRICS_TEMP_SUFFIX));
+    metrics->vendors = calloc(USB_METRICS_VENDOR_COUNT, sizeof(uint32_t));
+    if (metrics->temp_path == NULL || metrics->vendors == NULL)
+        return EXIT_ERROR;
+    memcpy(metrics->temp_path, path, length);
+    memcpy(metrics->temp_path + length, USB_METRICS_TEMP_SUFFIX, sizeof(USB_METRICS_TEMP_SUFFIX));
+    metrics->written = get_usb_metrics_clock();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Records the size of the loaded database and how long it took to load
+ *
+ * @details void set_usb_metrics_db(
+ *             usb_metrics_t *metrics,
+ *             usb_db_t *usb_db,
+ *             double seconds)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ * @param usb_db Pointer to the loaded database (with the databases it is layered on)
+ * @param seconds Duration of the load
+ */
+void set_usb_metrics_db(usb_metrics_t *metrics, usb_db_t *usb_db, double seconds)
+{
+    if (metrics == NULL)
+        return;
+    metrics->db_entries = 0;
+    for (usb_db_t *db = usb_db; db != NULL; db = db->base)
+        metrics->db_entries += db->count;
+    metrics->db_load_seconds = seconds;
+}
+
+/**
+ * @brief Marks the start of a walk over the enumerated devices
+ *
+ * @details void begin_usb_metrics_walk(usb_metrics_t *metrics)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ */
+void begin_usb_metrics_walk(usb_metrics_t *metrics)
+{
+    if (metrics == NULL)
+        return;
+    metrics->walk_start = get_usb_metrics_clock();
+    metrics->walk_classification_seconds = metrics->classification_seconds;
+}
+
+/**
+ * @brief Adds the time of a walk, less its classifications, to the enumeration
+ *
+ * the walk interleaves the enumeration with the classification of each
+ * device, whose latency is already observed on its own
+ *
+ * @details void end_usb_metrics_walk(usb_metrics_t *metrics)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ */
+void end_usb_metrics_walk(usb_metrics_t *metrics)
+{
+    if (metrics == NULL)
+        return;
+    metrics->enumeration_seconds += get_usb_metrics_clock() - metrics->walk_start -
+        (metrics->classification_seconds - metrics->walk_classification_seconds);
+    metrics->pending = true;
+}
+
+/**
+ * @brief Counts a classified device: its vendor and its classification latency
+ *
+ * @details void observe_usb_classification(
+ *             usb_metrics_t *metrics,
+ *             usb_device_info_t *usb_device_info,
+ *             double start)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ * @param usb_device_info Pointer to the classified device
+ * @param start Clock (get_usb_metrics_clock) when its classification started
+ */
+void observe_usb_classification(usb_metrics_t *metrics, usb_device_info_t *usb_device_info,
+    double start)
+{
+    double seconds = 0;
+    uint16_t vendor_id = 0;
+    size_t bucket = 0;
+
+    if (metrics == NULL)
+        return;
+    seconds = get_usb_metrics_clock() - start;
+    while (bucket < USB_METRICS_BUCKET_COUNT && seconds > metrics_buckets[bucket])
+        ++bucket;
+    ++metrics->buckets[bucket];
+    ++metrics->classifications;
+    metrics->classification_seconds += seconds;
+    if (parse_usb_id(usb_device_info->vendor_id, &vendor_id) == SUCCESS)
+        ++metrics->vendors[vendor_id];
+    else
+        ++metrics->invalid_vendors;
+    metrics->pending = true;
+}
+
+/**
+ * @brief Uncounts the vendor of a device removed during a watch
+ *
+ * the classification latency is kept, only the device gauges follow
+ * the devices still attached
+ *
+ * @details void forget_usb_classification(
+ *             usb_metrics_t *metrics,
+ *             usb_device_info_t *usb_device_info)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ * @param usb_device_info Pointer to the removed device, counted before
+ */
+void forget_usb_classification(usb_metrics_t *metrics, usb_device_info_t *usb_device_info)
+{
+    uint16_t vendor_id = 0;
+
+    if (metrics == NULL)
+        return;
+    if (parse_usb_id(usb_device_info->vendor_id, &vendor_id) == SUCCESS) {
+        if (metrics->vendors[vendor_id] > 0)
+            --metrics->vendors[vendor_id];
+    } else if (metrics->invalid_vendors > 0) {
+        --metrics->invalid_vendors;
+    }
+    metrics->pending = true;
+}
+
+/**
+ * @brief Writes the risk gauges, the database and the per-vendor device counts
+ *
+ * @details static void write_usb_metrics_counts(
+ *             FILE *file,
+ *             usb_metrics_t *metrics,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param file Temporary metrics file
+ * @param metrics Pointer to the metrics
+ * @param usb_risk_stats Pointer to the risk statistics
+ */
+static void write_usb_metrics_counts(FILE *file, usb_metrics_t *metrics,
+    usb_risk_stats_stats_t *usb_risk_stats)
+{
+    fprintf(file, "# HELP druid_devices USB devices attached, by risk level.\n"
+        "# TYPE druid_devices gauge\n"
+        "druid_devices{risk=\"low\"} %lu\n"
+        "druid_devices{risk=\"medium\"} %lu\n"
+        "druid_devices{risk=\"major\"} %lu\n",
+        usb_risk_stats->low, usb_risk_stats->medium, usb_risk_stats->major);
+    fprintf(file, "# HELP druid_vendor_devices USB devices attached, by vendor id.\n"
+        "# TYPE druid_vendor_devices gauge\n");
+    for (size_t i = 0; i < USB_METRICS_VENDOR_COUNT; ++i) {
+        if (metrics->vendors[i] != 0)
+            fprintf(file, "druid_vendor_devices{vendor_id=\"%04lx\"} %u\n",
+                i, metrics->vendors[i]);
+    }
+    if (metrics->invalid_vendors != 0)
+        fprintf(file, "druid_vendor_devices{vendor_id=\"invalid\"} %lu\n",
+            metrics->invalid_vendors);
+    fprintf(file, "# HELP druid_db_entries Entries of the loaded database.\n"
+        "# TYPE druid_db_entries gauge\n"
+        "druid_db_entries %lu\n", metrics->db_entries);
+}
+
+/**
+ * @brief Writes the durations and the classification latency histogram
+ *
+ * @details static void write_usb_metrics_timings(FILE *file, usb_metrics_t *metrics)
+ * @param file Temporary metrics file
+ * @param metrics Pointer to the metrics
+ */
+static void write_usb_metrics_timings(FILE *file, usb_metrics_t *metrics)
+{
+    size_t count = 0;
+
+    fprintf(file, "# HELP druid_db_load_duration_seconds Time taken to load the database.\n"
+        "# TYPE druid_db_load_duration_seconds gauge\n"
+        "druid_db_load_duration_seconds %.9f\n"
+        "# HELP druid_enumeration_duration_seconds Time taken to enumerate the USB devices.\n"
+        "# TYPE druid_enumeration_duration_seconds gauge\n"
+        "druid_enumeration_duration_seconds %.9f\n",
+        metrics->db_load_seconds, metrics->enumeration_seconds);
+    fprintf(file, "# HELP druid_classification_duration_seconds Time taken to classify "
+        "one USB device.\n"
+        "# TYPE druid_classification_duration_seconds histogram\n");
+    for (size_t i = 0; i < USB_METRICS_BUCKET_COUNT; ++i) {
+        count += metrics->buckets[i];
+        fprintf(file, "druid_classification_duration_seconds_bucket{le=\"%g\"} %lu\n",
+            metrics_buckets[i], count);
+    }
+    fprintf(file, "druid_classification_duration_seconds_bucket{le=\"+Inf\"} %lu\n"
+        "druid_classification_duration_seconds_sum %.9f\n"
+        "druid_classification_duration_seconds_count %lu\n",
+        metrics->classifications, metrics->classification_seconds, metrics->classifications);
+}
+
+/**
+ * @brief Writes the metrics file
+ *
+ * the metrics go to a temporary file next to it that then replaces it,
+ * so the collector never reads a partial file
+ *
+ * @details int write_usb_metrics(
+ *             usb_metrics_t *metrics,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ * @param usb_risk_stats Pointer to the risk statistics
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success, or without metrics
+ *         - 84     (EXIT_ERROR) if the file cannot be written
+ */
+int write_usb_metrics(usb_metrics_t *metrics, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    FILE *file = NULL;
+    int result = EXIT_ERROR;
+
+    if (metrics == NULL)
+        return EXIT_SUCCESS;
+    metrics->written = get_usb_metrics_clock();
+    metrics->pending = false;
+    file = fopen(metrics->temp_path, WRITE_MODE);
+    if (file != NULL) {
+        write_usb_metrics_counts(file, metrics, usb_risk_stats);
+        write_usb_metrics_timings(file, metrics);
+        result = ferror(file) ? EXIT_ERROR : EXIT_SUCCESS;
+        if (fclose(file) != SUCCESS)
+            result = EXIT_ERROR;
+    }
+    if (result == EXIT_SUCCESS && rename(metrics->temp_path, metrics->path) == SUCCESS)
+        return EXIT_SUCCESS;
+    unlink(metrics->temp_path);
+    dprintf(STDERR_FILENO, METRICS_FILE_ERROR_MESSAGE, metrics->path);
+    return EXIT_ERROR;
+}
+
+/**
+ * @brief Writes the metrics file if it changed, at most once per interval
+ *
+ * a watch calls it after every event: a burst of hotplug events gives
+ * one write, the later changes being left for the next one
+ *
+ * @details double update_usb_metrics(
+ *             usb_metrics_t *metrics,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param metrics Pointer to the metrics, or NULL when they are not collected
+ * @param usb_risk_stats Pointer to the risk statistics
+ * @return Seconds to wait before the changes left can be written, 0 if
+ *         nothing is left to write
+ */
+double update_usb_metrics(usb_metrics_t *metrics, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    double elapsed = 0;
+
+    if (metrics == NULL || !metrics->pending)
+        return 0;
+    elapsed = get_usb_metrics_clock() - metrics->written;
+    if (elapsed < USB_METRICS_INTERVAL)
+        return USB_METRICS_INTERVAL - elapsed;
+    write_usb_metrics(metrics, usb_risk_stats);
+    return 0;
+}
+
+/**
+ * @brief Frees the metrics
+ *
+ * @details void close_usb_metrics(usb_metrics_t *metrics)
+ * @param metrics Pointer to the metrics
+ */
+void close_usb_metrics(usb_metrics_t *metrics)
+{
+    free(metrics->temp_path);
+    free(metrics->vendors);
+    *metrics = (usb_metrics_t){0};
+}
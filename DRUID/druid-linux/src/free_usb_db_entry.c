@@ -19,40 +19,56 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stddef.h>
+#include <sys/mman.h>
 #include <systemd/sd-device.h>
 #include "druid.h"
 
 /**
- * @brief Frees memory allocated for an unknown usb_db_entry_t structure
+ * @brief Frees the parallel arrays of a database or of a parser chunk
  *
- * deallocates the vendor and product name strings
- * that were previously set for an unknown USB device
- * 
- * @details void free_unknown_usb_db_entry(usb_db_entry_t *unknown)
- * @param unknown Pointer to the usb_db_entry_t structure to be freed
+ * @details void free_usb_db_columns(usb_db_columns_t *columns)
+ * @param columns Pointer to the usb_db_columns_t structure to free
  */
-void free_unknown_usb_db_entry(usb_db_entry_t *unknown)
+void free_usb_db_columns(usb_db_columns_t *columns)
 {
-    free(unknown->vendor_name);
-    free(unknown->product_name);
+    free(columns->vendor_ids);
+    free(columns->product_ids);
+    free(columns->id_flags);
+    free(columns->vendor_names);
+    free(columns->product_names);
+    *columns = (usb_db_columns_t){NULL, NULL, NULL, NULL, NULL};
 }
 
 /**
  * @brief Frees all memory allocated within a usb_db_t structure
  *
- * iterates over each usb_db_entry_t in the database to free
- * vendor and product identifiers and names, then releases the entries array
+ * releases the columns, the hash index and the vendor directory, then unmaps the
+ * CSV text region every field points into; a database loaded from a
+ * compiled image owns nothing but the image mapping itself, and the
+ * embedded table owns nothing at all, except for the Eytzinger trees
+ * which are always built in memory
  * 
  * @details void free_usb_db(usb_db_t *usb_db)
  * @param usb_db Pointer to the usb_db_t structure to be freed
  */
 void free_usb_db(usb_db_t *usb_db)
 {
-    for (size_t i = 0; i < usb_db->count; i++) {
-        free(usb_db->entries[i].vendor_id);
-        free(usb_db->entries[i].vendor_name);
-        free(usb_db->entries[i].product_id);
-        free(usb_db->entries[i].product_name);
+    if (usb_db->base != NULL) {
+        free_usb_db(usb_db->base);
+        free(usb_db->base);
+    }
+    free_usb_db_eytzinger(&usb_db->eytzinger_products);
+    free_usb_db_eytzinger(&usb_db->eytzinger_vendors);
+    if (usb_db->embedded != NULL)
+        return;
+    if (usb_db->image != NULL) {
+        munmap(usb_db->image, usb_db->image_size);
+        return;
     }
-    free(usb_db->entries);
+    free_usb_db_columns(&usb_db->columns);
+    free(usb_db->index.products);
+    free(usb_db->directory.vendors);
+    free(usb_db->directory.products);
+    if (usb_db->mapping != NULL)
+        munmap(usb_db->mapping, usb_db->mapping_size);
 }
@@ -0,0 +1,120 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_backend_flag.c
+ * @brief reads the usb enumeration backend from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Parses an enumeration backend name
+ *
+ * @details static int parse_backend_name(const char *str, int *backend)
+ * @param str Argument following the backend flag
+ * @param backend Receives USB_BACKEND_SYSTEMD or USB_BACKEND_SYSFS
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the name is known
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+static int parse_backend_name(const char *str, int *backend)
+{
+    if (str == NULL)
+        return EXIT_ERROR;
+    if (strcmp(str, USB_BACKEND_SYSTEMD_NAME) == SUCCESS) {
+        *backend = USB_BACKEND_SYSTEMD;
+        return SUCCESS;
+    }
+    if (strcmp(str, USB_BACKEND_SYSFS_NAME) == SUCCESS) {
+        *backend = USB_BACKEND_SYSFS;
+        return SUCCESS;
+    }
+    return EXIT_ERROR;
+}
+
+/**
+ * @brief Removes a flag and its argument from the CLI arguments
+ *
+ * @details static void remove_flag(cli_args_t *cli_args, int i)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @param i Position of the flag
+ */
+static void remove_flag(cli_args_t *cli_args, int i)
+{
+    for (int j = i; j + 2 <= cli_args->ac; ++j)
+        cli_args->av[j] = cli_args->av[j + 2];
+    cli_args->ac -= 2;
+}
+
+/**
+ * @brief Handles the enumeration backend flags
+ *
+ * looks for "-b NAME" / "--backend NAME", "-s DIR" / "--sysfs-root DIR",
+ * "-d FILE" / "--devices FILE" and "-r FILE" / "--replay FILE" anywhere
+ * on the command line and removes them like the jobs flag does; a sysfs
+ * root selects the sysfs backend, a device list the list backend and a
+ * dump the replay backend. Without them, devices are enumerated through
+ * systemd
+ *
+ * @details int handle_backend_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flags are absent or valid
+ *         - 84     (EXIT_ERROR) if a backend name, root, list or dump is missing or unknown
+ */
+int handle_backend_flag(cli_args_t *cli_args)
+{
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strcmp(cli_args->av[i], BACKEND_FLAG) == SUCCESS ||
+            strcmp(cli_args->av[i], BACKEND_FLAG_OPTION) == SUCCESS) {
+            if (parse_backend_name(cli_args->av[i + 1], &cli_args->backend) == EXIT_ERROR) {
+                dprintf(STDERR_FILENO, INVALID_BACKEND_MESSAGE);
+                return EXIT_ERROR;
+            }
+        } else if (strcmp(cli_args->av[i], SYSFS_ROOT_FLAG) == SUCCESS ||
+            strcmp(cli_args->av[i], SYSFS_ROOT_FLAG_OPTION) == SUCCESS) {
+            if (cli_args->av[i + 1] == NULL) {
+                dprintf(STDERR_FILENO, INVALID_SYSFS_ROOT_MESSAGE);
+                return EXIT_ERROR;
+            }
+            cli_args->backend_source = cli_args->av[i + 1];
+            cli_args->backend = USB_BACKEND_SYSFS;
+        } else if (strcmp(cli_args->av[i], DEVICE_LIST_FLAG) == SUCCESS ||
+            strcmp(cli_args->av[i], DEVICE_LIST_FLAG_OPTION) == SUCCESS) {
+            if (cli_args->av[i + 1] == NULL) {
+                dprintf(STDERR_FILENO, INVALID_DEVICE_LIST_MESSAGE);
+                return EXIT_ERROR;
+            }
+            cli_args->backend_source = cli_args->av[i + 1];
+            cli_args->backend = USB_BACKEND_DEVICE_LIST;
+        } else if (strcmp(cli_args->av[i], REPLAY_FLAG) == SUCCESS ||
+            strcmp(cli_args->av[i], REPLAY_FLAG_OPTION) == SUCCESS) {
+            if (cli_args->av[i + 1] == NULL) {
+                dprintf(STDERR_FILENO, INVALID_REPLAY_MESSAGE);
+                return EXIT_ERROR;
+            }
+            cli_args->backend_source = cli_args->av[i + 1];
+            cli_args->backend = USB_BACKEND_REPLAY;
+        } else {
+            continue;
+        }
+        remove_flag(cli_args, i--);
+    }
+    return SUCCESS;
+}
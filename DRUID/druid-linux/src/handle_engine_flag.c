@@ -0,0 +1,81 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_engine_flag.c
+ * @brief reads the lookup engine from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Parses a lookup engine name
+ *
+ * @details static int parse_engine_name(const char *str, int *engine)
+ * @param str Argument following the engine flag
+ * @param engine Receives LOOKUP_ENGINE_HASH or LOOKUP_ENGINE_EYTZINGER
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the name is known
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+static int parse_engine_name(const char *str, int *engine)
+{
+    if (str == NULL)
+        return EXIT_ERROR;
+    if (strcmp(str, LOOKUP_ENGINE_HASH_NAME) == SUCCESS) {
+        *engine = LOOKUP_ENGINE_HASH;
+        return SUCCESS;
+    }
+    if (strcmp(str, LOOKUP_ENGINE_EYTZINGER_NAME) == SUCCESS) {
+        *engine = LOOKUP_ENGINE_EYTZINGER;
+        return SUCCESS;
+    }
+    return EXIT_ERROR;
+}
+
+/**
+ * @brief Handles the lookup engine flag
+ *
+ * looks for "-e NAME" / "--engine NAME" anywhere on the command line,
+ * stores the engine and removes both arguments like the jobs flag does;
+ * without the flag, lookups use the hash index (or the perfect hash
+ * of druid-embedded)
+ *
+ * @details int handle_engine_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flag is absent or valid
+ *         - 84     (EXIT_ERROR) if the engine name is missing or unknown
+ */
+int handle_engine_flag(cli_args_t *cli_args)
+{
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strcmp(cli_args->av[i], ENGINE_FLAG) != SUCCESS &&
+            strcmp(cli_args->av[i], ENGINE_FLAG_OPTION) != SUCCESS)
+            continue;
+        if (parse_engine_name(cli_args->av[i + 1], &cli_args->engine) == EXIT_ERROR) {
+            dprintf(STDERR_FILENO, INVALID_ENGINE_MESSAGE);
+            return EXIT_ERROR;
+        }
+        for (int j = i; j + 2 <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + 2];
+        cli_args->ac -= 2;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
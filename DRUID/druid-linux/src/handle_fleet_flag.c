@@ -0,0 +1,313 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_fleet_flag.c
+ * @brief classifies a directory of per-host snapshots on a worker pool (--fleet)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request a fleet audit
+ *
+ * @details static int check_for_fleet_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the fleet flag is followed by a directory
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_fleet_flag(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 3 &&
+        (strcmp(cli_args->av[1], FLEET_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], FLEET_FLAG_OPTION) == SUCCESS)
+        && cli_args->av[2] != NULL) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Keeps the directory entries that may be host snapshots
+ *
+ * @details int filter_fleet_entry(const struct dirent *entry)
+ * @param entry Directory entry
+ * @return Non-zero for regular files (or links, or unknown types) not starting with '.'
+ */
+int filter_fleet_entry(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.' && (entry->d_type == DT_REG ||
+        entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN);
+}
+
+/**
+ * @brief Counts one device of a host in its risk counters
+ *
+ * same lookup as check_usb_exist, without decoding names nor printing
+ * the device: workers only share the read-only database
+ *
+ * @details static void count_fleet_device(
+ *             usb_db_t *usb_db,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param usb_db Pointer to the shared database
+ * @param usb_device_info Pointer to the device to classify
+ * @param usb_risk_stats Pointer to the risk counters of the host
+ */
+static void count_fleet_device(usb_db_t *usb_db, usb_device_info_t *usb_device_info,
+    usb_risk_stats_stats_t *usb_risk_stats)
+{
+    usb_db_match_t usb_db_match = {NULL, 0};
+    int match = lookup_usb_db_index(usb_db, usb_device_info, &usb_db_match);
+
+    if (match == MATCH_VENDOR_AND_PRODUCT)
+        ++usb_risk_stats->low;
+    else if (match == MATCH_VENDOR_ONLY)
+        ++usb_risk_stats->medium;
+    else
+        ++usb_risk_stats->major;
+    add_usb_seen(&usb_risk_stats->seen, usb_device_info);
+    ++usb_risk_stats->seen_count;
+}
+
+/**
+ * @brief Classifies the snapshot of one host
+ *
+ * the snapshot goes through the replay backend, with the same dedupe as
+ * a scan of the host itself; its counts are kept for the host summary
+ * and added to the accumulator of the worker
+ *
+ * @details static void classify_fleet_host(
+ *             usb_fleet_t *fleet,
+ *             usb_fleet_host_t *host,
+ *             usb_risk_stats_stats_t *worker_stats)
+ * @param fleet Pointer to the shared fleet state
+ * @param host Host to classify
+ * @param worker_stats Risk accumulator of the calling worker
+ */
+static void classify_fleet_host(usb_fleet_t *fleet, usb_fleet_host_t *host,
+    usb_risk_stats_stats_t *worker_stats)
+{
+    char path[FLEET_PATH_SIZE] = {0};
+    cli_args_t host_args = *fleet->cli_args;
+    usb_tools_t usb_tools = {0};
+    usb_device_info_t usb_device_info = {0};
+    usb_risk_stats_stats_t host_stats = {0};
+    int written = snprintf(path, sizeof(path), "%s/%s", fleet->directory, host->name);
+    int status = UNSEEN;
+
+    host->status = EXIT_ERROR;
+    host_args.backend = USB_BACKEND_REPLAY;
+    host_args.backend_source = path;
+    host_stats.seen.per_port = fleet->cli_args->per_port;
+    if (written > 0 && written < FLEET_PATH_SIZE &&
+        init_usb_enumerator(&usb_tools, &usb_device_info, &host_args) == EXIT_SUCCESS) {
+        status = first_usb_device(&usb_tools, &usb_device_info);
+        host->status = EXIT_SUCCESS;
+    }
+    for (; status == SUCCESS; status = next_usb_device(&usb_tools, &usb_device_info)) {
+        if (usb_device_info.vendor_id == NULL || usb_device_info.product_id == NULL ||
+            check_usb_seen(&host_stats.seen, &usb_device_info) == SUCCESS)
+            continue;
+        count_fleet_device(fleet->usb_db, &usb_device_info, &host_stats);
+    }
+    close_usb_enumerator(&usb_tools);
+    free_usb_seen_set(&host_stats.seen);
+    host->low = host_stats.low;
+    host->medium = host_stats.medium;
+    host->major = host_stats.major;
+    worker_stats->low += host_stats.low;
+    worker_stats->medium += host_stats.medium;
+    worker_stats->major += host_stats.major;
+    worker_stats->seen_count += host_stats.seen_count;
+}
+
+/**
+ * @brief Worker loop: classifies hosts until none is left
+ *
+ * each worker takes its own accumulator once, then hosts in turn; a
+ * host is written by one worker only, so nothing is locked
+ *
+ * @details static void *classify_fleet_worker(void *arg)
+ * @param arg Pointer to the shared usb_fleet_t
+ * @return NULL
+ */
+static void *classify_fleet_worker(void *arg)
+{
+    usb_fleet_t *fleet = arg;
+    usb_risk_stats_stats_t *worker_stats = &fleet->worker_stats[
+        __atomic_fetch_add(&fleet->next_worker, 1, __ATOMIC_RELAXED)];
+    size_t i = 0;
+
+    while ((i = __atomic_fetch_add(&fleet->next_host, 1, __ATOMIC_RELAXED))
+        < fleet->host_count)
+        classify_fleet_host(fleet, &fleet->hosts[i], worker_stats);
+    return NULL;
+}
+
+/**
+ * @brief Runs the worker pool over every host and merges the accumulators
+ *
+ * the calling thread works too; if a thread cannot be started the
+ * remaining workers simply take more hosts
+ *
+ * @details static int run_fleet_workers(
+ *             usb_fleet_t *fleet,
+ *             size_t jobs,
+ *             usb_risk_stats_stats_t *total)
+ * @param fleet Pointer to the fleet state holding the hosts
+ * @param jobs Number of workers (0 uses every online CPU)
+ * @param total Receives the merged risk counters
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the accumulators cannot be allocated
+ */
+static int run_fleet_workers(usb_fleet_t *fleet, size_t jobs, usb_risk_stats_stats_t *total)
+{
+    pthread_t threads[MAX_JOBS] = {0};
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t started = 0;
+
+    if (jobs == 0)
+        jobs = online < 1 ? 1 : (online > MAX_JOBS ? MAX_JOBS : (size_t)online);
+    if (jobs > fleet->host_count)
+        jobs = fleet->host_count > 0 ? fleet->host_count : 1;
+    fleet->worker_stats = calloc(jobs, sizeof(usb_risk_stats_stats_t));
+    if (fleet->worker_stats == NULL)
+        return EXIT_ERROR;
+    for (size_t i = 1; i < jobs; ++i) {
+        if (pthread_create(&threads[started], NULL, classify_fleet_worker, fleet) == SUCCESS)
+            ++started;
+    }
+    classify_fleet_worker(fleet);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    for (size_t i = 0; i < jobs; ++i) {
+        total->low += fleet->worker_stats[i].low;
+        total->medium += fleet->worker_stats[i].medium;
+        total->major += fleet->worker_stats[i].major;
+        total->seen_count += fleet->worker_stats[i].seen_count;
+    }
+    free(fleet->worker_stats);
+    fleet->worker_stats = NULL;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Displays the summary of every host, in directory order
+ *
+ * @details int display_fleet_hosts(
+ *             usb_fleet_t *fleet,
+ *             usb_output_t *output)
+ * @param fleet Pointer to the classified fleet
+ * @param output Pointer to the output the summaries are rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every snapshot was read
+ *         - 84     (EXIT_ERROR) if a snapshot could not be read
+ */
+int display_fleet_hosts(usb_fleet_t *fleet, usb_output_t *output)
+{
+    int result = EXIT_SUCCESS;
+
+    print_usb_output(output, USB_RENDER_ANSI,
+        "\e[1;37m╭───────── Fleet hosts (%lu) ─────────╮\e[0m\n", fleet->host_count);
+    print_usb_output(output, USB_RENDER_PLAIN,
+        "╭───────── Fleet hosts (%lu) ─────────╮\n", fleet->host_count);
+    for (size_t i = 0; i < fleet->host_count; ++i) {
+        print_usb_json_fleet_host(output, &fleet->hosts[i]);
+        if (fleet->hosts[i].status == EXIT_ERROR) {
+            print_usb_output(output, USB_RENDER_ANSI,
+                "│ %-32s  \e[1;31mUnreadable\e[0m\n", fleet->hosts[i].name);
+            print_usb_output(output, USB_RENDER_PLAIN,
+                "│ %-32s  Unreadable\n", fleet->hosts[i].name);
+            result = EXIT_ERROR;
+        } else {
+            print_usb_output(output, USB_RENDER_ANSI,
+                "│ %-32s  Low \e[1;32m%lu\e[0m   Medium \e[1;33m%lu\e[0m   Major \e[1;31m%lu\e[0m\n",
+                fleet->hosts[i].name, fleet->hosts[i].low, fleet->hosts[i].medium,
+                fleet->hosts[i].major);
+            print_usb_output(output, USB_RENDER_PLAIN,
+                "│ %-32s  Low %lu   Medium %lu   Major %lu\n",
+                fleet->hosts[i].name, fleet->hosts[i].low, fleet->hosts[i].medium,
+                fleet->hosts[i].major);
+        }
+        end_usb_output_record(output);
+    }
+    print_usb_output(output, USB_RENDER_ANSI,
+        "\e[1;37m╰─────────────────────────────────────╯\e[0m\n\n");
+    print_usb_output(output, USB_RENDER_PLAIN,
+        "╰─────────────────────────────────────╯\n\n");
+    return result;
+}
+
+/**
+ * @brief Handles the fleet audit CLI flag
+ *
+ * every file of the directory is the snapshot of one host (udevadm
+ * export-db or lsusb dump, see --replay); the database is loaded once
+ * and shared read-only by -j workers, each keeping its own risk
+ * accumulator, merged into one risk table after the per-host summaries
+ *
+ * @details int handle_fleet_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every snapshot was classified
+ *         - 84     (EXIT_ERROR) if the database, the directory or a snapshot cannot be read,
+ *                  or the output file cannot be written
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_fleet_flag(cli_args_t *cli_args)
+{
+    usb_db_t usb_db = {0};
+    usb_risk_stats_stats_t total = {0};
+    usb_output_t output = {0};
+    usb_fleet_t fleet = {&usb_db, cli_args, NULL, NULL, 0, 0, NULL, 0};
+    struct dirent **entries = NULL;
+    int count = 0;
+    int result = EXIT_ERROR;
+
+    if (check_for_fleet_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    fleet.directory = cli_args->av[2];
+    count = scandir(fleet.directory, &entries, filter_fleet_entry, alphasort);
+    if (count < 0) {
+        dprintf(STDERR_FILENO, FLEET_ERROR_MESSAGE, fleet.directory);
+        return EXIT_ERROR;
+    }
+    fleet.host_count = count;
+    fleet.hosts = calloc(fleet.host_count + 1, sizeof(usb_fleet_host_t));
+    for (size_t i = 0; fleet.hosts != NULL && i < fleet.host_count; ++i)
+        fleet.hosts[i].name = entries[i]->d_name;
+    if (fleet.hosts != NULL && load_usb_db_from_file(&usb_db, cli_args) == EXIT_SUCCESS &&
+        run_fleet_workers(&fleet, cli_args->jobs, &total) == EXIT_SUCCESS &&
+        open_usb_output(&output, cli_args->output_path, cli_args->output_format) == EXIT_SUCCESS) {
+        result = display_fleet_hosts(&fleet, &output);
+        display_risk_table(&total, &output);
+    }
+    if (close_usb_output(&output) == EXIT_ERROR)
+        result = EXIT_ERROR;
+    free_usb_db(&usb_db);
+    free(fleet.hosts);
+    for (int i = 0; i < count; ++i)
+        free(entries[i]);
+    free(entries);
+    return result;
+}
@@ -0,0 +1,91 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_format_output_flag.c
+ * @brief reads the output format from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Parses an output format name
+ *
+ * @details static int parse_format_output_name(const char *str, int *format)
+ * @param str Name following the format output flag
+ * @param format Receives USB_FORMAT_JSON, USB_FORMAT_NDJSON or USB_FORMAT_BINARY
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the name is known
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+static int parse_format_output_name(const char *str, int *format)
+{
+    if (str == NULL)
+        return EXIT_ERROR;
+    if (strcmp(str, USB_FORMAT_JSON_NAME) == SUCCESS) {
+        *format = USB_FORMAT_JSON;
+        return SUCCESS;
+    }
+    if (strcmp(str, USB_FORMAT_NDJSON_NAME) == SUCCESS) {
+        *format = USB_FORMAT_NDJSON;
+        return SUCCESS;
+    }
+    if (strcmp(str, USB_FORMAT_BINARY_NAME) == SUCCESS) {
+        *format = USB_FORMAT_BINARY;
+        return SUCCESS;
+    }
+    return EXIT_ERROR;
+}
+
+/**
+ * @brief Handles the format output CLI flag
+ *
+ * looks for "--format-output=NAME" or "--format-output NAME" anywhere on
+ * the command line, stores the format and removes the flag like the
+ * jobs flag does; without the flag, the output is the text boxes
+ *
+ * @details int handle_format_output_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flag is absent or valid
+ *         - 84     (EXIT_ERROR) if the format name is missing or unknown
+ */
+int handle_format_output_flag(cli_args_t *cli_args)
+{
+    size_t length = strlen(FORMAT_OUTPUT_FLAG_OPTION);
+    const char *name = NULL;
+    int count = 0;
+
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strncmp(cli_args->av[i], FORMAT_OUTPUT_FLAG_OPTION, length) != SUCCESS ||
+            (cli_args->av[i][length] != '\0' &&
+            cli_args->av[i][length] != FORMAT_OUTPUT_FLAG_SEPARATOR))
+            continue;
+        count = cli_args->av[i][length] == '\0' ? 2 : 1;
+        name = count == 2 ? cli_args->av[i + 1] : cli_args->av[i] + length + 1;
+        if (parse_format_output_name(name, &cli_args->output_format) == EXIT_ERROR) {
+            dprintf(STDERR_FILENO, INVALID_FORMAT_OUTPUT_MESSAGE);
+            return EXIT_ERROR;
+        }
+        for (int j = i; j + count <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + count];
+        cli_args->ac -= count;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
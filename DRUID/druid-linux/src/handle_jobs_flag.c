@@ -0,0 +1,80 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_jobs_flag.c
+ * @brief reads the parser worker count from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Parses a worker count between 1 and MAX_JOBS
+ *
+ * @details static int parse_jobs_count(const char *str, size_t *jobs)
+ * @param str Argument following the jobs flag
+ * @param jobs Receives the worker count
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the count is valid
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+static int parse_jobs_count(const char *str, size_t *jobs)
+{
+    char *end = NULL;
+    long value = 0;
+
+    if (str == NULL || *str < '0' || *str > '9')
+        return EXIT_ERROR;
+    value = strtol(str, &end, 10);
+    if (*end != '\0' || value < 1 || value > MAX_JOBS)
+        return EXIT_ERROR;
+    *jobs = value;
+    return SUCCESS;
+}
+
+/**
+ * @brief Handles the parser worker count flag
+ *
+ * looks for "-j N" / "--jobs N" anywhere on the command line, stores the
+ * count and removes both arguments, so the other flags keep their usual
+ * positions (e.g. "druid -u feed.csv -j 8" is seen as "druid -u feed.csv");
+ * without the flag, the count stays 0 and the loader uses every online CPU
+ *
+ * @details int handle_jobs_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flag is absent or valid
+ *         - 84     (EXIT_ERROR) if the worker count is missing or invalid
+ */
+int handle_jobs_flag(cli_args_t *cli_args)
+{
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strcmp(cli_args->av[i], JOBS_FLAG) != SUCCESS &&
+            strcmp(cli_args->av[i], JOBS_FLAG_OPTION) != SUCCESS)
+            continue;
+        if (parse_jobs_count(cli_args->av[i + 1], &cli_args->jobs) == EXIT_ERROR) {
+            dprintf(STDERR_FILENO, INVALID_JOBS_MESSAGE, MAX_JOBS);
+            return EXIT_ERROR;
+        }
+        for (int j = i; j + 2 <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + 2];
+        cli_args->ac -= 2;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,63 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_metrics_file_flag.c
+ * @brief reads the metrics file path from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Handles the metrics file CLI flag
+ *
+ * looks for "--metrics-file=PATH" or "--metrics-file PATH" anywhere on
+ * the command line, stores the path and removes the flag like the jobs
+ * flag does; scans and watches then write their metrics to that file
+ *
+ * @details int handle_metrics_file_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flag is absent or valid
+ *         - 84     (EXIT_ERROR) if the path is missing or empty
+ */
+int handle_metrics_file_flag(cli_args_t *cli_args)
+{
+    size_t length = strlen(METRICS_FILE_FLAG_OPTION);
+    const char *path = NULL;
+    int count = 0;
+
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strncmp(cli_args->av[i], METRICS_FILE_FLAG_OPTION, length) != SUCCESS ||
+            (cli_args->av[i][length] != '\0' &&
+            cli_args->av[i][length] != METRICS_FILE_FLAG_SEPARATOR))
+            continue;
+        count = cli_args->av[i][length] == '\0' ? 2 : 1;
+        path = count == 2 ? cli_args->av[i + 1] : cli_args->av[i] + length + 1;
+        if (path == NULL || path[0] == '\0') {
+            dprintf(STDERR_FILENO, INVALID_METRICS_FILE_MESSAGE);
+            return EXIT_ERROR;
+        }
+        cli_args->metrics_path = path;
+        for (int j = i; j + count <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + count];
+        cli_args->ac -= count;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
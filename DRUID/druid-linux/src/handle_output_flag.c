@@ -0,0 +1,60 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_output_flag.c
+ * @brief reads the output file path from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Handles the output CLI flag
+ *
+ * looks for "-o PATH" or "--output PATH" anywhere on the command line,
+ * stores the path and removes the flag like the jobs flag does; scans,
+ * watches, fleet audits, queries and report reads then also write their
+ * results to that file
+ *
+ * @details int handle_output_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the flag is absent or valid
+ *         - 84     (EXIT_ERROR) if the path is missing or empty
+ */
+int handle_output_flag(cli_args_t *cli_args)
+{
+    const char *path = NULL;
+
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strcmp(cli_args->av[i], OUTPUT_FLAG) != SUCCESS &&
+            strcmp(cli_args->av[i], OUTPUT_FLAG_OPTION) != SUCCESS)
+            continue;
+        path = cli_args->av[i + 1];
+        if (path == NULL || path[0] == '\0') {
+            dprintf(STDERR_FILENO, INVALID_OUTPUT_MESSAGE);
+            return EXIT_ERROR;
+        }
+        cli_args->output_path = path;
+        for (int j = i; j + 2 <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + 2];
+        cli_args->ac -= 2;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,53 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_per_port_flag.c
+ * @brief reads the per-port deduplication mode from the command line
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Handles the per-port CLI flag
+ *
+ * looks for "-p" / "--per-port" anywhere on the command line and removes
+ * it like the jobs flag does; in per-port mode every bus-port path is
+ * classified, so identical devices plugged on different ports are all
+ * reported instead of once per vendor and product id
+ *
+ * @details int handle_per_port_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) whether the flag is present or not
+ */
+int handle_per_port_flag(cli_args_t *cli_args)
+{
+    for (int i = 1; i < cli_args->ac; ++i) {
+        if (strcmp(cli_args->av[i], PER_PORT_FLAG) != SUCCESS &&
+            strcmp(cli_args->av[i], PER_PORT_FLAG_OPTION) != SUCCESS)
+            continue;
+        cli_args->per_port = true;
+        for (int j = i; j + 1 <= cli_args->ac; ++j)
+            cli_args->av[j] = cli_args->av[j + 1];
+        cli_args->ac -= 1;
+        return SUCCESS;
+    }
+    return SUCCESS;
+}
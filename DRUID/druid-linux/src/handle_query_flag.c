@@ -0,0 +1,245 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_query_flag.c
+ * @brief asks a running druidd instead of loading the database (--query)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request a query to druidd
+ *
+ * @details static int check_for_query_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the query flag is given, alone or followed by an id pair
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_query_flag(cli_args_t *cli_args)
+{
+    if ((cli_args->ac == 2 || cli_args->ac == 3) &&
+        (strcmp(cli_args->av[1], QUERY_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], QUERY_FLAG_OPTION) == SUCCESS)) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Builds the request of the query: a scan, or the lookup of an id pair
+ *
+ * @details static int build_query_request(
+ *             const char *id_pair,
+ *             char *request,
+ *             size_t size)
+ * @param id_pair Vendor and product ids as vvvv:pppp, or NULL for a scan
+ * @param request Receives the request line
+ * @param size Size of the request buffer
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the id pair is malformed
+ */
+static int build_query_request(const char *id_pair, char *request, size_t size)
+{
+    uint16_t vendor_id = 0;
+    uint16_t product_id = 0;
+
+    if (id_pair == NULL) {
+        snprintf(request, size, "%c\n", DRUIDD_SCAN_REQUEST);
+        return EXIT_SUCCESS;
+    }
+    if (strlen(id_pair) != HEX_ID_LENGTH * 2 + 1 || id_pair[HEX_ID_LENGTH] != ':' ||
+        parse_usb_id_field(id_pair, HEX_ID_LENGTH, &vendor_id) == UNSEEN ||
+        parse_usb_id_field(id_pair + HEX_ID_LENGTH + 1, HEX_ID_LENGTH, &product_id) == UNSEEN) {
+        dprintf(STDERR_FILENO, INVALID_QUERY_MESSAGE);
+        return EXIT_ERROR;
+    }
+    snprintf(request, size, "%c;%04x;%04x\n", DRUIDD_LOOKUP_REQUEST, vendor_id, product_id);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Connects to druidd and sends the request
+ *
+ * @details static FILE *send_query_request(const char *path, const char *request)
+ * @param path Path of the druidd socket
+ * @param request Request line
+ * @return Stream the replies are read from, or NULL if druidd cannot be reached
+ */
+static FILE *send_query_request(const char *path, const char *request)
+{
+    struct sockaddr_un address = {0};
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    size_t length = strlen(request);
+    FILE *stream = NULL;
+
+    address.sun_family = AF_UNIX;
+    if (fd >= 0 && strlen(path) < sizeof(address.sun_path)) {
+        strcpy(address.sun_path, path);
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == SUCCESS &&
+            send(fd, request, length, MSG_NOSIGNAL) == (ssize_t)length)
+            stream = fdopen(fd, READ_MODE);
+    }
+    if (stream == NULL) {
+        if (fd >= 0)
+            close(fd);
+        dprintf(STDERR_FILENO, QUERY_CONNECT_ERROR_MESSAGE, path);
+    }
+    return stream;
+}
+
+/**
+ * @brief Displays one device reply of druidd the way a local scan would
+ *
+ * @details static int display_query_reply(
+ *             char *reply,
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output)
+ * @param reply Reply line, without its line break (modified in place)
+ * @param usb_risk_stats Pointer to the risk statistics to update
+ * @param output Pointer to the output the device is rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the reply is malformed
+ */
+static int display_query_reply(char *reply, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output)
+{
+    char *fields[DRUIDD_REPLY_FIELDS] = {NULL};
+    usb_device_info_t usb_device_info = {0};
+    usb_db_names_t usb_db_names = {0};
+    size_t count = 0;
+
+    while (count < DRUIDD_REPLY_FIELDS && reply != NULL)
+        fields[count++] = strsep(&reply, FILE_SEPARATOR);
+    if (count != DRUIDD_REPLY_FIELDS || reply != NULL || fields[0][1] != '\0' ||
+        fields[0][0] < '0' + MATCH_NONE || fields[0][0] > '0' + MATCH_VENDOR_AND_PRODUCT)
+        return EXIT_ERROR;
+    init_struct_usb_device_info(&usb_device_info);
+    usb_device_info.vendor_id = fields[1];
+    usb_device_info.product_id = fields[2];
+    usb_device_info.vendor_name = fields[5][0] != '\0' ? fields[5] : UNKNOWN_DEVICE_MESSAGE;
+    usb_device_info.product_name = fields[6][0] != '\0' ? fields[6] : UNKNOWN_DEVICE_MESSAGE;
+    usb_device_info.path_usb = fields[7][0] != '\0' ? fields[7] : NULL;
+    if (fields[8][0] != '\0')
+        usb_device_info.hub_depth = atoi(fields[8]);
+    usb_db_names = (usb_db_names_t){fields[3], strlen(fields[3]), fields[4], strlen(fields[4])};
+    if (fields[0][0] == '0' + MATCH_VENDOR_AND_PRODUCT)
+        display_known_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    else if (fields[0][0] == '0' + MATCH_VENDOR_ONLY)
+        display_partially_known_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    else
+        display_unknown_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    ++usb_risk_stats->seen_count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads and displays the replies of druidd
+ *
+ * a lookup gets one reply; a scan gets one reply per device, then the
+ * end reply, after which the risk table is printed
+ *
+ * @details static int display_query_replies(
+ *             FILE *stream,
+ *             bool scan,
+ *             usb_output_t *output)
+ * @param stream Stream of the connection
+ * @param scan Whether the request was a scan
+ * @param output Pointer to the output the replies are rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if druidd answered an error or something unexpected
+ */
+static int display_query_replies(FILE *stream, bool scan, usb_output_t *output)
+{
+    usb_risk_stats_stats_t usb_risk_stats = {0};
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length = 0;
+    int result = EXIT_ERROR;
+
+    while ((length = getline(&line, &line_size, stream)) > 0) {
+        if (line[length - 1] == LINE_SEPARATOR)
+            line[length - 1] = '\0';
+        if (line[0] == DRUIDD_ERROR_REPLY || (line[0] == DRUIDD_END_REPLY && !scan))
+            break;
+        if (line[0] == DRUIDD_END_REPLY) {
+            display_risk_table(&usb_risk_stats, output);
+            result = EXIT_SUCCESS;
+            break;
+        }
+        if (display_query_reply(line, &usb_risk_stats, output) == EXIT_ERROR)
+            break;
+        if (!scan) {
+            result = EXIT_SUCCESS;
+            break;
+        }
+    }
+    if (result == EXIT_ERROR && length > 1 && line[0] == DRUIDD_ERROR_REPLY)
+        dprintf(STDERR_FILENO, QUERY_SERVER_ERROR_MESSAGE, line + 2);
+    else if (result == EXIT_ERROR)
+        dprintf(STDERR_FILENO, QUERY_PROTOCOL_ERROR_MESSAGE);
+    free(line);
+    return result;
+}
+
+/**
+ * @brief Handles the query CLI flag
+ *
+ * the lookup (-q vvvv:pppp) or the scan of the host (-q alone) is done
+ * by a druidd already holding the database, found on the DRUID_SOCKET
+ * socket (DRUIDD_SOCKET_PATH by default): nothing is loaded here
+ *
+ * @details int handle_query_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if druidd answered
+ *         - 84     (EXIT_ERROR) if the id pair is malformed, druidd cannot answer
+ *                  or the output file cannot be written
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_query_flag(cli_args_t *cli_args)
+{
+    const char *id_pair = NULL;
+    char request[32] = {0};
+    FILE *stream = NULL;
+    usb_output_t output = {0};
+    int result = EXIT_ERROR;
+
+    if (check_for_query_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    id_pair = cli_args->ac == 3 ? cli_args->av[2] : NULL;
+    if (build_query_request(id_pair, request, sizeof(request)) == EXIT_ERROR)
+        return EXIT_ERROR;
+    stream = send_query_request(get_usb_lookup_socket_path(), request);
+    if (stream == NULL)
+        return EXIT_ERROR;
+    if (open_usb_output(&output, cli_args->output_path, cli_args->output_format) == EXIT_SUCCESS)
+        result = display_query_replies(stream, id_pair == NULL, &output);
+    if (close_usb_output(&output) == EXIT_ERROR)
+        result = EXIT_ERROR;
+    fclose(stream);
+    return result;
+}
@@ -0,0 +1,409 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_read_report_flag.c
+ * @brief decodes binary reports, or sums up a directory of them (--read-report)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request to read reports
+ *
+ * @details static int check_for_read_report_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the read report flag is followed by a path
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_read_report_flag(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 3 &&
+        (strcmp(cli_args->av[1], READ_REPORT_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], READ_REPORT_FLAG_OPTION) == SUCCESS)
+        && cli_args->av[2] != NULL) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Validates the header and the footer of a report
+ *
+ * magic and version are checked at both ends and every section the
+ * footer describes must lie inside the file, so a truncated or foreign
+ * file is never trusted
+ *
+ * @details static bool check_usb_report_ends(
+ *             const usb_report_header_t *header,
+ *             const usb_report_footer_t *footer,
+ *             size_t size)
+ * @param header Pointer to the header of the report
+ * @param footer Pointer to the footer of the report
+ * @param size Size of the report file
+ * @return true if the report is usable, false otherwise
+ */
+static bool check_usb_report_ends(const usb_report_header_t *header,
+    const usb_report_footer_t *footer, size_t size)
+{
+    size_t end = size - sizeof(usb_report_footer_t);
+
+    if (memcmp(header->magic, USB_REPORT_MAGIC, USB_REPORT_MAGIC_SIZE) != SUCCESS ||
+        header->version != USB_REPORT_VERSION || header->header_size != sizeof(usb_report_header_t) ||
+        memcmp(footer->magic, USB_REPORT_MAGIC, USB_REPORT_MAGIC_SIZE) != SUCCESS ||
+        footer->version != USB_REPORT_VERSION || end % USB_REPORT_ALIGNMENT != 0 ||
+        footer->strings_offset % USB_REPORT_ALIGNMENT != 0 ||
+        footer->strings_offset < sizeof(usb_report_header_t) || footer->strings_offset > end)
+        return false;
+    return footer->string_count <= (end - footer->strings_offset) / sizeof(uint32_t) &&
+        footer->strings_size <= end - footer->strings_offset -
+        footer->string_count * sizeof(uint32_t) &&
+        footer->record_count <= (footer->strings_offset - sizeof(usb_report_header_t)) /
+        sizeof(usb_report_record_t);
+}
+
+/**
+ * @brief Reads the footer of a report, and nothing else
+ *
+ * two reads (header and footer) are cheaper than mapping the file when
+ * only the totals of many small reports are needed
+ *
+ * @details static int read_usb_report_footer(
+ *             const char *path,
+ *             usb_report_footer_t *footer)
+ * @param path Path of the report
+ * @param footer Receives the footer
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the file cannot be read or is not a valid report
+ */
+static int read_usb_report_footer(const char *path, usb_report_footer_t *footer)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    usb_report_header_t header = {0};
+    struct stat st = {0};
+    int result = EXIT_ERROR;
+
+    if (fd < 0)
+        return EXIT_ERROR;
+    if (fstat(fd, &st) == SUCCESS &&
+        (size_t)st.st_size >= sizeof(usb_report_header_t) + sizeof(usb_report_footer_t) &&
+        pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        pread(fd, footer, sizeof(*footer), st.st_size - sizeof(*footer)) == sizeof(*footer) &&
+        check_usb_report_ends(&header, footer, st.st_size))
+        result = EXIT_SUCCESS;
+    close(fd);
+    return result;
+}
+
+/**
+ * @brief Validates a mapped report and locates its string table
+ *
+ * @details static bool check_usb_report(usb_report_view_t *view)
+ * @param view Pointer to the mapped report, whose sections are set
+ * @return true if the report is usable, false otherwise
+ */
+static bool check_usb_report(usb_report_view_t *view)
+{
+    const usb_report_footer_t *footer = NULL;
+
+    if (view->size < sizeof(usb_report_header_t) + sizeof(usb_report_footer_t) ||
+        view->size % USB_REPORT_ALIGNMENT != 0)
+        return false;
+    footer = (const usb_report_footer_t *)(view->data + view->size - sizeof(usb_report_footer_t));
+    if (!check_usb_report_ends((const usb_report_header_t *)view->data, footer, view->size))
+        return false;
+    view->footer = footer;
+    view->offsets = (const uint32_t *)(view->data + footer->strings_offset);
+    view->strings = (const char *)(view->offsets + footer->string_count);
+    return footer->strings_size == 0 || view->strings[footer->strings_size - 1] == '\0';
+}
+
+/**
+ * @brief Maps a report file and validates it
+ *
+ * @details static int map_usb_report(const char *path, usb_report_view_t *view)
+ * @param path Path of the report
+ * @param view Receives the mapping and its sections
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the file cannot be read or is not a valid report
+ */
+static int map_usb_report(const char *path, usb_report_view_t *view)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st = {0};
+    void *data = NULL;
+
+    *view = (usb_report_view_t){0};
+    if (fd < 0)
+        return EXIT_ERROR;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return EXIT_ERROR;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return EXIT_ERROR;
+    view->data = data;
+    view->size = st.st_size;
+    if (!check_usb_report(view)) {
+        munmap(data, st.st_size);
+        *view = (usb_report_view_t){0};
+        return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Gives a name of the string table of a report
+ *
+ * @details static const char *get_usb_report_name(
+ *             usb_report_view_t *view,
+ *             uint32_t index)
+ * @param view Pointer to the mapped report
+ * @param index Index of the name (USB_REPORT_NO_NAME when absent)
+ * @return The null-terminated name, or NULL if absent or out of bounds
+ */
+static const char *get_usb_report_name(usb_report_view_t *view, uint32_t index)
+{
+    if (index >= view->footer->string_count ||
+        view->offsets[index] >= view->footer->strings_size)
+        return NULL;
+    return view->strings + view->offsets[index];
+}
+
+/**
+ * @brief Gives a name of the string table of a report that is printed
+ * as text, UNKNOWN_DEVICE_MESSAGE standing for an absent one
+ *
+ * @details static const char *get_usb_report_text(
+ *             usb_report_view_t *view,
+ *             uint32_t index)
+ * @param view Pointer to the mapped report
+ * @param index Index of the name (USB_REPORT_NO_NAME when absent)
+ * @return The null-terminated name, never NULL
+ */
+static const char *get_usb_report_text(usb_report_view_t *view, uint32_t index)
+{
+    const char *name = get_usb_report_name(view, index);
+
+    return name != NULL ? name : UNKNOWN_DEVICE_MESSAGE;
+}
+
+/**
+ * @brief Displays one record of a report the way the scan that wrote it did
+ *
+ * ids are taken from the string table, as the scan read them, not
+ * from the numeric ids of the record; ids and names missing from the
+ * table are shown as unknown
+ *
+ * @details static void display_usb_report_record(
+ *             usb_report_view_t *view,
+ *             usb_report_record_t *record,
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output)
+ * @param view Pointer to the mapped report
+ * @param record Pointer to the record
+ * @param usb_risk_stats Pointer to the risk statistics to update
+ * @param output Pointer to the output the record is rendered to
+ */
+static void display_usb_report_record(usb_report_view_t *view, usb_report_record_t *record,
+    usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output)
+{
+    usb_device_info_t usb_device_info = {0};
+    usb_db_names_t usb_db_names = {0};
+    const char *vendor_id = get_usb_report_text(view, record->names[USB_REPORT_VENDOR_ID]);
+    const char *product_id = get_usb_report_text(view, record->names[USB_REPORT_PRODUCT_ID]);
+    const char *devpath = get_usb_report_name(view, record->names[USB_REPORT_DEVPATH]);
+
+    usb_device_info = (usb_device_info_t){vendor_id,
+        get_usb_report_text(view, record->names[USB_REPORT_VENDOR_NAME]), product_id,
+        get_usb_report_text(view, record->names[USB_REPORT_PRODUCT_NAME]), devpath,
+        get_usb_report_name(view, record->names[USB_REPORT_SERIAL]), record->hub_depth};
+    if (record->type == USB_REPORT_REMOVED) {
+        print_usb_output(output, USB_RENDER_ANSI, WATCH_REMOVED_MESSAGE, vendor_id, product_id,
+            devpath != NULL ? devpath : UNKNOWN_DEVICE_MESSAGE);
+        print_usb_output(output, USB_RENDER_PLAIN, WATCH_REMOVED_MESSAGE, vendor_id, product_id,
+            devpath != NULL ? devpath : UNKNOWN_DEVICE_MESSAGE);
+        print_usb_json_removed(output, &usb_device_info, devpath);
+        print_usb_report_removed(output, &usb_device_info, devpath);
+        end_usb_output_record(output);
+        return;
+    }
+    usb_db_names.vendor_name = get_usb_report_text(view, record->names[USB_REPORT_DB_VENDOR_NAME]);
+    usb_db_names.product_name = get_usb_report_text(view, record->names[USB_REPORT_DB_PRODUCT_NAME]);
+    usb_db_names.vendor_name_length = strlen(usb_db_names.vendor_name);
+    usb_db_names.product_name_length = strlen(usb_db_names.product_name);
+    if (record->match == MATCH_VENDOR_AND_PRODUCT)
+        display_known_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    else if (record->match == MATCH_VENDOR_ONLY)
+        display_partially_known_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    else
+        display_unknown_usb_device(&usb_device_info, &usb_db_names, usb_risk_stats, output);
+    ++usb_risk_stats->seen_count;
+}
+
+/**
+ * @brief Decodes every record of a report, then its risk table
+ *
+ * records are read in place from the mapping; each starts with its
+ * size, so fields appended by later versions are skipped, and record
+ * types this version does not know are ignored
+ *
+ * @details static int display_usb_report(
+ *             usb_report_view_t *view,
+ *             usb_output_t *output)
+ * @param view Pointer to the mapped report
+ * @param output Pointer to the output the records are rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every record was decoded
+ *         - 84     (EXIT_ERROR) if a record is truncated
+ */
+static int display_usb_report(usb_report_view_t *view, usb_output_t *output)
+{
+    usb_risk_stats_stats_t usb_risk_stats = {0};
+    usb_report_record_t record = {0};
+    size_t offset = sizeof(usb_report_header_t);
+    uint16_t size = 0;
+
+    for (uint64_t i = 0; i < view->footer->record_count; ++i) {
+        if (view->footer->strings_offset - offset < sizeof(usb_report_record_t))
+            return EXIT_ERROR;
+        memcpy(&size, view->data + offset, sizeof(size));
+        if (size < sizeof(usb_report_record_t) || size > view->footer->strings_offset - offset)
+            return EXIT_ERROR;
+        memcpy(&record, view->data + offset, sizeof(record));
+        offset += size;
+        if (record.type == USB_REPORT_DEVICE || record.type == USB_REPORT_REMOVED)
+            display_usb_report_record(view, &record, &usb_risk_stats, output);
+    }
+    display_risk_table(&usb_risk_stats, output);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Sums up every report of a directory from their footers only
+ *
+ * only the header and the footer of each report are read, the records
+ * are never touched; reports are listed like the hosts of a fleet
+ * audit, then the risk table of all of them
+ *
+ * @details static int display_usb_report_directory(
+ *             const char *directory,
+ *             cli_args_t *cli_args,
+ *             usb_output_t *output)
+ * @param directory Directory holding one report per host
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @param output Pointer to the output the summaries are rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every report was read
+ *         - 84     (EXIT_ERROR) if the directory or a report cannot be read
+ */
+static int display_usb_report_directory(const char *directory, cli_args_t *cli_args,
+    usb_output_t *output)
+{
+    usb_fleet_t fleet = {NULL, cli_args, directory, NULL, 0, 0, NULL, 0};
+    usb_risk_stats_stats_t total = {0};
+    usb_report_footer_t footer = {0};
+    struct dirent **entries = NULL;
+    char path[FLEET_PATH_SIZE] = {0};
+    int count = scandir(directory, &entries, filter_fleet_entry, alphasort);
+    int result = EXIT_ERROR;
+
+    if (count < 0) {
+        dprintf(STDERR_FILENO, READ_REPORT_DIRECTORY_ERROR_MESSAGE, directory);
+        return EXIT_ERROR;
+    }
+    fleet.host_count = count;
+    fleet.hosts = calloc(fleet.host_count + 1, sizeof(usb_fleet_host_t));
+    for (size_t i = 0; fleet.hosts != NULL && i < fleet.host_count; ++i) {
+        fleet.hosts[i].name = entries[i]->d_name;
+        fleet.hosts[i].status = EXIT_ERROR;
+        if ((size_t)snprintf(path, sizeof(path), "%s/%s", directory, entries[i]->d_name) >=
+            sizeof(path) || read_usb_report_footer(path, &footer) == EXIT_ERROR)
+            continue;
+        fleet.hosts[i] = (usb_fleet_host_t){entries[i]->d_name, footer.low, footer.medium,
+            footer.major, EXIT_SUCCESS};
+        total.low += footer.low;
+        total.medium += footer.medium;
+        total.major += footer.major;
+    }
+    if (fleet.hosts != NULL) {
+        result = display_fleet_hosts(&fleet, output);
+        display_risk_table(&total, output);
+    }
+    free(fleet.hosts);
+    for (int i = 0; i < count; ++i)
+        free(entries[i]);
+    free(entries);
+    return result;
+}
+
+/**
+ * @brief Handles the read report CLI flag
+ *
+ * a report file (written with --format-output=binary) is decoded and
+ * displayed like the scan that wrote it, in any output format; a
+ * directory of reports is summed up from their footers, one line per
+ * report and the risk table of all of them
+ *
+ * @details int handle_read_report_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every report was read
+ *         - 84     (EXIT_ERROR) if a report cannot be read or is invalid, or the
+ *                  output file cannot be written
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_read_report_flag(cli_args_t *cli_args)
+{
+    const char *path = NULL;
+    usb_report_view_t view = {0};
+    usb_output_t output = {0};
+    struct stat st = {0};
+    int result = EXIT_ERROR;
+
+    if (check_for_read_report_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    path = cli_args->av[2];
+    if (stat(path, &st) == SUCCESS && S_ISDIR(st.st_mode)) {
+        if (open_usb_output(&output, cli_args->output_path, cli_args->output_format) == EXIT_SUCCESS)
+            result = display_usb_report_directory(path, cli_args, &output);
+    } else if (map_usb_report(path, &view) == EXIT_SUCCESS) {
+        if (open_usb_output(&output, cli_args->output_path, cli_args->output_format) == EXIT_SUCCESS) {
+            result = display_usb_report(&view, &output);
+            if (result == EXIT_ERROR)
+                dprintf(STDERR_FILENO, READ_REPORT_ERROR_MESSAGE, path);
+        }
+        munmap((void *)view.data, view.size);
+    } else {
+        dprintf(STDERR_FILENO, READ_REPORT_ERROR_MESSAGE, path);
+    }
+    if (close_usb_output(&output) == EXIT_ERROR)
+        result = EXIT_ERROR;
+    return result;
+}
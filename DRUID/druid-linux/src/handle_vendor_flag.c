@@ -0,0 +1,125 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_vendor_flag.c
+ * @brief lists the products the database knows for one vendor
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request a vendor listing
+ *
+ * @details static int check_for_vendor_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the vendor flag is followed by an id
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_vendor_flag(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 3 &&
+        (strcmp(cli_args->av[1], VENDOR_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], VENDOR_FLAG_OPTION) == SUCCESS)
+        && cli_args->av[2] != NULL) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Prints a vendor and the products of its directory span
+ *
+ * the span is already sorted by product id and holds each id once, with
+ * the row a scan would match; a span reaching past the products of a
+ * corrupted image is printed empty
+ *
+ * @details static void display_vendor_products(
+ *             usb_db_t *usb_db,
+ *             usb_db_vendor_t *vendor)
+ * @param usb_db Pointer to the database holding the directory
+ * @param vendor Pointer to the vendor to list
+ */
+static void display_vendor_products(usb_db_t *usb_db, usb_db_vendor_t *vendor)
+{
+    usb_db_names_t usb_db_names = {0};
+    usb_db_slot_t *product = NULL;
+    size_t start = vendor[0].start;
+    size_t end = vendor[1].start;
+
+    if (start > end || end > usb_db->directory.product_count)
+        end = start;
+    if (vendor->entry == EMPTY_SLOT || vendor->entry > usb_db->count)
+        init_struct_unknown_usb_db_names(&usb_db_names);
+    else
+        decode_usb_db_entry(usb_db, vendor->entry - 1, &usb_db_names);
+    printf(VENDOR_HEADER_MESSAGE, vendor->vendor_id, usb_db_names.vendor_name_length,
+        usb_db_names.vendor_name, end - start);
+    for (size_t i = start; i < end; ++i) {
+        product = &usb_db->directory.products[i];
+        if (product->entry == EMPTY_SLOT || product->entry > usb_db->count)
+            continue;
+        decode_usb_db_entry(usb_db, product->entry - 1, &usb_db_names);
+        printf(VENDOR_PRODUCT_MESSAGE, product->key & 0xffff,
+            usb_db_names.product_name_length, usb_db_names.product_name);
+    }
+}
+
+/**
+ * @brief Handles the vendor listing CLI flag
+ *
+ * loads the database like a scan does (embedded table, compiled image
+ * or CSV), then finds the vendor with one binary search in the vendor
+ * directory and prints its products in product id order
+ *
+ * @details int handle_vendor_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the vendor was listed
+ *         - 84     (EXIT_ERROR) if the id is invalid, unknown or the database cannot be loaded
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_vendor_flag(cli_args_t *cli_args)
+{
+    usb_db_t usb_db = {0};
+    usb_db_vendor_t *vendor = NULL;
+    uint16_t vendor_id = 0;
+
+    if (check_for_vendor_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    if (parse_usb_id(cli_args->av[2], &vendor_id) != SUCCESS) {
+        dprintf(STDERR_FILENO, INVALID_VENDOR_MESSAGE);
+        return EXIT_ERROR;
+    }
+    if (load_usb_db_from_file(&usb_db, cli_args) == EXIT_ERROR) {
+        free_usb_db(&usb_db);
+        return EXIT_ERROR;
+    }
+    vendor = find_usb_db_vendor(&usb_db.directory, vendor_id);
+    if (vendor == NULL) {
+        dprintf(STDERR_FILENO, UNKNOWN_VENDOR_MESSAGE, vendor_id);
+        free_usb_db(&usb_db);
+        return EXIT_ERROR;
+    }
+    display_vendor_products(&usb_db, vendor);
+    free_usb_db(&usb_db);
+    return EXIT_SUCCESS;
+}
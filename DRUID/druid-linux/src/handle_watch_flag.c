@@ -0,0 +1,390 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file handle_watch_flag.c
+ * @brief classifies usb devices as they are plugged in (hotplug watch mode)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include <systemd/sd-event.h>
+#include "druid.h"
+
+/**
+ * @brief Checks if the CLI arguments request the watch mode
+ *
+ * @details static int check_for_watch_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the watch flag is present
+ *         - -1     (UNSEEN) otherwise
+ */
+static int check_for_watch_flag(cli_args_t *cli_args)
+{
+    if (cli_args->ac == 2 &&
+        (strcmp(cli_args->av[1], WATCH_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], WATCH_FLAG_OPTION) == SUCCESS)) {
+        return SUCCESS;
+    }
+    return UNSEEN;
+}
+
+/**
+ * @brief Loads the database of the watch, timing the load for the metrics
+ *
+ * @details static int load_watch_db(usb_watch_t *watch, cli_args_t *cli_args)
+ * @param watch Pointer to the usb_watch_t state
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the database was loaded
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+static int load_watch_db(usb_watch_t *watch, cli_args_t *cli_args)
+{
+    double start = get_usb_metrics_clock();
+
+    if (load_usb_db_from_file(watch->usb_db, cli_args) == EXIT_ERROR)
+        return EXIT_ERROR;
+    set_usb_metrics_db(watch->usb_risk_stats->metrics, watch->usb_db,
+        get_usb_metrics_clock() - start);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Writes the metrics left pending by the last events, once the
+ * interval since the previous write is over
+ *
+ * @details static int write_watch_metrics(
+ *             sd_event_source *source,
+ *             uint64_t usec,
+ *             void *userdata)
+ * @param source Timer event source, released here
+ * @param usec Time the timer was set to (unused)
+ * @param userdata Pointer to the usb_watch_t state
+ * @return 0, so the event loop keeps running
+ */
+static int write_watch_metrics(sd_event_source *source, uint64_t usec, void *userdata)
+{
+    usb_watch_t *watch = userdata;
+
+    (void)usec;
+    watch->metrics_timer = sd_event_source_unref(source);
+    write_usb_metrics(watch->usb_risk_stats->metrics, watch->usb_risk_stats);
+    return SUCCESS;
+}
+
+/**
+ * @brief Writes the metrics file, or arms a timer to write it later
+ *
+ * the file is written at most once per USB_METRICS_INTERVAL seconds;
+ * changes made meanwhile are written when the timer expires, so a
+ * burst of hotplug events costs one write and the last one is not lost
+ *
+ * @details static void schedule_watch_metrics(usb_watch_t *watch)
+ * @param watch Pointer to the usb_watch_t state
+ */
+static void schedule_watch_metrics(usb_watch_t *watch)
+{
+    double delay = update_usb_metrics(watch->usb_risk_stats->metrics, watch->usb_risk_stats);
+
+    if (delay > 0 && watch->metrics_timer == NULL)
+        sd_event_add_time_relative(watch->event, &watch->metrics_timer, CLOCK_MONOTONIC,
+            (uint64_t)(delay * 1000000) + 1, 0, write_watch_metrics, watch);
+}
+
+/**
+ * @brief Classifies a device attached during the watch and records it
+ * at its bus-port path
+ *
+ * an event for a path already attached is ignored; a device already
+ * classified (same vendor and product IDs, or same bus-port path in
+ * per-port mode) is not counted again and shares the risk of the
+ * attached device it duplicates; a device without bus-port path is
+ * classified but cannot be tracked
+ *
+ * @details static void attach_watch_device(
+ *             usb_watch_t *watch,
+ *             usb_device_info_t *usb_device_info)
+ * @param watch Pointer to the usb_watch_t state
+ * @param usb_device_info Pointer to the device, with non-NULL ids
+ */
+static void attach_watch_device(usb_watch_t *watch, usb_device_info_t *usb_device_info)
+{
+    usb_seen_set_t *seen = &watch->usb_risk_stats->seen;
+    usb_live_device_t *twin = NULL;
+    int match = MATCH_NONE;
+
+    if (usb_device_info->path_usb != NULL &&
+        find_usb_live_device(&watch->live, usb_device_info->path_usb) != NULL)
+        return;
+    if (check_usb_seen(seen, usb_device_info) == SUCCESS) {
+        twin = find_usb_live_seen(&watch->live, get_usb_seen_key(seen, usb_device_info));
+        if (twin == NULL)
+            return;
+        match = twin->match;
+    } else {
+        match = check_usb_exist(watch->usb_db, usb_device_info, watch->usb_risk_stats,
+            watch->output);
+    }
+    if (usb_device_info->path_usb != NULL)
+        add_usb_live_device(&watch->live, usb_device_info->path_usb,
+            get_usb_seen_key(seen, usb_device_info), match);
+}
+
+/**
+ * @brief Forgets the device detached from a bus-port path
+ *
+ * once no attached device shares its seen set key, the key leaves the
+ * set and the risk counter and the metrics vendor count of the device
+ * are decremented, so the risk table and the device gauges only count
+ * the devices still attached
+ *
+ * @details static void detach_watch_device(
+ *             usb_watch_t *watch,
+ *             usb_device_info_t *usb_device_info)
+ * @param watch Pointer to the usb_watch_t state
+ * @param usb_device_info Pointer to the removed device
+ */
+static void detach_watch_device(usb_watch_t *watch, usb_device_info_t *usb_device_info)
+{
+    usb_risk_stats_stats_t *usb_risk_stats = watch->usb_risk_stats;
+    usb_live_device_t device = {0};
+
+    if (usb_device_info->path_usb == NULL ||
+        take_usb_live_device(&watch->live, usb_device_info->path_usb, &device) == UNSEEN ||
+        find_usb_live_seen(&watch->live, device.seen_key) != NULL)
+        return;
+    remove_usb_seen_key(&usb_risk_stats->seen, device.seen_key);
+    if (device.match == MATCH_VENDOR_AND_PRODUCT)
+        --usb_risk_stats->low;
+    else if (device.match == MATCH_VENDOR_ONLY)
+        --usb_risk_stats->medium;
+    else
+        --usb_risk_stats->major;
+    forget_usb_classification(usb_risk_stats->metrics, usb_device_info);
+}
+
+/**
+ * @brief Classifies the devices connected when the watch starts
+ *
+ * same walk as scan_usb_devices, but each device is recorded at its
+ * bus-port path so its removal can be undone
+ *
+ * @details static void scan_watch_devices(
+ *             usb_watch_t *watch,
+ *             usb_tools_t *usb_tools,
+ *             usb_device_info_t *usb_device_info)
+ * @param watch Pointer to the usb_watch_t state
+ * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
+ * @param usb_device_info Pointer to the usb_device_info_t structure for storing device info
+ */
+static void scan_watch_devices(usb_watch_t *watch, usb_tools_t *usb_tools,
+    usb_device_info_t *usb_device_info)
+{
+    usb_topology_t usb_topology = {0};
+    int status = UNSEEN;
+
+    begin_usb_metrics_walk(watch->usb_risk_stats->metrics);
+    status = first_usb_device(usb_tools, usb_device_info);
+    for (; status == SUCCESS; status = next_usb_device(usb_tools, usb_device_info)) {
+        if (add_usb_topology_node(&usb_topology, usb_device_info) == USB_NODE_INTERFACE ||
+            usb_device_info->vendor_id == NULL || usb_device_info->product_id == NULL)
+            continue;
+        attach_watch_device(watch, usb_device_info);
+    }
+    end_usb_metrics_walk(watch->usb_risk_stats->metrics);
+    free_usb_topology(&usb_topology);
+}
+
+/**
+ * @brief Classifies the device of one hotplug event
+ *
+ * only the plugged device is looked up (the database stays loaded),
+ * a removal is reported without lookup and undoes the classification
+ * of its device; events of devices without vendor id are ignored.
+ * Plugged devices are added to the usb tree of the watch so their hub
+ * depth is known
+ *
+ * @details static int handle_usb_event(
+ *             sd_device_monitor *monitor,
+ *             sd_device *device,
+ *             void *userdata)
+ * @param monitor Monitor that received the event (unused)
+ * @param device Device added or removed
+ * @param userdata Pointer to the usb_watch_t state
+ * @return 0, so the event loop keeps running
+ */
+static int handle_usb_event(sd_device_monitor *monitor, sd_device *device,
+    void *userdata)
+{
+    usb_watch_t *watch = userdata;
+    usb_device_info_t usb_device_info = {0};
+    sd_device_action_t action = _SD_DEVICE_ACTION_INVALID;
+    const char *devpath = NULL;
+
+    (void)monitor;
+    init_struct_usb_device_info(&usb_device_info);
+    get_vendor_product_device(device, &usb_device_info);
+    if (sd_device_get_action(device, &action) < 0 ||
+        usb_device_info.vendor_id == NULL || usb_device_info.product_id == NULL)
+        return SUCCESS;
+    if (action == SD_DEVICE_ADD) {
+        add_usb_topology_node(&watch->topology, &usb_device_info);
+        attach_watch_device(watch, &usb_device_info);
+    } else if (action == SD_DEVICE_REMOVE) {
+        sd_device_get_devpath(device, &devpath);
+        print_usb_output(watch->output, USB_RENDER_ANSI, WATCH_REMOVED_MESSAGE,
+            usb_device_info.vendor_id, usb_device_info.product_id,
+            devpath != NULL ? devpath : UNKNOWN_DEVICE_MESSAGE);
+        print_usb_output(watch->output, USB_RENDER_PLAIN, WATCH_REMOVED_MESSAGE,
+            usb_device_info.vendor_id, usb_device_info.product_id,
+            devpath != NULL ? devpath : UNKNOWN_DEVICE_MESSAGE);
+        print_usb_json_removed(watch->output, &usb_device_info, devpath);
+        print_usb_report_removed(watch->output, &usb_device_info, devpath);
+        print_usb_journal_removed(watch->output, &usb_device_info, devpath);
+        detach_watch_device(watch, &usb_device_info);
+    }
+    flush_usb_output(watch->output);
+    schedule_watch_metrics(watch);
+    return SUCCESS;
+}
+
+/**
+ * @brief Leaves the event loop on SIGINT or SIGTERM
+ *
+ * @details static int stop_watch(
+ *             sd_event_source *source,
+ *             const struct signalfd_siginfo *info,
+ *             void *userdata)
+ * @param source Signal event source (unused)
+ * @param info Received signal (unused)
+ * @param userdata Pointer to the usb_watch_t state
+ * @return Result of sd_event_exit
+ */
+static int stop_watch(sd_event_source *source, const struct signalfd_siginfo *info,
+    void *userdata)
+{
+    usb_watch_t *watch = userdata;
+
+    (void)source;
+    (void)info;
+    return sd_event_exit(watch->event, SUCCESS);
+}
+
+/**
+ * @brief Sets up the event loop and subscribes to usb hotplug events
+ *
+ * SIGINT and SIGTERM are blocked and delivered through the loop so the
+ * risk table is still printed on exit; the monitor only receives whole
+ * usb devices, not their interfaces
+ *
+ * @details static int start_watch(usb_watch_t *watch)
+ * @param watch Pointer to the usb_watch_t state
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the monitor is running
+ *         - 84     (EXIT_ERROR) on any systemd failure
+ */
+static int start_watch(usb_watch_t *watch)
+{
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) < 0 ||
+        sd_event_default(&watch->event) < 0 ||
+        sd_event_add_signal(watch->event, NULL, SIGINT, stop_watch, watch) < 0 ||
+        sd_event_add_signal(watch->event, NULL, SIGTERM, stop_watch, watch) < 0 ||
+        sd_device_monitor_new(&watch->monitor) < 0 ||
+        sd_device_monitor_filter_add_match_subsystem_devtype(watch->monitor,
+        SEARCH_DEVICE_TYPE, USB_DEVICE_DEVTYPE) < 0 ||
+        sd_device_monitor_attach_event(watch->monitor, watch->event) < 0 ||
+        sd_device_monitor_start(watch->monitor, handle_usb_event, watch) < 0)
+        return EXIT_ERROR;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the hotplug watch CLI flag
+ *
+ * loads the database once, subscribes to hotplug events, classifies the
+ * devices already connected, then sleeps in the event loop and only
+ * classifies each device as it is plugged in; the risk table printed on
+ * exit counts the devices still attached; the monitor is started
+ * before the initial scan so a device plugged meanwhile is not missed;
+ * the metrics file, if any, is written after the initial scan, then
+ * after events at a limited rate, and on exit
+ *
+ * @details int handle_watch_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) when the watch is stopped by a signal
+ *         - 84     (EXIT_ERROR) if the output, the database or the monitor cannot be set up
+ *         - -1     (UNSEEN) if the flag was not given
+ */
+int handle_watch_flag(cli_args_t *cli_args)
+{
+    usb_db_t usb_db = {0};
+    usb_risk_stats_stats_t usb_risk_stats = {0};
+    usb_tools_t usb_tools = {0};
+    usb_device_info_t usb_device_info = {0};
+    usb_output_t output = {0};
+    usb_metrics_t metrics = {0};
+    usb_watch_t watch = {&usb_db, &usb_risk_stats, &output, NULL, NULL, {0}, NULL, {0}};
+    int result = EXIT_ERROR;
+
+    if (check_for_watch_flag(cli_args) == UNSEEN)
+        return UNSEEN;
+    usb_risk_stats.seen.per_port = cli_args->per_port;
+    if (open_usb_output(&output, cli_args->output_path, cli_args->output_format) == EXIT_ERROR) {
+        close_usb_output(&output);
+        return EXIT_ERROR;
+    }
+    if (cli_args->journal)
+        open_usb_journal(&output, true);
+    if (cli_args->metrics_path != NULL)
+        usb_risk_stats.metrics = &metrics;
+    if ((cli_args->metrics_path == NULL ||
+        open_usb_metrics(&metrics, cli_args->metrics_path) == EXIT_SUCCESS) &&
+        load_watch_db(&watch, cli_args) == EXIT_SUCCESS &&
+        start_watch(&watch) == EXIT_SUCCESS &&
+        init_usb_enumerator(&usb_tools, &usb_device_info, cli_args) == EXIT_SUCCESS) {
+        scan_watch_devices(&watch, &usb_tools, &usb_device_info);
+        print_usb_output(&output, USB_RENDER_ANSI, WATCH_STARTED_MESSAGE);
+        flush_usb_output(&output);
+        write_usb_metrics(usb_risk_stats.metrics, &usb_risk_stats);
+        if (sd_event_loop(watch.event) >= 0)
+            result = EXIT_SUCCESS;
+        display_risk_table(&usb_risk_stats, &output);
+        write_usb_metrics(usb_risk_stats.metrics, &usb_risk_stats);
+    } else {
+        dprintf(STDERR_FILENO, WATCH_ERROR_MESSAGE);
+    }
+    close_usb_enumerator(&usb_tools);
+    sd_device_monitor_unref(watch.monitor);
+    sd_event_source_unref(watch.metrics_timer);
+    sd_event_unref(watch.event);
+    free_usb_topology(&watch.topology);
+    free_usb_live_set(&watch.live);
+    free_usb_seen_set(&usb_risk_stats.seen);
+    free_usb_db(&usb_db);
+    close_usb_metrics(&metrics);
+    close_usb_output(&output);
+    return result;
+}
@@ -26,7 +26,8 @@
  * @brief Initializes the usb_tools_t structure to default values
  *
  * sets the internal pointers of the usb_tools_t structure
- * to NULL in preparation for USB enumeration setup
+ * to NULL and selects the systemd backend in preparation
+ * for USB enumeration setup
  * 
  * @details void init_struct_usb_tools(usb_tools_t *usb_tools)
  * @param usb_tools Pointer to the usb_tools_t structure to be initialized
@@ -35,6 +36,12 @@ void init_struct_usb_tools(usb_tools_t *usb_tools)
 {
     usb_tools->device = NULL;
     usb_tools->enumerator = NULL;
+    usb_tools->backend = &systemd_usb_backend;
+    usb_tools->sysfs.devices = NULL;
+    usb_tools->sysfs.name = NULL;
+    usb_tools->device_list = (usb_device_list_t){0};
+    usb_tools->replay.fd = -1;
+    usb_tools->replay.buffer = NULL;
 }
 
 /**
@@ -52,61 +59,82 @@ void init_struct_usb_device_info(usb_device_info_t *usb_device_info)
     usb_device_info->vendor_name = NULL;
     usb_device_info->product_id = NULL;
     usb_device_info->product_name = NULL;
+    usb_device_info->path_usb = NULL;
+    usb_device_info->serial = NULL;
+    usb_device_info->hub_depth = UNSEEN;
 }
 
 /**
- * @brief Initializes the usb_db_t structure with allocated capacity
+ * @brief Initializes the usb_db_t structure to an empty database
  *
- * allocates memory for storing USB database entries and
- * initializes the entry count to zero
+ * sets the columns, the hash index, the mapped text region
+ * and the compiled image to NULL and the entry count to zero
  * 
- * @details int init_struct_usb_db(usb_db_t *usb_db, size_t allocated_capacity)
+ * @details void init_struct_usb_db(usb_db_t *usb_db)
  * @param usb_db Pointer to the usb_db_t structure to initialize
- * @param allocated_capacity Number of usb_db_entry_t elements to allocate
- * @return Exit code:
- *         - 0      (EXIT_SUCCESS) on successful memory allocation
- *         - 84     (EXIT_ERROR) if memory allocation fails
  */
-int init_struct_usb_db(usb_db_t *usb_db, size_t allocated_capacity)
+void init_struct_usb_db(usb_db_t *usb_db)
 {
-    usb_db->entries = malloc(sizeof(usb_db_entry_t) * allocated_capacity);
-    if (usb_db->entries == NULL)
-        return EXIT_ERROR;    
+    usb_db->columns = (usb_db_columns_t){NULL, NULL, NULL, NULL, NULL};
     usb_db->count = 0;
-    return EXIT_SUCCESS;
+    usb_db->index.products = NULL;
+    usb_db->index.mask = 0;
+    usb_db->directory = (usb_db_directory_t){NULL, NULL, 0, 0};
+    usb_db->eytzinger_products = (usb_db_eytzinger_t){NULL, NULL, 0};
+    usb_db->eytzinger_vendors = (usb_db_eytzinger_t){NULL, NULL, 0};
+    usb_db->text = NULL;
+    usb_db->text_size = 0;
+    usb_db->mapping = NULL;
+    usb_db->mapping_size = 0;
+    usb_db->image = NULL;
+    usb_db->image_size = 0;
+    usb_db->embedded = NULL;
+    usb_db->base = NULL;
 }
 
 /**
- * @brief Initializes a temporary usb_db_entry_t structure
+ * @brief Allocates the parallel arrays of count database rows
  *
- * sets all fields of the usb_db_entry_t structure
- * (vendor and product identifiers and names) to NULL
- * before parsing or data assignment
+ * every column is allocated for at least one row, so an empty
+ * database still has valid (unused) arrays
  * 
- * @details void init_struct_usb_db_entry(usb_db_entry_t *usb_db_entry)
- * @param usb_db_entry Pointer to the usb_db_entry_t structure to be initialized
+ * @details int alloc_usb_db_columns(usb_db_columns_t *columns, size_t count)
+ * @param columns Pointer to the usb_db_columns_t structure to allocate
+ * @param count Number of rows
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails (columns are freed)
  */
-void init_struct_usb_db_entry(usb_db_entry_t *usb_db_entry)
+int alloc_usb_db_columns(usb_db_columns_t *columns, size_t count)
 {
-    usb_db_entry->vendor_id = NULL;
-    usb_db_entry->vendor_name = NULL;
-    usb_db_entry->product_id = NULL;
-    usb_db_entry->product_name = NULL;
+    count = count > 0 ? count : 1;
+    columns->vendor_ids = malloc(sizeof(uint16_t) * count);
+    columns->product_ids = malloc(sizeof(uint16_t) * count);
+    columns->id_flags = malloc(sizeof(uint8_t) * count);
+    columns->vendor_names = malloc(sizeof(usb_db_field_t) * count);
+    columns->product_names = malloc(sizeof(usb_db_field_t) * count);
+    if (columns->vendor_ids == NULL || columns->product_ids == NULL ||
+        columns->id_flags == NULL || columns->vendor_names == NULL ||
+        columns->product_names == NULL) {
+        free_usb_db_columns(columns);
+        return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
 }
 
 /**
- * @brief Initializes a usb_db_entry_t structure for unknown USB devices
+ * @brief Initializes a usb_db_names_t structure for unknown USB devices
  *
- * sets vendor and product identifiers to NULL, and assigns default
- * placeholder strings for vendor and product names to indicate an unknown device
+ * assigns the default placeholder string to vendor and product names
+ * to indicate an unknown device (no allocation involved)
  * 
- * @details void init_struct_unknown_usb_db_entry(usb_db_entry_t *unknown)
- * @param unknown Pointer to the usb_db_entry_t structure to be initialized as unknown
+ * @details void init_struct_unknown_usb_db_names(usb_db_names_t *unknown)
+ * @param unknown Pointer to the usb_db_names_t structure to be initialized as unknown
  */
-void init_struct_unknown_usb_db_entry(usb_db_entry_t *unknown)
+void init_struct_unknown_usb_db_names(usb_db_names_t *unknown)
 {
-    unknown->vendor_id = NULL;
-    unknown->vendor_name = strdup(UNKNOWN_DEVICE_MESSAGE);
-    unknown->product_id = NULL;
-    unknown->product_name = strdup(UNKNOWN_DEVICE_MESSAGE);
+    unknown->vendor_name = UNKNOWN_DEVICE_MESSAGE;
+    unknown->vendor_name_length = sizeof(UNKNOWN_DEVICE_MESSAGE) - 1;
+    unknown->product_name = UNKNOWN_DEVICE_MESSAGE;
+    unknown->product_name_length = sizeof(UNKNOWN_DEVICE_MESSAGE) - 1;
 }
@@ -22,27 +22,117 @@
 #include <systemd/sd-device.h>
 #include "druid.h"
 
+/* enumeration backends, indexed by USB_BACKEND_* */
+static const usb_backend_t *const usb_backends[USB_BACKEND_COUNT] = {
+    &systemd_usb_backend,
+    &sysfs_usb_backend,
+    &device_list_usb_backend,
+    &replay_usb_backend
+};
+
 /**
  * @brief Initializes the USB enumerator
  *
  * sets up internal USB tool structures, initializes the USB device info,
- * and prepares the systemd enumerator to target the USB subsystem
+ * and opens the selected backend: the systemd enumerator targeting the
+ * USB subsystem (default), a sysfs tree, a device list file or a
+ * udevadm/lsusb dump
  * 
- * @details int init_usb_enumerator(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info)
+ * @details int init_usb_enumerator(
+ *             usb_tools_t *usb_tools,
+ *             usb_device_info_t *usb_device_info,
+ *             cli_args_t *cli_args)
  * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
  * @param usb_device_info Pointer to the usb_device_info_t structure to be initialized
+ * @param cli_args Pointer to the cli_args_t structure holding the backend and its source
  * @return Exit code:
  *         - 0      (EXIT_SUCCESS) on successful initialization
- *         - 84     (EXIT_ERROR) if the enumerator could not be created
+ *         - 84     (EXIT_ERROR) if the backend could not be opened
  */
-int init_usb_enumerator(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info)
+int init_usb_enumerator(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info,
+    cli_args_t *cli_args)
 {
     init_struct_usb_tools(usb_tools);
     init_struct_usb_device_info(usb_device_info);
-    if (sd_device_enumerator_new(&usb_tools->enumerator) < 0)
-        return EXIT_ERROR;
-    sd_device_enumerator_add_match_subsystem(usb_tools->enumerator, SEARCH_DEVICE_TYPE, 1);
-    usb_tools->device = sd_device_enumerator_get_device_first(
-        usb_tools->enumerator);
-    return EXIT_SUCCESS;
+    if (cli_args->backend >= 0 && cli_args->backend < USB_BACKEND_COUNT)
+        usb_tools->backend = usb_backends[cli_args->backend];
+    return usb_tools->backend->open(usb_tools, cli_args->backend_source);
+}
+
+/**
+ * @brief Reads the current device of the backend into the device info
+ *
+ * @details static int read_usb_device(
+ *             usb_tools_t *usb_tools,
+ *             usb_device_info_t *usb_device_info,
+ *             int status)
+ * @param usb_tools Pointer to the usb_tools_t structure holding the backend
+ * @param usb_device_info Pointer to the usb_device_info_t structure to fill
+ * @param status Result of the move to the current device
+ * @return Exit code:
+ *         - 0      (SUCCESS) if there is a current device
+ *         - -1     (UNSEEN) at the end of the enumeration
+ */
+static int read_usb_device(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info,
+    int status)
+{
+    const usb_backend_t *backend = usb_tools->backend;
+
+    if (status != SUCCESS)
+        return UNSEEN;
+    usb_device_info->vendor_id = backend->get_property(usb_tools, USB_PROPERTY_VENDOR_ID);
+    usb_device_info->vendor_name = backend->get_property(usb_tools, USB_PROPERTY_VENDOR_NAME);
+    usb_device_info->product_id = backend->get_property(usb_tools, USB_PROPERTY_PRODUCT_ID);
+    usb_device_info->product_name = backend->get_property(usb_tools, USB_PROPERTY_PRODUCT_NAME);
+    usb_device_info->serial = backend->get_property(usb_tools, USB_PROPERTY_SERIAL);
+    usb_device_info->path_usb = backend->get_property(usb_tools, USB_PROPERTY_PATH);
+    return SUCCESS;
+}
+
+/**
+ * @brief Restarts the enumeration and reads its first device
+ *
+ * @details int first_usb_device(
+ *             usb_tools_t *usb_tools,
+ *             usb_device_info_t *usb_device_info)
+ * @param usb_tools Pointer to the initialized usb_tools_t structure
+ * @param usb_device_info Pointer to the usb_device_info_t structure to fill
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) if there is no device
+ */
+int first_usb_device(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info)
+{
+    return read_usb_device(usb_tools, usb_device_info,
+        usb_tools->backend->first(usb_tools));
+}
+
+/**
+ * @brief Reads the next device of the enumeration
+ *
+ * @details int next_usb_device(
+ *             usb_tools_t *usb_tools,
+ *             usb_device_info_t *usb_device_info)
+ * @param usb_tools Pointer to the initialized usb_tools_t structure
+ * @param usb_device_info Pointer to the usb_device_info_t structure to fill
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was read
+ *         - -1     (UNSEEN) once every device has been read
+ */
+int next_usb_device(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info)
+{
+    return read_usb_device(usb_tools, usb_device_info,
+        usb_tools->backend->next(usb_tools));
+}
+
+/**
+ * @brief Releases the resources of the enumeration backend
+ *
+ * @details void close_usb_enumerator(usb_tools_t *usb_tools)
+ * @param usb_tools Pointer to the usb_tools_t structure (may be zeroed, never opened)
+ */
+void close_usb_enumerator(usb_tools_t *usb_tools)
+{
+    if (usb_tools->backend != NULL)
+        usb_tools->backend->close(usb_tools);
 }
@@ -0,0 +1,109 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file libdruid.c
+ * @brief public handle API of libdruid.a and libdruid.so
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Opens a database for in-process lookups
+ *
+ * loads and indexes it once, the way druid does: with a NULL path, the
+ * default database (its compiled image when it is up to date); with a
+ * path, that CSV file, parsed on every online CPU
+ *
+ * @details druid_db_t *druid_db_open(const char *path)
+ * @param path CSV database file, or NULL for DATA_FILE_PATH
+ * @return The database handle, or NULL if it cannot be loaded
+ */
+druid_db_t *druid_db_open(const char *path)
+{
+    usb_db_options_t options = {DATA_FILE_PATH, DATA_IMAGE_PATH, NULL, 0, LOOKUP_ENGINE_HASH};
+    druid_db_t *db = calloc(1, sizeof(druid_db_t));
+
+    if (db == NULL)
+        return NULL;
+    if (path != NULL)
+        options = (usb_db_options_t){path, NULL, NULL, 0, LOOKUP_ENGINE_HASH};
+    if (open_usb_db(&db->usb_db, &options) == EXIT_ERROR) {
+        druid_db_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+/**
+ * @brief Classifies a vid/pid pair
+ *
+ * same lookup and names as a druid scan; the database is only read,
+ * so any number of threads may classify with one handle at once
+ *
+ * @details int druid_classify(
+ *             const druid_db_t *db,
+ *             uint16_t vendor_id,
+ *             uint16_t product_id,
+ *             druid_result_t *result)
+ * @param db Database handle
+ * @param vendor_id Vendor id of the device
+ * @param product_id Product id of the device
+ * @param result Receives the match level and the database names
+ * @return Exit code:
+ *         - 0      (SUCCESS) on success
+ *         - -1     (UNSEEN) if the handle or the result is NULL
+ */
+int druid_classify(const druid_db_t *db, uint16_t vendor_id, uint16_t product_id,
+    druid_result_t *result)
+{
+    usb_db_match_t usb_db_match = {NULL, 0};
+    usb_db_names_t usb_db_names = {0};
+
+    if (db == NULL || result == NULL)
+        return UNSEEN;
+    result->match = lookup_usb_db_ids((usb_db_t *)&db->usb_db, vendor_id, product_id,
+        true, &usb_db_match);
+    if (result->match == MATCH_NONE)
+        init_struct_unknown_usb_db_names(&usb_db_names);
+    else
+        decode_usb_db_entry(usb_db_match.usb_db, usb_db_match.row, &usb_db_names);
+    result->vendor_name = usb_db_names.vendor_name;
+    result->vendor_name_length = usb_db_names.vendor_name_length;
+    result->product_name = usb_db_names.product_name;
+    result->product_name_length = usb_db_names.product_name_length;
+    return SUCCESS;
+}
+
+/**
+ * @brief Closes a database handle
+ *
+ * no thread may still be classifying with it; the names returned by
+ * druid_classify are freed with it
+ *
+ * @details void druid_db_close(druid_db_t *db)
+ * @param db Database handle (may be NULL)
+ */
+void druid_db_close(druid_db_t *db)
+{
+    if (db == NULL)
+        return;
+    free_usb_db(&db->usb_db);
+    free(db);
+}
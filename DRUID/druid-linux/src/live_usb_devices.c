@@ -0,0 +1,161 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file live_usb_devices.c
+ * @brief usb devices attached during a watch, with the risk they were given
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Hashes a bus-port path (FNV-1a)
+ *
+ * @details static uint64_t hash_live_path(const char *path)
+ * @param path Null-terminated bus-port path
+ * @return The hash of the path
+ */
+static uint64_t hash_live_path(const char *path)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (; *path != '\0'; ++path) {
+        hash ^= (unsigned char)*path;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the attached device at a bus-port path
+ *
+ * few devices are attached at once, so the entries are searched in order
+ *
+ * @details usb_live_device_t *find_usb_live_device(
+ *             usb_live_set_t *live,
+ *             const char *path)
+ * @param live Pointer to the attached devices
+ * @param path Bus-port path of the device
+ * @return Pointer to the entry, or NULL if no device is attached there
+ */
+usb_live_device_t *find_usb_live_device(usb_live_set_t *live, const char *path)
+{
+    uint64_t path_key = hash_live_path(path);
+
+    for (size_t i = 0; i < live->count; ++i) {
+        if (live->devices[i].path_key == path_key)
+            return &live->devices[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds an attached device with a given seen set key
+ *
+ * @details usb_live_device_t *find_usb_live_seen(
+ *             usb_live_set_t *live,
+ *             uint64_t seen_key)
+ * @param live Pointer to the attached devices
+ * @param seen_key Key of the device in the seen set
+ * @return Pointer to the first such entry, or NULL if none is attached
+ */
+usb_live_device_t *find_usb_live_seen(usb_live_set_t *live, uint64_t seen_key)
+{
+    for (size_t i = 0; i < live->count; ++i) {
+        if (live->devices[i].seen_key == seen_key)
+            return &live->devices[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Records a device attached at a bus-port path
+ *
+ * @details int add_usb_live_device(
+ *             usb_live_set_t *live,
+ *             const char *path,
+ *             uint64_t seen_key,
+ *             int match)
+ * @param live Pointer to the attached devices
+ * @param path Bus-port path of the device, not attached yet
+ * @param seen_key Key of the device in the seen set
+ * @param match Risk the device was given (MATCH_*)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails (the entries are kept)
+ */
+int add_usb_live_device(usb_live_set_t *live, const char *path, uint64_t seen_key,
+    int match)
+{
+    size_t capacity = live->capacity != 0 ? live->capacity * INCREASED_SIZE : SEEN_SET_SIZE;
+    usb_live_device_t *devices = NULL;
+
+    if (live->count == live->capacity) {
+        devices = realloc(live->devices, capacity * sizeof(usb_live_device_t));
+        if (devices == NULL)
+            return EXIT_ERROR;
+        live->devices = devices;
+        live->capacity = capacity;
+    }
+    live->devices[live->count].path_key = hash_live_path(path);
+    live->devices[live->count].seen_key = seen_key;
+    live->devices[live->count].match = match;
+    ++live->count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Removes the device attached at a bus-port path
+ *
+ * @details int take_usb_live_device(
+ *             usb_live_set_t *live,
+ *             const char *path,
+ *             usb_live_device_t *device)
+ * @param live Pointer to the attached devices
+ * @param path Bus-port path of the device
+ * @param device Pointer filled with the removed entry
+ * @return Exit code:
+ *         - 0      (SUCCESS) if a device was attached there
+ *         - -1     (UNSEEN) otherwise
+ */
+int take_usb_live_device(usb_live_set_t *live, const char *path, usb_live_device_t *device)
+{
+    usb_live_device_t *entry = find_usb_live_device(live, path);
+
+    if (entry == NULL)
+        return UNSEEN;
+    *device = *entry;
+    *entry = live->devices[live->count - 1];
+    --live->count;
+    return SUCCESS;
+}
+
+/**
+ * @brief Frees the entries of the attached devices
+ *
+ * @details void free_usb_live_set(usb_live_set_t *live)
+ * @param live Pointer to the attached devices (may never have been filled)
+ */
+void free_usb_live_set(usb_live_set_t *live)
+{
+    free(live->devices);
+    live->devices = NULL;
+    live->count = 0;
+    live->capacity = 0;
+}
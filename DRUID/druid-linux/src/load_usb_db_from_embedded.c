@@ -0,0 +1,152 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file load_usb_db_from_embedded.c
+ * @brief uses the database table compiled into druid-embedded
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Hashes a packed key with a bucket seed
+ *
+ * shared by the generator and the lookup, so both place keys alike;
+ * seed 0 gives the bucket of a key
+ *
+ * @details uint32_t hash_usb_db_mph(uint32_t key, uint32_t seed)
+ * @param key Packed identifier (vid << 16 | pid)
+ * @param seed Bucket seed
+ * @return 32 bit hash
+ */
+uint32_t hash_usb_db_mph(uint32_t key, uint32_t seed)
+{
+    key ^= seed * 0x9e3779b9U;
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return key;
+}
+
+/**
+ * @brief Looks a key up in a minimal perfect hash
+ *
+ * two hashes and one key compare, no probing: every key of the table
+ * owns exactly one slot, any other key is rejected by the compare
+ *
+ * @details uint32_t find_usb_db_mph(const usb_db_mph_t *mph, uint32_t key)
+ * @param mph Pointer to the perfect hash
+ * @param key Packed identifier
+ * @return The database row + 1, or EMPTY_SLOT if the key is absent
+ */
+uint32_t find_usb_db_mph(const usb_db_mph_t *mph, uint32_t key)
+{
+    uint32_t bucket = 0;
+    const usb_db_slot_t *slot = NULL;
+
+    if (mph->bucket_count == 0 || mph->slot_count == 0)
+        return EMPTY_SLOT;
+    bucket = hash_usb_db_mph(key, 0) % mph->bucket_count;
+    slot = &mph->slots[hash_usb_db_mph(key, mph->seeds[bucket]) % mph->slot_count];
+    return slot->key == key ? slot->entry : EMPTY_SLOT;
+}
+
+/**
+ * @brief Tells whether this binary embeds its database
+ *
+ * embedded_usb_db is a weak symbol, only defined when the generated
+ * table is linked in (make druid-embedded)
+ *
+ * @details bool check_embedded_usb_db(void)
+ * @return true for druid-embedded, false for druid
+ */
+bool check_embedded_usb_db(void)
+{
+    return &embedded_usb_db != NULL;
+}
+
+/**
+ * @brief Points a usb_db_t at the embedded table
+ *
+ * nothing is allocated or copied: columns and names stay in the read-only
+ * pages of the binary, shared by every running druid-embedded
+ *
+ * @details static void fill_usb_db_from_embedded(usb_db_t *usb_db)
+ * @param usb_db Pointer to the usb_db_t structure to fill
+ */
+static void fill_usb_db_from_embedded(usb_db_t *usb_db)
+{
+    init_struct_usb_db(usb_db);
+    usb_db->columns.vendor_ids = (uint16_t *)embedded_usb_db.vendor_ids;
+    usb_db->columns.product_ids = (uint16_t *)embedded_usb_db.product_ids;
+    usb_db->columns.id_flags = (uint8_t *)embedded_usb_db.id_flags;
+    usb_db->columns.vendor_names = (usb_db_field_t *)embedded_usb_db.vendor_names;
+    usb_db->columns.product_names = (usb_db_field_t *)embedded_usb_db.product_names;
+    usb_db->count = embedded_usb_db.count;
+    usb_db->text = embedded_usb_db.text;
+    usb_db->text_size = embedded_usb_db.text_size;
+    usb_db->directory.vendors = (usb_db_vendor_t *)embedded_usb_db.directory_vendors;
+    usb_db->directory.products = (usb_db_slot_t *)embedded_usb_db.directory_products;
+    usb_db->directory.vendor_count = embedded_usb_db.vendor_count;
+    usb_db->directory.product_count = embedded_usb_db.product_count;
+    usb_db->embedded = &embedded_usb_db;
+}
+
+/**
+ * @brief Loads the USB database from the embedded table
+ *
+ * @details int load_usb_db_from_embedded(usb_db_t *usb_db)
+ * @param usb_db Pointer to the usb_db_t structure to fill
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the binary embeds a database
+ *         - -1     (UNSEEN) otherwise
+ */
+int load_usb_db_from_embedded(usb_db_t *usb_db)
+{
+    if (!check_embedded_usb_db())
+        return UNSEEN;
+    fill_usb_db_from_embedded(usb_db);
+    return SUCCESS;
+}
+
+/**
+ * @brief Layers a parsed update file on top of the embedded table
+ *
+ * lookups search the update entries first, then the embedded table,
+ * which keeps the precedence of druid where the update file is loaded
+ * before the default database; does nothing in druid
+ *
+ * @details int attach_embedded_usb_db(usb_db_t *usb_db)
+ * @param usb_db Pointer to the usb_db_t structure holding the update entries
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int attach_embedded_usb_db(usb_db_t *usb_db)
+{
+    if (!check_embedded_usb_db())
+        return EXIT_SUCCESS;
+    usb_db->base = malloc(sizeof(usb_db_t));
+    if (usb_db->base == NULL)
+        return EXIT_ERROR;
+    fill_usb_db_from_embedded(usb_db->base);
+    return EXIT_SUCCESS;
+}
@@ -21,208 +21,181 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <systemd/sd-device.h>
 #include "druid.h"
 
 /**
- * @brief Removes the trailing newline character from a string
+ * @brief Checks if the CLI arguments request a database update
  *
- * checks if the last character of the string is a newline
- * and replaces it with a null terminator to clean the string
+ * determines whether the provided arguments contain a valid update flag
+ * followed by a filename
  * 
- * @details static void remove_newline(char *str)
- * @param str Pointer to the null-terminated string to modify
+ * @details static int check_for_update_flag(cli_args_t *cli_args)
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (SUCCESS) if an update file is specified
+ *         - -1     (UNSEEN) otherwise
  */
-static void remove_newline(char *str)
+static int check_for_update_flag(cli_args_t *cli_args)
 {
-    size_t len = strlen(str);
-
-    if (len > 0 && str[len - 1] == '\n')
-        str[len - 1] = '\0';
+    if (cli_args->ac == 3 &&
+        (strcmp(cli_args->av[1], UPDATE_FLAG) == SUCCESS ||
+        strcmp(cli_args->av[1], UPDATE_FLAG_OPTION) == SUCCESS)
+        && cli_args->av[2] != NULL) {
+        return SUCCESS;
+    }
+    return UNSEEN;
 }
 
 /**
- * @brief Parses a CSV line and fills a USB database entry structure
+ * @brief Collects the CSV files to load, update file first
  *
- * splits the input line using the defined separator to extract vendor ID, vendor name,
- * product ID, and product name, then duplicates and assigns these strings
- * to the corresponding fields in the USB database entry
+ * ensures the update file, if any, is a csv file; update entries are
+ * loaded before the default database so they take precedence on lookups
+ * (druid-embedded has no default database file)
  * 
- * @details static void fill_struct_temp_data(
- *             usb_db_entry_t *usb_db_entry,
- *             char *line)
- * @param usb_db_entry Pointer to the usb_db_entry_t structure to fill
- * @param line Input CSV formatted string containing USB device data
+ * @details static int collect_usb_db_sources(
+ *             const usb_db_options_t *options,
+ *             const char **paths,
+ *             size_t *count)
+ * @param options Pointer to the files and settings of the load
+ * @param paths Receives the paths of the files to load, in load order
+ * @param count Receives the number of files to load
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if no update is requested or the update file is valid
+ *         - 84     (EXIT_ERROR) if the update file is not a csv file
  */
-static void fill_struct_temp_data(usb_db_entry_t *usb_db_entry, char *line)
+static int collect_usb_db_sources(const usb_db_options_t *options, const char **paths,
+    size_t *count)
 {
-    char *vendor_id = strtok(line, FILE_SEPARATOR);
-    char *vendor_name = strtok(NULL, FILE_SEPARATOR);
-    char *product_id = strtok(NULL, FILE_SEPARATOR);
-    char *product_name = strtok(NULL, FILE_SEPARATOR);
+    const char *extension = NULL;
 
-    remove_newline(product_name);
-    usb_db_entry->vendor_id = strdup(vendor_id);
-    usb_db_entry->vendor_name = strdup(vendor_name);
-    usb_db_entry->product_id = strdup(product_id);
-    usb_db_entry->product_name = strdup(product_name);
+    *count = 0;
+    if (options->update_path != NULL) {
+        extension = strrchr(options->update_path, FILE_TYPE_SEPARATOR[0]);
+        if (extension == NULL || strcmp(extension, FILE_TYPE_PLUS_SEPARATOR) != SUCCESS) {
+            dprintf(STDERR_FILENO, UNKNOWN_FILE_TYPE_MESSAGE);
+            return EXIT_ERROR;
+        }
+        paths[(*count)++] = options->update_path;
+    }
+    if (!check_embedded_usb_db() && options->data_path != NULL)
+        paths[(*count)++] = options->data_path;
+    return EXIT_SUCCESS;
 }
 
 /**
- * @brief Appends a USB database entry parsed from a single line
+ * @brief Loads USB device data from the local CSV database file
  *
- * checks if the USB database array needs resizing and reallocates if necessary,
- * then initializes and fills a new database entry with parsed data from the line,
- * and increments the entry count
+ * maps the update file (if any) and the USB data file read-only,
+ * parses them on options->jobs workers, recording every field as a view
+ * into the mapping, and finally builds the lookup hash index and the
+ * vendor directory; in
+ * druid-embedded the update entries are layered on the embedded table
  * 
- * @details static int append_usb_entry_from_line(
+ * @details int load_usb_db_from_csv(
  *             usb_db_t *usb_db,
- *             usb_db_entry_t **usb_db_entry,
- *             char *line,
- *             size_t *allocated_capacity)
- * @param usb_db Pointer to the usb_db_t structure holding the database entries
- * @param usb_db_entry Double pointer to a usb_db_entry_t structure to update with new entry
- * @param line String containing the raw database entry line to parse
- * @param allocated_capacity Pointer to the current allocated capacity of the database array
+ *             const usb_db_options_t *options)
+ * @param usb_db Pointer to the usb_db_t structure to populate with entries
+ * @param options Pointer to the files and settings of the load
  * @return Exit code:
- *         - 0      (EXIT_SUCCESS) on successful append
- *         - 84     (EXIT_ERROR) if memory reallocation fails
+ *         - 0      (EXIT_SUCCESS) if the file was successfully loaded
+ *         - 84     (EXIT_ERROR) on failure (file missing, allocation error, etc.)
  */
-static int append_usb_entry_from_line(usb_db_t *usb_db, usb_db_entry_t **usb_db_entry,
-    char *line, size_t *allocated_capacity)
+int load_usb_db_from_csv(usb_db_t *usb_db, const usb_db_options_t *options)
 {
-    if (usb_db->count >= *allocated_capacity) {
-        *allocated_capacity *= INCREASED_SIZE;
-        usb_db->entries = realloc(usb_db->entries, sizeof(usb_db_entry_t) * (*allocated_capacity));
-        if (usb_db->entries == NULL)
-            return EXIT_ERROR;
-    }
-    *usb_db_entry = &usb_db->entries[usb_db->count];
-    init_struct_usb_db_entry(*usb_db_entry);
-    fill_struct_temp_data(*usb_db_entry, line);
-    ++usb_db->count;
-    return EXIT_SUCCESS;
+    const char *paths[MAX_DB_SOURCES] = {0};
+    usb_db_source_t sources[MAX_DB_SOURCES] = {0};
+    size_t source_count = 0;
+
+    init_struct_usb_db(usb_db);
+    if (collect_usb_db_sources(options, paths, &source_count) == EXIT_ERROR ||
+        map_usb_db_sources(usb_db, paths, source_count, sources) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (parse_usb_db_chunks(usb_db, sources, source_count, options->jobs) == EXIT_ERROR ||
+        build_usb_db_index(usb_db) == EXIT_ERROR ||
+        build_usb_db_directory(usb_db) == EXIT_ERROR)
+        return EXIT_ERROR;
+    return attach_embedded_usb_db(usb_db);
 }
 
 /**
- * @brief Loads new USB database entries from an update file
+ * @brief Loads the USB database, preferring the embedded table or the compiled image
  *
- * opens the specified update file, reads its content line by line,
- * and appends each entry to the existing USB database
+ * uses the table built into druid-embedded, or else maps the compiled
+ * database image when one is given, exists and is still in sync with
+ * the CSV file (no parsing at all); falls back to parsing the CSV when
+ * the image is missing or stale, or when an update file is given
  * 
- * @details static int add_new_data(
- *             cli_args_t *cli_args,
+ * @details static int load_usb_db_source(
  *             usb_db_t *usb_db,
- *             usb_db_entry_t *usb_db_entry,
- *             size_t allocated_capacity)
- * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
- * @param usb_db Pointer to the usb_db_t structure to append new entries
- * @param usb_db_entry Pointer to the usb_db_entry_t structure used during parsing
- * @param allocated_capacity Initial allocated size for database entries
+ *             const usb_db_options_t *options)
+ * @param usb_db Pointer to the usb_db_t structure to populate with entries
+ * @param options Pointer to the files and settings of the load
  * @return Exit code:
- *         - 0      (EXIT_SUCCESS) on successful loading and appending
- *         - 84     (EXIT_ERROR) if the file cannot be opened or reading fails
+ *         - 0      (EXIT_SUCCESS) if the database was successfully loaded
+ *         - 84     (EXIT_ERROR) on failure (file missing, allocation error, etc.)
  */
-static int add_new_data(cli_args_t *cli_args, usb_db_t *usb_db,
-    usb_db_entry_t *usb_db_entry, size_t allocated_capacity)
+static int load_usb_db_source(usb_db_t *usb_db, const usb_db_options_t *options)
 {
-    char *line = NULL;
-    size_t n = 0;
-    FILE *update_data_file = fopen(strcat(cli_args->av[2], FILE_TYPE_PLUS_SEPARATOR), READ_MODE);
-
-    if (update_data_file == NULL) {
-        dprintf(STDERR_FILENO, UNKNOWN_FILE_MESSAGE);
-        return EXIT_ERROR;
+    if (options->update_path == NULL) {
+        if (load_usb_db_from_embedded(usb_db) == SUCCESS)
+            return EXIT_SUCCESS;
+        if (options->image_path != NULL && load_usb_db_from_image(usb_db,
+            options->image_path, options->data_path) == SUCCESS)
+            return EXIT_SUCCESS;
     }
-    while (getline(&line, &n, update_data_file) != EOF) {
-        if (append_usb_entry_from_line(usb_db, &usb_db_entry, line, &allocated_capacity) == EXIT_ERROR)
-            return EXIT_ERROR;
-    }
-    fclose(update_data_file);
-    free(line);
-    return EXIT_SUCCESS;
+    return load_usb_db_from_csv(usb_db, options);
 }
 
 /**
- * @brief Checks for a file update request via CLI and loads new data if valid
+ * @brief Loads the USB database and prepares the selected lookup engine
  *
- * verifies if the CLI input requests an update, ensures the file format is correct,
- * and triggers the loading of new USB database entries if applicable
+ * the hash index (or perfect hash) and the vendor directory come with
+ * every source; the Eytzinger trees are only built for the eytzinger
+ * engine; nothing here depends on the command line, so druid and
+ * libdruid load the same way
  * 
- * @details static int check_for_update_file_and_load(
- *             cli_args_t *cli_args,
+ * @details int open_usb_db(
  *             usb_db_t *usb_db,
- *             usb_db_entry_t *usb_db_entry,
- *             size_t allocated_capacity)
- * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
- * @param usb_db Pointer to the usb_db_t structure to append new entries
- * @param usb_db_entry Pointer to the usb_db_entry_t structure used during parsing
- * @param allocated_capacity Initial allocated size for database entries
+ *             const usb_db_options_t *options)
+ * @param usb_db Pointer to the usb_db_t structure to populate with entries
+ * @param options Pointer to the files and settings of the load
  * @return Exit code:
- *         - 0      (EXIT_SUCCESS) if no update is requested or update is successful
- *         - 84     (EXIT_ERROR) if the file is invalid or loading fails
+ *         - 0      (EXIT_SUCCESS) if the database was successfully loaded
+ *         - 84     (EXIT_ERROR) on failure (file missing, allocation error, etc.)
  */
-static int check_for_update_file_and_load(cli_args_t *cli_args, usb_db_t *usb_db,
-    usb_db_entry_t *usb_db_entry, size_t allocated_capacity)
+int open_usb_db(usb_db_t *usb_db, const usb_db_options_t *options)
 {
-    if (cli_args->ac == 3 &&
-        (strcmp(cli_args->av[1], UPDATE_FLAG) == SUCCESS ||
-        strcmp(cli_args->av[1], UPDATE_FLAG_OPTION) == SUCCESS)
-        && cli_args->av[2] != NULL) {
-            strtok(cli_args->av[2], FILE_TYPE_SEPARATOR);
-            if (strcmp(strtok(NULL, FILE_TYPE_SEPARATOR), FILE_TYPE) != SUCCESS) {
-                dprintf(STDERR_FILENO, UNKNOWN_FILE_TYPE_MESSAGE);
-                return EXIT_ERROR;
-            } else {
-                if (add_new_data(cli_args, usb_db,
-                    usb_db_entry, allocated_capacity) == EXIT_ERROR)
-                    return EXIT_ERROR;
-            }
-    } else
-        return EXIT_SUCCESS;
+    if (load_usb_db_source(usb_db, options) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (options->engine == LOOKUP_ENGINE_EYTZINGER)
+        return build_usb_db_eytzinger(usb_db);
     return EXIT_SUCCESS;
 }
 
 /**
- * @brief Loads USB device data from the local database file
+ * @brief Loads the USB database selected on the command line
  *
- * opens the USB data file, initializes the database structure,
- * checks for file updates, and appends entries line by line
+ * the default database and its compiled image, with the --update file
+ * layered on top when given, parsed on --jobs workers for --engine
  * 
  * @details int load_usb_db_from_file(
  *             usb_db_t *usb_db,
- *             usb_db_entry_t *usb_db_entry,
  *             cli_args_t *cli_args)
  * @param usb_db Pointer to the usb_db_t structure to populate with entries
- * @param usb_db_entry Pointer to a usb_db_entry_t structure used during parsing
  * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
  * @return Exit code:
- *         - 0      (EXIT_SUCCESS) if the file was successfully loaded
+ *         - 0      (EXIT_SUCCESS) if the database was successfully loaded
  *         - 84     (EXIT_ERROR) on failure (file missing, allocation error, etc.)
  */
-int load_usb_db_from_file(usb_db_t *usb_db, usb_db_entry_t *usb_db_entry,
-    cli_args_t *cli_args)
+int load_usb_db_from_file(usb_db_t *usb_db, cli_args_t *cli_args)
 {
-    FILE *data_file = fopen(DATA_FILE_PATH, READ_MODE);
-    char *line = NULL;
-    size_t n = 0;
-    size_t allocated_capacity = DEFAULT_SIZE;
+    usb_db_options_t options = {DATA_FILE_PATH, DATA_IMAGE_PATH, NULL,
+        cli_args->jobs, cli_args->engine};
 
-    if (data_file == NULL)
-        return EXIT_ERROR;
-    if (init_struct_usb_db(usb_db, allocated_capacity) == EXIT_ERROR)
-        return EXIT_ERROR;
-    if (check_for_update_file_and_load(cli_args, usb_db, usb_db_entry, allocated_capacity) == EXIT_ERROR) {
-        fclose(data_file);
-        return EXIT_ERROR;
-    }
-    while (getline(&line, &n, data_file) != EOF) {
-        if (append_usb_entry_from_line(usb_db, &usb_db_entry, line, &allocated_capacity) == EXIT_ERROR) {
-            fclose(data_file);
-            return EXIT_ERROR;
-        }
-    }
-    free(line);
-    fclose(data_file);
-    return EXIT_SUCCESS;
+    if (check_for_update_flag(cli_args) == SUCCESS)
+        options.update_path = cli_args->av[2];
+    return open_usb_db(usb_db, &options);
 }
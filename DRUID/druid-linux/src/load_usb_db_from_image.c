@@ -0,0 +1,311 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file load_usb_db_from_image.c
+ * @brief maps the compiled usb database image
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Computes the FNV-1a checksum of a whole file
+ *
+ * maps the file read-only and hashes every byte, used to detect
+ * CSV edits that did not change the modification time (or the reverse)
+ *
+ * @details uint64_t checksum_usb_db_file(const char *path)
+ * @param path Path of the file to hash
+ * @return The 64 bit checksum, or 0 if the file cannot be read
+ */
+uint64_t checksum_usb_db_file(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st = {0};
+    unsigned char *data = NULL;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+    for (off_t i = 0; i < st.st_size; ++i) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    munmap(data, st.st_size);
+    return hash;
+}
+
+/**
+ * @brief Checks whether a compiled image still matches its CSV source
+ *
+ * the image is fresh when the CSV modification time and size are those
+ * recorded at compile time; if only the time changed (file touched or
+ * copied), the checksum decides
+ *
+ * @details int check_usb_db_image_fresh(
+ *             const usb_db_image_header_t *header,
+ *             const char *csv_path)
+ * @param header Pointer to the image header
+ * @param csv_path Path of the CSV source database
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the image is in sync with the CSV
+ *         - -1     (UNSEEN) if the image is stale or the CSV is missing
+ */
+int check_usb_db_image_fresh(const usb_db_image_header_t *header,
+    const char *csv_path)
+{
+    struct stat st = {0};
+
+    if (stat(csv_path, &st) < 0)
+        return UNSEEN;
+    if ((uint64_t)st.st_size != header->csv_size)
+        return UNSEEN;
+    if (st.st_mtim.tv_sec == header->csv_mtime_sec &&
+        st.st_mtim.tv_nsec == header->csv_mtime_nsec)
+        return SUCCESS;
+    if (checksum_usb_db_file(csv_path) == header->csv_checksum)
+        return SUCCESS;
+    return UNSEEN;
+}
+
+/**
+ * @brief Checks that an image section lies inside the mapping
+ *
+ * @details static bool check_image_section(
+ *             size_t image_size,
+ *             uint64_t offset,
+ *             uint64_t count,
+ *             size_t element_size)
+ * @param image_size Total size of the mapping
+ * @param offset Section offset from the start of the image
+ * @param count Number of elements in the section
+ * @param element_size Size of one element
+ * @return true if the whole section is readable, false otherwise
+ */
+static bool check_image_section(size_t image_size, uint64_t offset,
+    uint64_t count, size_t element_size)
+{
+    if (offset % DB_IMAGE_ALIGNMENT != 0 || offset > image_size)
+        return false;
+    return count <= (image_size - offset) / element_size;
+}
+
+/**
+ * @brief Checks the contents of the hash index of an image
+ *
+ * the index must keep at least INDEX_LOAD_FACTOR slots per used slot,
+ * as build_usb_db_index does, so that every probe meets an empty slot,
+ * and each used slot must point to a database row
+ *
+ * @details static bool check_image_index(
+ *             const usb_db_image_header_t *header,
+ *             const usb_db_slot_t *slots)
+ * @param header Pointer to the mapped header
+ * @param slots First slot of the index
+ * @return true if the index is usable, false otherwise
+ */
+static bool check_image_index(const usb_db_image_header_t *header,
+    const usb_db_slot_t *slots)
+{
+    uint64_t used = 0;
+
+    if (header->index_slots / INDEX_LOAD_FACTOR < header->count)
+        return false;
+    for (uint64_t i = 0; i < header->index_slots; ++i) {
+        if (slots[i].entry == EMPTY_SLOT)
+            continue;
+        if (slots[i].entry > header->count)
+            return false;
+        ++used;
+    }
+    return used <= header->index_slots / INDEX_LOAD_FACTOR;
+}
+
+/**
+ * @brief Checks the contents of the vendor directory of an image
+ *
+ * vendor spans must follow each other inside the products, the sentinel
+ * closing the last one, and every vendor or product must point to a
+ * database row
+ *
+ * @details static bool check_image_directory(
+ *             const usb_db_image_header_t *header,
+ *             const usb_db_vendor_t *vendors,
+ *             const usb_db_slot_t *products)
+ * @param header Pointer to the mapped header
+ * @param vendors First vendor of the directory
+ * @param products First product of the directory
+ * @return true if the directory is usable, false otherwise
+ */
+static bool check_image_directory(const usb_db_image_header_t *header,
+    const usb_db_vendor_t *vendors, const usb_db_slot_t *products)
+{
+    if (header->product_count > header->count || vendors[0].start != 0 ||
+        vendors[header->vendor_count].start != header->product_count)
+        return false;
+    for (uint64_t i = 0; i < header->vendor_count; ++i) {
+        if (vendors[i].entry == EMPTY_SLOT || vendors[i].entry > header->count ||
+            vendors[i].start > vendors[i + 1].start)
+            return false;
+    }
+    for (uint64_t i = 0; i < header->product_count; ++i) {
+        if (products[i].entry == EMPTY_SLOT || products[i].entry > header->count)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Validates the header of a mapped image
+ *
+ * checks magic, version, that every section is in bounds and properly
+ * aligned, then that the index and the directory only lead to database
+ * rows, so a truncated, corrupted or foreign file is never trusted
+ *
+ * @details static bool check_image_header(
+ *             const usb_db_image_header_t *header,
+ *             size_t image_size)
+ * @param header Pointer to the mapped header
+ * @param image_size Total size of the mapping
+ * @return true if the header is usable, false otherwise
+ */
+static bool check_image_header(const usb_db_image_header_t *header, size_t image_size)
+{
+    const char *image = (const char *)header;
+
+    if (memcmp(header->magic, DB_IMAGE_MAGIC, DB_IMAGE_MAGIC_SIZE) != SUCCESS ||
+        header->version != DB_IMAGE_VERSION || header->index_slots == 0 ||
+        (header->index_slots & (header->index_slots - 1)) != 0 ||
+        header->vendor_count > USB_ID_COUNT)
+        return false;
+    if (!check_image_section(image_size, header->vendor_ids_offset, header->count, sizeof(uint16_t)) ||
+        !check_image_section(image_size, header->product_ids_offset, header->count, sizeof(uint16_t)) ||
+        !check_image_section(image_size, header->id_flags_offset, header->count, sizeof(uint8_t)) ||
+        !check_image_section(image_size, header->vendor_names_offset, header->count, sizeof(usb_db_field_t)) ||
+        !check_image_section(image_size, header->product_names_offset, header->count, sizeof(usb_db_field_t)) ||
+        !check_image_section(image_size, header->products_offset, header->index_slots, sizeof(usb_db_slot_t)) ||
+        !check_image_section(image_size, header->directory_vendors_offset,
+            header->vendor_count + 1, sizeof(usb_db_vendor_t)) ||
+        !check_image_section(image_size, header->directory_products_offset,
+            header->product_count, sizeof(usb_db_slot_t)) ||
+        !check_image_section(image_size, header->strings_offset, header->strings_size, sizeof(char)))
+        return false;
+    return check_image_index(header, (const usb_db_slot_t *)(image + header->products_offset)) &&
+        check_image_directory(header,
+            (const usb_db_vendor_t *)(image + header->directory_vendors_offset),
+            (const usb_db_slot_t *)(image + header->directory_products_offset));
+}
+
+/**
+ * @brief Maps an image file and validates it against its CSV source
+ *
+ * @details static usb_db_image_header_t *map_image(
+ *             const char *image_path,
+ *             const char *csv_path,
+ *             size_t *image_size)
+ * @param image_path Path of the compiled image
+ * @param csv_path Path of the CSV source database
+ * @param image_size Receives the size of the mapping
+ * @return The mapped header, or NULL if the image is missing, invalid or stale
+ */
+static usb_db_image_header_t *map_image(const char *image_path,
+    const char *csv_path, size_t *image_size)
+{
+    int fd = open(image_path, O_RDONLY);
+    struct stat st = {0};
+    usb_db_image_header_t *header = NULL;
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(usb_db_image_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+        return NULL;
+    if (!check_image_header(header, st.st_size) ||
+        check_usb_db_image_fresh(header, csv_path) != SUCCESS) {
+        munmap(header, st.st_size);
+        return NULL;
+    }
+    *image_size = st.st_size;
+    return header;
+}
+
+/**
+ * @brief Loads the USB database from a compiled image with a single mmap
+ *
+ * the image is shared between concurrent druid processes and used in
+ * place: columns, hash index, vendor directory and names all point into
+ * the mapping, nothing is parsed or copied (views are bounds-checked
+ * when decoded)
+ *
+ * @details int load_usb_db_from_image(
+ *             usb_db_t *usb_db,
+ *             const char *image_path,
+ *             const char *csv_path)
+ * @param usb_db Pointer to the usb_db_t structure to populate
+ * @param image_path Path of the compiled image
+ * @param csv_path Path of the CSV source the image was compiled from
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the image was loaded
+ *         - -1     (UNSEEN) if the image is missing, invalid or stale
+ */
+int load_usb_db_from_image(usb_db_t *usb_db, const char *image_path,
+    const char *csv_path)
+{
+    size_t image_size = 0;
+    char *image = (char *)map_image(image_path, csv_path, &image_size);
+    usb_db_image_header_t *header = (usb_db_image_header_t *)image;
+
+    if (image == NULL)
+        return UNSEEN;
+    init_struct_usb_db(usb_db);
+    usb_db->columns.vendor_ids = (uint16_t *)(image + header->vendor_ids_offset);
+    usb_db->columns.product_ids = (uint16_t *)(image + header->product_ids_offset);
+    usb_db->columns.id_flags = (uint8_t *)(image + header->id_flags_offset);
+    usb_db->columns.vendor_names = (usb_db_field_t *)(image + header->vendor_names_offset);
+    usb_db->columns.product_names = (usb_db_field_t *)(image + header->product_names_offset);
+    usb_db->count = header->count;
+    usb_db->index.products = (usb_db_slot_t *)(image + header->products_offset);
+    usb_db->index.mask = header->index_slots - 1;
+    usb_db->directory.vendors = (usb_db_vendor_t *)(image + header->directory_vendors_offset);
+    usb_db->directory.products = (usb_db_slot_t *)(image + header->directory_products_offset);
+    usb_db->directory.vendor_count = header->vendor_count;
+    usb_db->directory.product_count = header->product_count;
+    usb_db->text = image + header->strings_offset;
+    usb_db->text_size = header->strings_size;
+    usb_db->image = image;
+    usb_db->image_size = image_size;
+    return SUCCESS;
+}
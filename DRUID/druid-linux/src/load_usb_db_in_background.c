@@ -0,0 +1,102 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file load_usb_db_in_background.c
+ * @brief loads the usb database on a background thread while devices are enumerated
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Loader thread: loads the database, then publishes the result
+ *
+ * the release store orders every write of the load before the flag, so
+ * a thread seeing the flag set sees the whole index (and the duration
+ * of the load)
+ *
+ * @details static void *load_usb_db_worker(void *arg)
+ * @param arg Pointer to the usb_db_loader_t
+ * @return NULL
+ */
+static void *load_usb_db_worker(void *arg)
+{
+    usb_db_loader_t *loader = arg;
+    double start = get_usb_metrics_clock();
+
+    loader->status = load_usb_db_from_file(loader->usb_db, loader->cli_args);
+    loader->seconds = get_usb_metrics_clock() - start;
+    __atomic_store_n(&loader->published, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Starts loading the database in the background
+ *
+ * if the thread cannot be started the database is loaded right away, so
+ * the caller only loses the overlap
+ *
+ * @details int start_usb_db_loader(usb_db_loader_t *loader)
+ * @param loader Pointer to the loader holding the database and the CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) once the load is started (or done)
+ *         - 84     (EXIT_ERROR) if the synchronous fallback load fails
+ */
+int start_usb_db_loader(usb_db_loader_t *loader)
+{
+    loader->published = false;
+    loader->status = EXIT_ERROR;
+    loader->started = pthread_create(&loader->thread, NULL,
+        load_usb_db_worker, loader) == SUCCESS;
+    if (!loader->started)
+        load_usb_db_worker(loader);
+    return loader->started ? EXIT_SUCCESS : loader->status;
+}
+
+/**
+ * @brief Tells, without waiting, whether the database can be used
+ *
+ * @details bool check_usb_db_loader(usb_db_loader_t *loader)
+ * @param loader Pointer to the started loader
+ * @return true if the database is loaded and indexed, false while it is
+ *         loading or if its load failed
+ */
+bool check_usb_db_loader(usb_db_loader_t *loader)
+{
+    return __atomic_load_n(&loader->published, __ATOMIC_ACQUIRE) &&
+        loader->status == EXIT_SUCCESS;
+}
+
+/**
+ * @brief Waits for the end of the load
+ *
+ * @details int wait_usb_db_loader(usb_db_loader_t *loader)
+ * @param loader Pointer to the started loader
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the database is loaded
+ *         - 84     (EXIT_ERROR) if its load failed
+ */
+int wait_usb_db_loader(usb_db_loader_t *loader)
+{
+    if (loader->started) {
+        pthread_join(loader->thread, NULL);
+        loader->started = false;
+    }
+    return loader->status;
+}
@@ -39,20 +39,50 @@ int main(int ac, char **av)
 {
     usb_device_info_t usb_device_info = {0};
     usb_tools_t usb_tools = {0};
-    usb_db_entry_t usb_db_entry = {0};
-    cli_args_t cli_args = {ac, av};
-    int cli_flags_result = handle_cli_info_flags(ac, av);
+    cli_args_t cli_args = {ac, av, 0, LOOKUP_ENGINE_HASH, USB_BACKEND_SYSTEMD, NULL, false,
+        USB_FORMAT_TEXT, false, NULL, NULL};
+    int cli_flags_result = UNSEEN;
 
+    if (handle_jobs_flag(&cli_args) == EXIT_ERROR ||
+        handle_engine_flag(&cli_args) == EXIT_ERROR ||
+        handle_backend_flag(&cli_args) == EXIT_ERROR ||
+        handle_per_port_flag(&cli_args) == EXIT_ERROR ||
+        handle_format_output_flag(&cli_args) == EXIT_ERROR ||
+        handle_output_flag(&cli_args) == EXIT_ERROR ||
+        handle_journal_flag(&cli_args) == EXIT_ERROR ||
+        handle_metrics_file_flag(&cli_args) == EXIT_ERROR)
+        return EXIT_ERROR;
+    cli_flags_result = handle_cli_info_flags(cli_args.ac, cli_args.av);
     if (cli_flags_result == EXIT_SUCCESS)
         return EXIT_SUCCESS;
     else if (cli_flags_result == EXIT_ERROR)
         return EXIT_ERROR;
-    if (init_usb_enumerator(&usb_tools, &usb_device_info) == EXIT_ERROR)
+    cli_flags_result = handle_compile_db_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    cli_flags_result = handle_vendor_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    cli_flags_result = handle_watch_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    cli_flags_result = handle_fleet_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    cli_flags_result = handle_query_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    cli_flags_result = handle_read_report_flag(&cli_args);
+    if (cli_flags_result != UNSEEN)
+        return cli_flags_result;
+    if (init_usb_enumerator(&usb_tools, &usb_device_info, &cli_args) == EXIT_ERROR) {
+        close_usb_enumerator(&usb_tools);
         return EXIT_ERROR;
-    if (scan_connected_usb_and_check_risks(&usb_tools, &usb_device_info, &usb_db_entry, &cli_args) == EXIT_ERROR) {
-        sd_device_enumerator_unref(usb_tools.enumerator);
+    }
+    if (scan_connected_usb_and_check_risks(&usb_tools, &usb_device_info, &cli_args) == EXIT_ERROR) {
+        close_usb_enumerator(&usb_tools);
         return EXIT_ERROR;
     }
-    sd_device_enumerator_unref(usb_tools.enumerator);
+    close_usb_enumerator(&usb_tools);
     return EXIT_SUCCESS;
 }
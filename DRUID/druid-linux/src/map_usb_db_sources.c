@@ -0,0 +1,141 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file map_usb_db_sources.c
+ * @brief maps the CSV database files into one read-only text region
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Rounds a size up to a whole number of pages
+ *
+ * @details static size_t round_to_pages(size_t size, size_t page_size)
+ * @param size Size in bytes
+ * @param page_size System page size
+ * @return The rounded size
+ */
+static size_t round_to_pages(size_t size, size_t page_size)
+{
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+/**
+ * @brief Opens every source file and lays them out in the region
+ *
+ * each file starts on a page boundary so it can be mapped in place;
+ * the layout must fit 32 bit field offsets
+ *
+ * @details static int open_sources(
+ *             const char **paths,
+ *             size_t count,
+ *             int *fds,
+ *             usb_db_source_t *sources,
+ *             size_t *region_size)
+ * @param paths Paths of the files, in load order
+ * @param count Number of files
+ * @param fds Receives the opened file descriptors
+ * @param sources Receives the position and size of each file
+ * @param region_size Receives the total size of the region
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if a file cannot be opened or is too large
+ */
+static int open_sources(const char **paths, size_t count, int *fds,
+    usb_db_source_t *sources, size_t *region_size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    struct stat st = {0};
+
+    *region_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        fds[i] = open(paths[i], O_RDONLY);
+        if (fds[i] < 0 || fstat(fds[i], &st) < 0) {
+            dprintf(STDERR_FILENO, UNKNOWN_FILE_MESSAGE);
+            return EXIT_ERROR;
+        }
+        sources[i].offset = *region_size;
+        sources[i].size = st.st_size;
+        *region_size += round_to_pages(st.st_size, page_size);
+    }
+    if (*region_size > UINT32_MAX) {
+        dprintf(STDERR_FILENO, DATABASE_TOO_LARGE_MESSAGE);
+        return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Maps the CSV source files into one contiguous read-only region
+ *
+ * reserves the address range once, then maps every file in place
+ * (MAP_FIXED) at its page-aligned offset: nothing is copied, and a single
+ * base pointer plus 32 bit offsets addresses every field of every file
+ *
+ * @details int map_usb_db_sources(
+ *             usb_db_t *usb_db,
+ *             const char **paths,
+ *             size_t count,
+ *             usb_db_source_t *sources)
+ * @param usb_db Pointer to the usb_db_t structure receiving the region
+ * @param paths Paths of the files, in load order
+ * @param count Number of files (at most MAX_DB_SOURCES)
+ * @param sources Receives the position and size of each file in the region
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if a file cannot be opened or mapped
+ */
+int map_usb_db_sources(usb_db_t *usb_db, const char **paths,
+    size_t count, usb_db_source_t *sources)
+{
+    int fds[MAX_DB_SOURCES] = {-1, -1};
+    size_t region_size = 0;
+    char *region = MAP_FAILED;
+    int result = EXIT_ERROR;
+
+    if (count > MAX_DB_SOURCES)
+        return EXIT_ERROR;
+    result = open_sources(paths, count, fds, sources, &region_size);
+    if (result == EXIT_SUCCESS && region_size > 0)
+        region = mmap(NULL, region_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == EXIT_SUCCESS && region_size > 0 && region == MAP_FAILED)
+        result = EXIT_ERROR;
+    for (size_t i = 0; result == EXIT_SUCCESS && i < count; ++i) {
+        if (sources[i].size > 0 && mmap(region + sources[i].offset, sources[i].size,
+            PROT_READ, MAP_PRIVATE | MAP_FIXED, fds[i], 0) == MAP_FAILED)
+            result = EXIT_ERROR;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    if (result == EXIT_ERROR) {
+        if (region != MAP_FAILED)
+            munmap(region, region_size);
+        return EXIT_ERROR;
+    }
+    usb_db->mapping = region == MAP_FAILED ? NULL : region;
+    usb_db->mapping_size = region_size;
+    usb_db->text = usb_db->mapping;
+    usb_db->text_size = region_size;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file pack_usb_db_names.c
+ * @brief packs the database names into a compact string blob
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Appends a name to the blob and records its view
+ *
+ * identical consecutive names (the vendor name repeated on every
+ * product row) are stored once by reusing the previous view
+ *
+ * @details static int append_name(
+ *             usb_db_blob_t *blob,
+ *             const char *str,
+ *             const usb_db_field_t *previous,
+ *             usb_db_field_t *field)
+ * @param blob Pointer to the string blob being built
+ * @param str First character of the name in the database text
+ * @param previous View of the same column on the previous row, or NULL
+ * @param field In: view in the database text, out: view in the blob
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int append_name(usb_db_blob_t *blob, const char *str,
+    const usb_db_field_t *previous, usb_db_field_t *field)
+{
+    size_t capacity = blob->capacity;
+    char *data = NULL;
+
+    if (previous != NULL && previous->length == field->length &&
+        memcmp(blob->data + previous->offset, str, field->length) == SUCCESS) {
+        field->offset = previous->offset;
+        return EXIT_SUCCESS;
+    }
+    while (blob->size + field->length > capacity)
+        capacity = capacity > 0 ? capacity * INCREASED_SIZE : DEFAULT_SIZE;
+    if (capacity != blob->capacity) {
+        data = realloc(blob->data, capacity);
+        if (data == NULL)
+            return EXIT_ERROR;
+        blob->data = data;
+        blob->capacity = capacity;
+    }
+    memcpy(blob->data + blob->size, str, field->length);
+    field->offset = (uint32_t)blob->size;
+    blob->size += field->length;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies every vendor and product name of a database into a blob
+ *
+ * the blob only holds names (ids are already numeric columns), so it is
+ * much smaller than the CSV text; the views written to vendor_names and
+ * product_names point into the blob
+ *
+ * @details int pack_usb_db_names(
+ *             usb_db_t *usb_db,
+ *             usb_db_field_t *vendor_names,
+ *             usb_db_field_t *product_names,
+ *             usb_db_blob_t *blob)
+ * @param usb_db Pointer to the loaded database
+ * @param vendor_names Receives count vendor name views into the blob
+ * @param product_names Receives count product name views into the blob
+ * @param blob Pointer to the blob to fill (freed by the caller)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int pack_usb_db_names(usb_db_t *usb_db, usb_db_field_t *vendor_names,
+    usb_db_field_t *product_names, usb_db_blob_t *blob)
+{
+    usb_db_columns_t *columns = &usb_db->columns;
+
+    for (size_t i = 0; i < usb_db->count; ++i) {
+        vendor_names[i] = columns->vendor_names[i];
+        product_names[i] = columns->product_names[i];
+        if (append_name(blob, usb_db->text + columns->vendor_names[i].offset,
+            i > 0 ? &vendor_names[i - 1] : NULL, &vendor_names[i]) == EXIT_ERROR ||
+            append_name(blob, usb_db->text + columns->product_names[i].offset,
+            i > 0 ? &product_names[i - 1] : NULL, &product_names[i]) == EXIT_ERROR)
+            return EXIT_ERROR;
+    }
+    return EXIT_SUCCESS;
+}
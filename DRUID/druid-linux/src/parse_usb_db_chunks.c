@@ -0,0 +1,340 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file parse_usb_db_chunks.c
+ * @brief parses the mapped csv files in newline-aligned chunks on a worker pool
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Counts the lines of one chunk
+ *
+ * one vectorised pass (popcount of the newline masks) gives an upper
+ * bound of the entries, so the chunk is allocated once at its final size
+ *
+ * @details static size_t count_chunk_lines(
+ *             usb_db_ingest_t *ingest,
+ *             usb_db_chunk_t *chunk)
+ * @param ingest Pointer to the shared ingest state
+ * @param chunk Chunk to count
+ * @return Upper bound of the number of entries in the chunk
+ */
+static size_t count_chunk_lines(usb_db_ingest_t *ingest, usb_db_chunk_t *chunk)
+{
+    const char *end = ingest->text + chunk->end;
+    size_t lines = 1;
+
+    for (const char *pos = ingest->text + chunk->start; pos < end; pos += SCAN_BLOCK_SIZE)
+        lines += __builtin_popcountll(scan_usb_db_block(ingest->scan_block, pos, end).lines);
+    return lines;
+}
+
+/**
+ * @brief Closes the current field at a separator
+ *
+ * records the field as an (offset, length) view into the mapping;
+ * separators after the fourth field are part of nothing and ignored
+ *
+ * @details static void close_field(usb_db_parser_t *parser, size_t stop)
+ * @param parser Pointer to the parser state
+ * @param stop Offset of the separator ending the field
+ */
+static void close_field(usb_db_parser_t *parser, size_t stop)
+{
+    if (parser->field < FIELDS_PER_LINE) {
+        parser->fields[parser->field].offset = parser->field_start;
+        parser->fields[parser->field].length = stop - parser->field_start;
+        ++parser->field;
+    }
+    parser->field_start = stop + 1;
+}
+
+/**
+ * @brief Stores one CSV line in the chunk columns
+ *
+ * closes the last field of the line [line_start, stop), leaves missing
+ * fields empty, parses the vendor and product IDs to integers (flagging
+ * the ones that are not hexadecimal) and keeps the names as views into
+ * the mapping; empty lines are skipped
+ *
+ * @details static void fill_struct_temp_data(
+ *             usb_db_ingest_t *ingest,
+ *             usb_db_chunk_t *chunk,
+ *             usb_db_parser_t *parser,
+ *             size_t stop)
+ * @param ingest Pointer to the shared ingest state
+ * @param chunk Chunk receiving the row
+ * @param parser Pointer to the parser state
+ * @param stop Offset of the newline (or end of chunk) ending the line
+ */
+static void fill_struct_temp_data(usb_db_ingest_t *ingest, usb_db_chunk_t *chunk,
+    usb_db_parser_t *parser, size_t stop)
+{
+    usb_db_columns_t *columns = &chunk->columns;
+    size_t row = chunk->count;
+
+    if (stop > parser->line_start) {
+        close_field(parser, stop);
+        for (; parser->field < FIELDS_PER_LINE; ++parser->field)
+            parser->fields[parser->field] = (usb_db_field_t){stop, 0};
+        columns->id_flags[row] = 0;
+        columns->vendor_ids[row] = 0;
+        columns->product_ids[row] = 0;
+        if (parse_usb_id_field(ingest->text + parser->fields[0].offset,
+            parser->fields[0].length, &columns->vendor_ids[row]) == SUCCESS)
+            columns->id_flags[row] |= ID_FLAG_VENDOR;
+        if (parse_usb_id_field(ingest->text + parser->fields[2].offset,
+            parser->fields[2].length, &columns->product_ids[row]) == SUCCESS)
+            columns->id_flags[row] |= ID_FLAG_PRODUCT;
+        columns->vendor_names[row] = parser->fields[1];
+        columns->product_names[row] = parser->fields[3];
+        ++chunk->count;
+    }
+    parser->line_start = stop + 1;
+    parser->field_start = stop + 1;
+    parser->field = 0;
+}
+
+/**
+ * @brief Parses one chunk into its own columns
+ *
+ * scans the chunk SCAN_BLOCK_SIZE bytes at a time and walks the set bits
+ * of the separator masks; chunks never share a line, so workers need
+ * no locking
+ *
+ * @details static void parse_chunk(
+ *             usb_db_ingest_t *ingest,
+ *             usb_db_chunk_t *chunk)
+ * @param ingest Pointer to the shared ingest state
+ * @param chunk Chunk to parse
+ */
+static void parse_chunk(usb_db_ingest_t *ingest, usb_db_chunk_t *chunk)
+{
+    usb_db_parser_t parser = {chunk->start, chunk->start, 0, {{0, 0}}};
+    usb_db_delimiters_t delimiters = {0, 0};
+    uint64_t mask = 0;
+    size_t bit = 0;
+
+    if (alloc_usb_db_columns(&chunk->columns, count_chunk_lines(ingest, chunk)) == EXIT_ERROR) {
+        chunk->status = EXIT_ERROR;
+        return;
+    }
+    for (size_t pos = chunk->start; pos < chunk->end; pos += SCAN_BLOCK_SIZE) {
+        delimiters = scan_usb_db_block(ingest->scan_block, ingest->text + pos,
+            ingest->text + chunk->end);
+        for (mask = delimiters.fields | delimiters.lines; mask != 0; mask &= mask - 1) {
+            bit = __builtin_ctzll(mask);
+            if (delimiters.lines & ((uint64_t)1 << bit))
+                fill_struct_temp_data(ingest, chunk, &parser, pos + bit);
+            else
+                close_field(&parser, pos + bit);
+        }
+    }
+    fill_struct_temp_data(ingest, chunk, &parser, chunk->end);
+}
+
+/**
+ * @brief Worker loop: parses chunks until none is left
+ *
+ * @details static void *parse_chunks_worker(void *arg)
+ * @param arg Pointer to the shared usb_db_ingest_t
+ * @return NULL
+ */
+static void *parse_chunks_worker(void *arg)
+{
+    usb_db_ingest_t *ingest = arg;
+    size_t i = 0;
+
+    while ((i = __atomic_fetch_add(&ingest->next_chunk, 1, __ATOMIC_RELAXED))
+        < ingest->chunk_count)
+        parse_chunk(ingest, &ingest->chunks[i]);
+    return NULL;
+}
+
+/**
+ * @brief Splits the mapped files into newline-aligned chunks, in file order
+ *
+ * every file is cut into at most jobs pieces of at least MIN_CHUNK_SIZE
+ * bytes; each cut is moved forward to just after the next newline
+ *
+ * @details static void plan_chunks(
+ *             usb_db_ingest_t *ingest,
+ *             usb_db_source_t *sources,
+ *             size_t source_count,
+ *             size_t jobs)
+ * @param ingest Pointer to the ingest state receiving the chunks
+ * @param sources Position and size of each mapped file
+ * @param source_count Number of mapped files
+ * @param jobs Number of workers
+ */
+static void plan_chunks(usb_db_ingest_t *ingest, usb_db_source_t *sources,
+    size_t source_count, size_t jobs)
+{
+    size_t pieces = 0;
+    size_t start = 0;
+    size_t end = 0;
+    size_t cut = 0;
+    const char *newline = NULL;
+
+    for (size_t i = 0; i < source_count; ++i) {
+        pieces = sources[i].size / MIN_CHUNK_SIZE;
+        pieces = pieces < 1 ? 1 : (pieces > jobs ? jobs : pieces);
+        start = sources[i].offset;
+        end = sources[i].offset + sources[i].size;
+        for (size_t p = 1; p <= pieces && start < end; ++p) {
+            cut = p == pieces ? end : sources[i].offset + sources[i].size / pieces * p;
+            cut = cut < start ? start : cut;
+            if (cut < end) {
+                newline = memchr(ingest->text + cut, LINE_SEPARATOR, end - cut);
+                cut = newline != NULL ? (size_t)(newline - ingest->text) + 1 : end;
+            }
+            ingest->chunks[ingest->chunk_count++] = (usb_db_chunk_t){start, cut,
+                {NULL, NULL, NULL, NULL, NULL}, 0, EXIT_SUCCESS};
+            start = cut;
+        }
+    }
+}
+
+/**
+ * @brief Runs the worker pool over every chunk
+ *
+ * the calling thread works too; if a thread cannot be started the
+ * remaining workers simply take more chunks
+ *
+ * @details static void run_chunk_workers(usb_db_ingest_t *ingest, size_t jobs)
+ * @param ingest Pointer to the planned ingest state
+ * @param jobs Number of workers
+ */
+static void run_chunk_workers(usb_db_ingest_t *ingest, size_t jobs)
+{
+    pthread_t threads[MAX_JOBS] = {0};
+    size_t started = 0;
+
+    if (jobs > ingest->chunk_count)
+        jobs = ingest->chunk_count;
+    for (size_t i = 1; i < jobs; ++i) {
+        if (pthread_create(&threads[started], NULL, parse_chunks_worker, ingest) == SUCCESS)
+            ++started;
+    }
+    parse_chunks_worker(ingest);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+}
+
+/**
+ * @brief Appends the rows of one chunk to the database columns
+ *
+ * @details static void append_chunk_columns(
+ *             usb_db_columns_t *columns,
+ *             size_t row,
+ *             usb_db_chunk_t *chunk)
+ * @param columns Columns of the database
+ * @param row First free row of the database
+ * @param chunk Parsed chunk
+ */
+static void append_chunk_columns(usb_db_columns_t *columns, size_t row,
+    usb_db_chunk_t *chunk)
+{
+    memcpy(&columns->vendor_ids[row], chunk->columns.vendor_ids,
+        sizeof(uint16_t) * chunk->count);
+    memcpy(&columns->product_ids[row], chunk->columns.product_ids,
+        sizeof(uint16_t) * chunk->count);
+    memcpy(&columns->id_flags[row], chunk->columns.id_flags,
+        sizeof(uint8_t) * chunk->count);
+    memcpy(&columns->vendor_names[row], chunk->columns.vendor_names,
+        sizeof(usb_db_field_t) * chunk->count);
+    memcpy(&columns->product_names[row], chunk->columns.product_names,
+        sizeof(usb_db_field_t) * chunk->count);
+}
+
+/**
+ * @brief Concatenates the per-chunk columns in file order
+ *
+ * chunks are merged in the order they were planned (update file first),
+ * so the final table is exactly the one a sequential parse would build
+ * and the same rows win on lookups
+ *
+ * @details static int merge_chunks(usb_db_t *usb_db, usb_db_ingest_t *ingest)
+ * @param usb_db Pointer to the usb_db_t structure receiving the rows
+ * @param ingest Pointer to the parsed ingest state
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if a chunk or the final table could not be allocated
+ */
+static int merge_chunks(usb_db_t *usb_db, usb_db_ingest_t *ingest)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < ingest->chunk_count; ++i) {
+        if (ingest->chunks[i].status == EXIT_ERROR)
+            return EXIT_ERROR;
+        total += ingest->chunks[i].count;
+    }
+    if (alloc_usb_db_columns(&usb_db->columns, total) == EXIT_ERROR)
+        return EXIT_ERROR;
+    for (size_t i = 0; i < ingest->chunk_count; ++i) {
+        append_chunk_columns(&usb_db->columns, usb_db->count, &ingest->chunks[i]);
+        usb_db->count += ingest->chunks[i].count;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses the mapped CSV files on a pool of worker threads
+ *
+ * cuts the files into newline-aligned chunks, parses them concurrently
+ * into per-chunk columns with the SIMD delimiter scan and merges them
+ * into usb_db in file order; small databases use a single chunk per file
+ *
+ * @details int parse_usb_db_chunks(
+ *             usb_db_t *usb_db,
+ *             usb_db_source_t *sources,
+ *             size_t source_count,
+ *             size_t jobs)
+ * @param usb_db Pointer to the usb_db_t structure holding the mapped text
+ * @param sources Position and size of each mapped file
+ * @param source_count Number of mapped files
+ * @param jobs Number of workers (0 uses every online CPU)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) on allocation failure
+ */
+int parse_usb_db_chunks(usb_db_t *usb_db, usb_db_source_t *sources,
+    size_t source_count, size_t jobs)
+{
+    usb_db_ingest_t ingest = {usb_db->text, NULL, 0, 0, select_usb_db_scan_block()};
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int result = EXIT_ERROR;
+
+    if (jobs == 0)
+        jobs = online < 1 ? 1 : (online > MAX_JOBS ? MAX_JOBS : (size_t)online);
+    ingest.chunks = calloc(jobs * MAX_DB_SOURCES, sizeof(usb_db_chunk_t));
+    if (ingest.chunks == NULL)
+        return EXIT_ERROR;
+    plan_chunks(&ingest, sources, source_count, jobs);
+    run_chunk_workers(&ingest, jobs);
+    result = merge_chunks(usb_db, &ingest);
+    for (size_t i = 0; i < ingest.chunk_count; ++i)
+        free_usb_db_columns(&ingest.chunks[i].columns);
+    free(ingest.chunks);
+    return result;
+}
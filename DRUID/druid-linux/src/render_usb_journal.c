@@ -0,0 +1,385 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file render_usb_journal.c
+ * @brief journal sink: one structured journald entry per classified device
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <systemd/sd-device.h>
+#include <systemd/sd-journal.h>
+#include "druid.h"
+
+/* risk level, message id and priority of each match level (MATCH_NONE, MATCH_VENDOR_ONLY, MATCH_VENDOR_AND_PRODUCT) */
+static const char *const journal_risk_names[] = {"major", "medium", "low"};
+static const char *const journal_message_ids[] = {
+    USB_JOURNAL_MESSAGE_ID_MAJOR, USB_JOURNAL_MESSAGE_ID_MEDIUM, USB_JOURNAL_MESSAGE_ID_LOW
+};
+static const int journal_priorities[] = {LOG_ERR, LOG_WARNING, LOG_INFO};
+
+/**
+ * @brief Appends a field to the pending journal entry
+ *
+ * entries are kept as "KEY=value" lines ended by an empty line until
+ * they are sent, so newlines inside the value are turned into spaces;
+ * a field without value (NULL) is left out of the entry
+ *
+ * @details static void append_journal_field(
+ *             usb_output_t *output,
+ *             const char *key,
+ *             const char *value,
+ *             size_t length)
+ * @param output Pointer to the output
+ * @param key Field name followed by '='
+ * @param value Value of the field (not null-terminated), or NULL
+ * @param length Length of the value
+ */
+static void append_journal_field(usb_output_t *output, const char *key,
+    const char *value, size_t length)
+{
+    usb_db_blob_t *buffer = &output->buffers[USB_RENDER_JOURNAL];
+    size_t key_length = strlen(key);
+    char *out = NULL;
+
+    if (value == NULL ||
+        reserve_usb_output(output, buffer, key_length + length + 1) == EXIT_ERROR)
+        return;
+    out = buffer->data + buffer->size;
+    memcpy(out, key, key_length);
+    out += key_length;
+    for (size_t i = 0; i < length; ++i)
+        out[i] = value[i] == '\n' ? ' ' : value[i];
+    out[length] = '\n';
+    buffer->size += key_length + length + 1;
+}
+
+/**
+ * @brief Appends a field holding a null-terminated string (or nothing)
+ *
+ * @details static void append_journal_text(
+ *             usb_output_t *output,
+ *             const char *key,
+ *             const char *str)
+ * @param output Pointer to the output
+ * @param key Field name followed by '='
+ * @param str Value of the field, or NULL
+ */
+static void append_journal_text(usb_output_t *output, const char *key, const char *str)
+{
+    append_journal_field(output, key, str, str != NULL ? strlen(str) : 0);
+}
+
+/**
+ * @brief Opens an entry with its message, message id, priority and identifier
+ *
+ * @details static void begin_journal_entry(
+ *             usb_output_t *output,
+ *             const char *message,
+ *             const char *message_id,
+ *             int priority)
+ * @param output Pointer to the output
+ * @param message Human readable message of the entry
+ * @param message_id Message id of the kind of entry
+ * @param priority Syslog priority of the entry
+ */
+static void begin_journal_entry(usb_output_t *output, const char *message,
+    const char *message_id, int priority)
+{
+    append_journal_text(output, "MESSAGE=", message);
+    print_usb_output(output, USB_RENDER_JOURNAL, "MESSAGE_ID=%s\nPRIORITY=%d\n"
+        "SYSLOG_IDENTIFIER=" USB_JOURNAL_IDENTIFIER "\n", message_id, priority);
+}
+
+/**
+ * @brief Closes an entry, which is sent with the next flush of the output
+ *
+ * @details static void end_journal_entry(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+static void end_journal_entry(usb_output_t *output)
+{
+    print_usb_output(output, USB_RENDER_JOURNAL, "\n");
+    ++output->journal.pending;
+}
+
+/**
+ * @brief Renders the journal entry of a classified device
+ *
+ * @details void print_usb_journal_device(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_db_names_t *usb_db_names,
+ *             int match)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing current USB device info
+ * @param usb_db_names Pointer to the names of the matching database entry ("Unknown" if none)
+ * @param match Match level of the device (MATCH_*)
+ */
+void print_usb_journal_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match)
+{
+    char message[USB_JOURNAL_MESSAGE_SIZE] = {0};
+
+    if (!output->renders[USB_RENDER_JOURNAL])
+        return;
+    snprintf(message, sizeof(message), "%s risk USB device %s:%s on %s",
+        journal_risk_names[match], usb_device_info->vendor_id, usb_device_info->product_id,
+        usb_device_info->path_usb != NULL ? usb_device_info->path_usb : UNKNOWN_DEVICE_MESSAGE);
+    begin_journal_entry(output, message, journal_message_ids[match],
+        journal_priorities[match]);
+    append_journal_text(output, "DRUID_RISK=", journal_risk_names[match]);
+    append_journal_text(output, "DRUID_VID=", usb_device_info->vendor_id);
+    append_journal_text(output, "DRUID_PID=", usb_device_info->product_id);
+    append_journal_text(output, "DRUID_VENDOR_NAME=", usb_device_info->vendor_name);
+    append_journal_text(output, "DRUID_PRODUCT_NAME=", usb_device_info->product_name);
+    append_journal_field(output, "DRUID_DB_VENDOR_NAME=", usb_db_names->vendor_name,
+        usb_db_names->vendor_name_length);
+    append_journal_field(output, "DRUID_DB_PRODUCT_NAME=", usb_db_names->product_name,
+        usb_db_names->product_name_length);
+    append_journal_text(output, "DRUID_SERIAL=", usb_device_info->serial);
+    append_journal_text(output, "DRUID_DEVPATH=", usb_device_info->path_usb);
+    if (usb_device_info->path_usb != NULL && usb_device_info->hub_depth >= 0)
+        print_usb_output(output, USB_RENDER_JOURNAL, "DRUID_HUB_DEPTH=%d\n",
+            usb_device_info->hub_depth);
+    end_journal_entry(output);
+}
+
+/**
+ * @brief Renders the journal entry of a device unplugged during a watch
+ *
+ * @details void print_usb_journal_removed(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             const char *devpath)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing the removed device ids
+ * @param devpath Device path of the removed device, or NULL
+ */
+void print_usb_journal_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath)
+{
+    char message[USB_JOURNAL_MESSAGE_SIZE] = {0};
+
+    if (!output->renders[USB_RENDER_JOURNAL])
+        return;
+    snprintf(message, sizeof(message), "USB device %s:%s removed from %s",
+        usb_device_info->vendor_id, usb_device_info->product_id,
+        devpath != NULL ? devpath : UNKNOWN_DEVICE_MESSAGE);
+    begin_journal_entry(output, message, USB_JOURNAL_MESSAGE_ID_REMOVED, LOG_INFO);
+    append_journal_text(output, "DRUID_VID=", usb_device_info->vendor_id);
+    append_journal_text(output, "DRUID_PID=", usb_device_info->product_id);
+    append_journal_text(output, "DRUID_DEVPATH=", devpath);
+    end_journal_entry(output);
+}
+
+/**
+ * @brief Renders the journal entry summing up the risks of a scan
+ *
+ * @details void print_usb_journal_risk_table(
+ *             usb_output_t *output,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param output Pointer to the output
+ * @param usb_risk_stats Pointer to the risk statistics structure
+ */
+void print_usb_journal_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    char message[USB_JOURNAL_MESSAGE_SIZE] = {0};
+
+    if (!output->renders[USB_RENDER_JOURNAL])
+        return;
+    snprintf(message, sizeof(message), "USB scan: %lu low, %lu medium and %lu major risk devices",
+        usb_risk_stats->low, usb_risk_stats->medium, usb_risk_stats->major);
+    begin_journal_entry(output, message, USB_JOURNAL_MESSAGE_ID_SUMMARY,
+        usb_risk_stats->major > 0 ? LOG_WARNING : LOG_INFO);
+    print_usb_output(output, USB_RENDER_JOURNAL, "DRUID_LOW=%lu\nDRUID_MEDIUM=%lu\n"
+        "DRUID_MAJOR=%lu\n", usb_risk_stats->low, usb_risk_stats->medium, usb_risk_stats->major);
+    end_journal_entry(output);
+}
+
+/**
+ * @brief Sends a batch of rendered entries to journald, one call per entry
+ *
+ * every line of an entry is one field, given to sd_journal_sendv
+ * without its newline; an empty line ends the entry
+ *
+ * @details static void send_usb_journal_entries(const char *data, size_t size)
+ * @param data Rendered entries
+ * @param size Size of the rendered entries
+ */
+static void send_usb_journal_entries(const char *data, size_t size)
+{
+    struct iovec fields[USB_JOURNAL_MAX_FIELDS];
+    const char *end = NULL;
+    size_t start = 0;
+    int count = 0;
+
+    while (start < size) {
+        end = memchr(data + start, '\n', size - start);
+        if (end == NULL)
+            return;
+        if (end == data + start && count > 0)
+            sd_journal_sendv(fields, count);
+        if (end == data + start)
+            count = 0;
+        else if (count < USB_JOURNAL_MAX_FIELDS)
+            fields[count++] = (struct iovec){(void *)(data + start), end - (data + start)};
+        start = end - data + 1;
+    }
+}
+
+/**
+ * @brief Sender thread: waits for batches and submits them outside the lock
+ *
+ * the queue is swapped with the emptied buffer of the previous batch, so
+ * the lock is only held for the swap and both buffers keep their memory;
+ * once stopping, the thread leaves after the last batch is sent
+ *
+ * @details static void *send_usb_journal_worker(void *arg)
+ * @param arg Pointer to the usb_journal_t of the output
+ * @return NULL
+ */
+static void *send_usb_journal_worker(void *arg)
+{
+    usb_journal_t *journal = arg;
+    usb_db_blob_t batch = {0};
+    usb_db_blob_t queue = {0};
+
+    pthread_mutex_lock(&journal->lock);
+    while (true) {
+        while (journal->queue.size == 0 && !journal->stopping)
+            pthread_cond_wait(&journal->ready, &journal->lock);
+        if (journal->queue.size == 0)
+            break;
+        queue = journal->queue;
+        journal->queue = batch;
+        batch = queue;
+        pthread_cond_signal(&journal->drained);
+        pthread_mutex_unlock(&journal->lock);
+        send_usb_journal_entries(batch.data, batch.size);
+        batch.size = 0;
+        pthread_mutex_lock(&journal->lock);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    free(batch.data);
+    return NULL;
+}
+
+/**
+ * @brief Adds the journal sink to an output and starts its sender thread
+ *
+ * the thread is started with every signal blocked so SIGINT and SIGTERM
+ * still reach the watch loop; if it cannot be started the entries are
+ * sent by the flushes themselves, so only the overlap is lost
+ *
+ * @details void open_usb_journal(usb_output_t *output, bool lossy)
+ * @param output Pointer to the opened output
+ * @param lossy Whether a full queue drops batches (watch) rather than waits (scan)
+ */
+void open_usb_journal(usb_output_t *output, bool lossy)
+{
+    usb_journal_t *journal = &output->journal;
+    sigset_t signals;
+    sigset_t previous;
+
+    output->renders[USB_RENDER_JOURNAL] = true;
+    journal->lossy = lossy;
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->ready, NULL);
+    pthread_cond_init(&journal->drained, NULL);
+    sigfillset(&signals);
+    pthread_sigmask(SIG_SETMASK, &signals, &previous);
+    journal->started = pthread_create(&journal->thread, NULL,
+        send_usb_journal_worker, journal) == SUCCESS;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/**
+ * @brief Hands the entries rendered since the last flush to the sender thread
+ *
+ * an idle queue takes the buffer itself (swapped, not copied), a busy one
+ * gets the entries appended; past USB_JOURNAL_QUEUE_LIMIT bytes a scan
+ * waits for the sender to take the queue, while a watch drops the batch
+ * and counts it, journald being too slow must not stall the hotplug
+ * classification
+ *
+ * @details void flush_usb_journal(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+void flush_usb_journal(usb_output_t *output)
+{
+    usb_journal_t *journal = &output->journal;
+    usb_db_blob_t *buffer = &output->buffers[USB_RENDER_JOURNAL];
+    usb_db_blob_t queue = {0};
+
+    if (buffer->size == 0)
+        return;
+    if (!journal->started) {
+        send_usb_journal_entries(buffer->data, buffer->size);
+    } else {
+        pthread_mutex_lock(&journal->lock);
+        while (!journal->lossy && journal->queue.size > 0 &&
+            journal->queue.size + buffer->size > USB_JOURNAL_QUEUE_LIMIT)
+            pthread_cond_wait(&journal->drained, &journal->lock);
+        if (journal->queue.size == 0) {
+            queue = journal->queue;
+            journal->queue = *buffer;
+            *buffer = queue;
+        } else if (journal->queue.size + buffer->size <= USB_JOURNAL_QUEUE_LIMIT &&
+            reserve_usb_output(output, &journal->queue, buffer->size) == EXIT_SUCCESS) {
+            memcpy(journal->queue.data + journal->queue.size, buffer->data, buffer->size);
+            journal->queue.size += buffer->size;
+        } else {
+            journal->dropped += journal->pending;
+        }
+        pthread_cond_signal(&journal->ready);
+        pthread_mutex_unlock(&journal->lock);
+    }
+    buffer->size = 0;
+    journal->pending = 0;
+}
+
+/**
+ * @brief Waits for the sender thread to send what is queued, then frees the sink
+ *
+ * @details void close_usb_journal(usb_output_t *output)
+ * @param output Pointer to the output, flushed beforehand
+ */
+void close_usb_journal(usb_output_t *output)
+{
+    usb_journal_t *journal = &output->journal;
+
+    if (!output->renders[USB_RENDER_JOURNAL])
+        return;
+    if (journal->started) {
+        pthread_mutex_lock(&journal->lock);
+        journal->stopping = true;
+        pthread_cond_signal(&journal->ready);
+        pthread_mutex_unlock(&journal->lock);
+        pthread_join(journal->thread, NULL);
+    }
+    pthread_cond_destroy(&journal->ready);
+    pthread_cond_destroy(&journal->drained);
+    pthread_mutex_destroy(&journal->lock);
+    free(journal->queue.data);
+    if (journal->dropped > 0)
+        dprintf(STDERR_FILENO, JOURNAL_DROPPED_MESSAGE, journal->dropped);
+}
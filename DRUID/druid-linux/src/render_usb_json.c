@@ -0,0 +1,416 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file render_usb_json.c
+ * @brief json and ndjson renderer of the output (--format-output)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/* risk level of each match level (MATCH_NONE, MATCH_VENDOR_ONLY, MATCH_VENDOR_AND_PRODUCT) */
+static const char *const json_risk_names[] = {"major", "medium", "low"};
+
+/* escape letter of each byte: 0 when copied as is, 'u' for \u00XX */
+static const char json_escapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', [92] = '\\'
+};
+
+/**
+ * @brief Appends raw text to the json buffer
+ *
+ * @details static void append_json(
+ *             usb_output_t *output,
+ *             const char *text,
+ *             size_t length)
+ * @param output Pointer to the output
+ * @param text Text to append
+ * @param length Length of the text
+ */
+static void append_json(usb_output_t *output, const char *text, size_t length)
+{
+    usb_db_blob_t *buffer = &output->buffers[USB_RENDER_JSON];
+
+    if (reserve_usb_output(output, buffer, length) == EXIT_ERROR)
+        return;
+    memcpy(buffer->data + buffer->size, text, length);
+    buffer->size += length;
+}
+
+/**
+ * @brief Measures the well-formed UTF-8 sequence starting at a byte
+ *
+ * follows RFC 3629: overlong forms, surrogates and code points above
+ * U+10FFFF are rejected, as are sequences cut by the end of the string
+ *
+ * @details static size_t measure_utf8_sequence(
+ *             const unsigned char *bytes,
+ *             size_t left)
+ * @param bytes First byte of the sequence (0x80 or above)
+ * @param left Bytes left in the string, the first one included
+ * @return Length of the sequence, or 0 if it is not valid UTF-8
+ */
+static size_t measure_utf8_sequence(const unsigned char *bytes, size_t left)
+{
+    size_t length = 0;
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+
+    if (bytes[0] >= 0xc2 && bytes[0] <= 0xdf)
+        length = 2;
+    else if (bytes[0] >= 0xe0 && bytes[0] <= 0xef)
+        length = 3;
+    else if (bytes[0] >= 0xf0 && bytes[0] <= 0xf4)
+        length = 4;
+    if (length == 0 || length > left)
+        return 0;
+    if (bytes[0] == 0xe0)
+        low = 0xa0;
+    else if (bytes[0] == 0xed)
+        high = 0x9f;
+    else if (bytes[0] == 0xf0)
+        low = 0x90;
+    else if (bytes[0] == 0xf4)
+        high = 0x8f;
+    if (bytes[1] < low || bytes[1] > high)
+        return 0;
+    for (size_t i = 2; i < length; ++i) {
+        if (bytes[i] < 0x80 || bytes[i] > 0xbf)
+            return 0;
+    }
+    return length;
+}
+
+/**
+ * @brief Appends a json string, escaping quotes, backslashes and control bytes
+ *
+ * runs of bytes needing no escape are copied at once, well-formed UTF-8
+ * sequences included; each byte that is not part of one (device strings
+ * are not guaranteed to be UTF-8) becomes \ufffd, so the output is
+ * always valid json
+ *
+ * @details static void append_json_string(
+ *             usb_output_t *output,
+ *             const char *str,
+ *             size_t length)
+ * @param output Pointer to the output
+ * @param str String to append (null when NULL)
+ * @param length Length of the string
+ */
+static void append_json_string(usb_output_t *output, const char *str, size_t length)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    usb_db_blob_t *buffer = &output->buffers[USB_RENDER_JSON];
+    const unsigned char *bytes = (const unsigned char *)str;
+    char *out = NULL;
+    size_t start = 0;
+    size_t sequence = 0;
+
+    if (str == NULL) {
+        append_json(output, "null", 4);
+        return;
+    }
+    if (reserve_usb_output(output, buffer, length * 6 + 2) == EXIT_ERROR)
+        return;
+    out = buffer->data + buffer->size;
+    *out++ = '"';
+    for (size_t i = 0; i < length; ++i) {
+        if (bytes[i] >= 0x80) {
+            sequence = measure_utf8_sequence(bytes + i, length - i);
+            if (sequence != 0) {
+                i += sequence - 1;
+                continue;
+            }
+        } else if (json_escapes[bytes[i]] == 0)
+            continue;
+        memcpy(out, str + start, i - start);
+        out += i - start;
+        start = i + 1;
+        if (bytes[i] >= 0x80) {
+            memcpy(out, USB_JSON_REPLACEMENT, sizeof(USB_JSON_REPLACEMENT) - 1);
+            out += sizeof(USB_JSON_REPLACEMENT) - 1;
+            continue;
+        }
+        *out++ = '\\';
+        *out++ = json_escapes[bytes[i]];
+        if (json_escapes[bytes[i]] == 'u') {
+            memcpy(out, "00", 2);
+            out[2] = hex_digits[bytes[i] >> 4];
+            out[3] = hex_digits[bytes[i] & 0xf];
+            out += 4;
+        }
+    }
+    memcpy(out, str + start, length - start);
+    out += length - start;
+    *out++ = '"';
+    buffer->size = out - buffer->data;
+}
+
+/**
+ * @brief Appends a member name followed by its separator
+ *
+ * @details static void append_json_key(usb_output_t *output, const char *key)
+ * @param output Pointer to the output
+ * @param key Member name, preceded by the comma of the previous member if any
+ */
+static void append_json_key(usb_output_t *output, const char *key)
+{
+    append_json(output, key, strlen(key));
+}
+
+/**
+ * @brief Appends an unsigned number
+ *
+ * @details static void append_json_number(usb_output_t *output, size_t value)
+ * @param output Pointer to the output
+ * @param value Number to append
+ */
+static void append_json_number(usb_output_t *output, size_t value)
+{
+    char digits[24];
+    size_t start = sizeof(digits);
+
+    do {
+        digits[--start] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    append_json(output, digits + start, sizeof(digits) - start);
+}
+
+/**
+ * @brief Appends the current UTC time, to the millisecond
+ *
+ * the date part is formatted once per second and reused by the records
+ * emitted within it
+ *
+ * @details static void append_json_timestamp(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+static void append_json_timestamp(usb_output_t *output)
+{
+    struct timespec now = {0};
+    struct tm date = {0};
+    char millis[6] = {'.', 0, 0, 0, 'Z', '"'};
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (output->stamp[0] == '\0' || now.tv_sec != output->stamp_second) {
+        gmtime_r(&now.tv_sec, &date);
+        strftime(output->stamp, sizeof(output->stamp), "\"%Y-%m-%dT%H:%M:%S", &date);
+        output->stamp_second = now.tv_sec;
+    }
+    millis[1] = '0' + now.tv_nsec / 100000000;
+    millis[2] = '0' + now.tv_nsec / 10000000 % 10;
+    millis[3] = '0' + now.tv_nsec / 1000000 % 10;
+    append_json(output, output->stamp, strlen(output->stamp));
+    append_json(output, millis, sizeof(millis));
+}
+
+/**
+ * @brief Opens a record: its separator from the previous one, and its type
+ *
+ * json output is one array of records, ndjson output one record per line
+ *
+ * @details static void begin_json_record(usb_output_t *output, const char *type)
+ * @param output Pointer to the output
+ * @param type Type of the record
+ */
+static void begin_json_record(usb_output_t *output, const char *type)
+{
+    if (output->format == USB_FORMAT_JSON)
+        append_json(output, output->records == 0 ? "[\n" : ",\n", 2);
+    ++output->records;
+    append_json_key(output, "{\"type\":");
+    append_json_string(output, type, strlen(type));
+}
+
+/**
+ * @brief Closes a record with its timestamp
+ *
+ * @details static void end_json_record(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+static void end_json_record(usb_output_t *output)
+{
+    append_json_key(output, ",\"timestamp\":");
+    append_json_timestamp(output);
+    if (output->format == USB_FORMAT_NDJSON)
+        append_json(output, "}\n", 2);
+    else
+        append_json(output, "}", 1);
+}
+
+/**
+ * @brief Appends a member holding a null-terminated string (or null)
+ *
+ * @details static void append_json_text(
+ *             usb_output_t *output,
+ *             const char *key,
+ *             const char *str)
+ * @param output Pointer to the output
+ * @param key Member name and its separators
+ * @param str Value of the member, or NULL
+ */
+static void append_json_text(usb_output_t *output, const char *key, const char *str)
+{
+    append_json_key(output, key);
+    append_json_string(output, str, str != NULL ? strlen(str) : 0);
+}
+
+/**
+ * @brief Renders the json record of a classified device
+ *
+ * @details void print_usb_json_device(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_db_names_t *usb_db_names,
+ *             int match,
+ *             size_t number)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing current USB device info
+ * @param usb_db_names Pointer to the names of the matching database entry ("Unknown" if none)
+ * @param match Match level of the device (MATCH_*)
+ * @param number Number of the device in the scan
+ */
+void print_usb_json_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match, size_t number)
+{
+    if (!output->renders[USB_RENDER_JSON])
+        return;
+    begin_json_record(output, "device");
+    append_json_key(output, ",\"number\":");
+    append_json_number(output, number);
+    append_json_text(output, ",\"risk\":", json_risk_names[match]);
+    append_json_text(output, ",\"vendor_id\":", usb_device_info->vendor_id);
+    append_json_text(output, ",\"product_id\":", usb_device_info->product_id);
+    append_json_text(output, ",\"vendor_name\":", usb_device_info->vendor_name);
+    append_json_text(output, ",\"product_name\":", usb_device_info->product_name);
+    append_json_key(output, ",\"db_vendor_name\":");
+    append_json_string(output, usb_db_names->vendor_name, usb_db_names->vendor_name_length);
+    append_json_key(output, ",\"db_product_name\":");
+    append_json_string(output, usb_db_names->product_name, usb_db_names->product_name_length);
+    append_json_text(output, ",\"serial\":", usb_device_info->serial);
+    append_json_text(output, ",\"devpath\":", usb_device_info->path_usb);
+    append_json_key(output, ",\"hub_depth\":");
+    if (usb_device_info->path_usb != NULL && usb_device_info->hub_depth >= 0)
+        append_json_number(output, usb_device_info->hub_depth);
+    else
+        append_json(output, "null", 4);
+    end_json_record(output);
+}
+
+/**
+ * @brief Renders the json record of a device unplugged during a watch
+ *
+ * @details void print_usb_json_removed(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             const char *devpath)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing the removed device ids
+ * @param devpath Device path of the removed device, or NULL
+ */
+void print_usb_json_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath)
+{
+    if (!output->renders[USB_RENDER_JSON])
+        return;
+    begin_json_record(output, "removed");
+    append_json_text(output, ",\"vendor_id\":", usb_device_info->vendor_id);
+    append_json_text(output, ",\"product_id\":", usb_device_info->product_id);
+    append_json_text(output, ",\"devpath\":", devpath);
+    end_json_record(output);
+}
+
+/**
+ * @brief Renders the json record of one host of a fleet audit
+ *
+ * @details void print_usb_json_fleet_host(
+ *             usb_output_t *output,
+ *             usb_fleet_host_t *host)
+ * @param output Pointer to the output
+ * @param host Pointer to the classified host
+ */
+void print_usb_json_fleet_host(usb_output_t *output, usb_fleet_host_t *host)
+{
+    if (!output->renders[USB_RENDER_JSON])
+        return;
+    begin_json_record(output, "host");
+    append_json_text(output, ",\"host\":", host->name);
+    append_json_key(output, ",\"readable\":");
+    if (host->status == EXIT_ERROR) {
+        append_json(output, "false", 5);
+        end_json_record(output);
+        return;
+    }
+    append_json_key(output, "true,\"low\":");
+    append_json_number(output, host->low);
+    append_json_key(output, ",\"medium\":");
+    append_json_number(output, host->medium);
+    append_json_key(output, ",\"major\":");
+    append_json_number(output, host->major);
+    end_json_record(output);
+}
+
+/**
+ * @brief Renders the risk table as the json summary record
+ *
+ * @details void print_usb_json_risk_table(
+ *             usb_output_t *output,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param output Pointer to the output
+ * @param usb_risk_stats Pointer to the structure containing aggregated risk counters
+ */
+void print_usb_json_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    if (!output->renders[USB_RENDER_JSON])
+        return;
+    begin_json_record(output, "summary");
+    append_json_key(output, ",\"devices\":");
+    append_json_number(output, usb_risk_stats->low + usb_risk_stats->medium +
+        usb_risk_stats->major);
+    append_json_key(output, ",\"low\":");
+    append_json_number(output, usb_risk_stats->low);
+    append_json_key(output, ",\"medium\":");
+    append_json_number(output, usb_risk_stats->medium);
+    append_json_key(output, ",\"major\":");
+    append_json_number(output, usb_risk_stats->major);
+    end_json_record(output);
+}
+
+/**
+ * @brief Closes the json array once every record is rendered
+ *
+ * nothing is needed for ndjson; an empty json output is still a valid
+ * document ([])
+ *
+ * @details void end_usb_json_output(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+void end_usb_json_output(usb_output_t *output)
+{
+    if (!output->renders[USB_RENDER_JSON] || output->format != USB_FORMAT_JSON)
+        return;
+    if (output->records == 0)
+        append_json(output, "[]\n", 3);
+    else
+        append_json(output, "\n]\n", 3);
+}
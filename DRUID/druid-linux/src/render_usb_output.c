@@ -0,0 +1,279 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file render_usb_output.c
+ * @brief output sinks: records formatted once per renderer, written to every sink
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Adds a sink to the output
+ *
+ * @details int add_usb_output_sink(
+ *             usb_output_t *output,
+ *             int fd,
+ *             int render,
+ *             bool owned)
+ * @param output Pointer to the output
+ * @param fd Descriptor the sink writes to
+ * @param render Renderer of the sink (USB_RENDER_*)
+ * @param owned Whether the descriptor is closed with the output
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the output already has USB_OUTPUT_MAX_SINKS sinks
+ */
+int add_usb_output_sink(usb_output_t *output, int fd, int render, bool owned)
+{
+    if (output->sink_count >= USB_OUTPUT_MAX_SINKS || render < 0 || render >= USB_RENDER_COUNT)
+        return EXIT_ERROR;
+    output->sinks[output->sink_count++] = (usb_output_sink_t){fd, render, owned};
+    output->renders[render] = true;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Gives the renderer of a machine readable format
+ *
+ * @details static int get_usb_output_render(int format)
+ * @param format Output format (USB_FORMAT_JSON, USB_FORMAT_NDJSON or USB_FORMAT_BINARY)
+ * @return USB_RENDER_JSON or USB_RENDER_BINARY
+ */
+static int get_usb_output_render(int format)
+{
+    return format == USB_FORMAT_BINARY ? USB_RENDER_BINARY : USB_RENDER_JSON;
+}
+
+/**
+ * @brief Opens the output of a scan: the console, and the --output file if any
+ *
+ * as text, the console gets the ANSI renderer and the file the plain
+ * one; as json, ndjson or binary (--format-output), the file gets the
+ * json or binary renderer, or the console when there is no file; when
+ * the console is a terminal every record is written at once, otherwise
+ * (pipe, file) records are batched USB_OUTPUT_FLUSH_SIZE bytes at a time
+ *
+ * @details int open_usb_output(
+ *             usb_output_t *output,
+ *             const char *path,
+ *             int format)
+ * @param output Pointer to the output to open
+ * @param path File receiving the plain (or json, binary) rendering, or NULL for the console only
+ * @param format Output format (USB_FORMAT_*)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the file cannot be created
+ */
+int open_usb_output(usb_output_t *output, const char *path, int format)
+{
+    int fd = -1;
+
+    *output = (usb_output_t){0};
+    output->interactive = isatty(STDOUT_FILENO);
+    output->status = EXIT_SUCCESS;
+    output->format = format;
+    add_usb_output_sink(output, STDOUT_FILENO, path == NULL && format != USB_FORMAT_TEXT ?
+        get_usb_output_render(format) : USB_RENDER_ANSI, false);
+    if (path != NULL) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, OUTPUT_FILE_MODE);
+        if (fd < 0 || add_usb_output_sink(output, fd, format != USB_FORMAT_TEXT ?
+            get_usb_output_render(format) : USB_RENDER_PLAIN, true) == EXIT_ERROR)
+            return EXIT_ERROR;
+    }
+    begin_usb_report_output(output);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Makes room for length bytes (and a terminator) in a renderer buffer
+ *
+ * @details int reserve_usb_output(
+ *             usb_output_t *output,
+ *             usb_db_blob_t *buffer,
+ *             size_t length)
+ * @param output Pointer to the output, whose status is set on failure
+ * @param buffer Buffer of the renderer
+ * @param length Number of bytes about to be formatted
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int reserve_usb_output(usb_output_t *output, usb_db_blob_t *buffer, size_t length)
+{
+    size_t capacity = buffer->capacity;
+    char *data = NULL;
+
+    while (buffer->size + length >= capacity)
+        capacity = capacity > 0 ? capacity * INCREASED_SIZE : USB_OUTPUT_FLUSH_SIZE;
+    if (capacity == buffer->capacity)
+        return EXIT_SUCCESS;
+    data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        output->status = EXIT_ERROR;
+        return EXIT_ERROR;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Formats text into the buffer of one renderer
+ *
+ * nothing is formatted for a renderer no sink uses, and text formatted
+ * for a renderer is shared by all of its sinks
+ *
+ * @details void print_usb_output(
+ *             usb_output_t *output,
+ *             int render,
+ *             const char *format,
+ *             ...)
+ * @param output Pointer to the output
+ * @param render Renderer the text is meant for (USB_RENDER_*)
+ * @param format printf format of the text
+ */
+void print_usb_output(usb_output_t *output, int render, const char *format, ...)
+{
+    usb_db_blob_t *buffer = &output->buffers[render];
+    va_list args;
+    int length = 0;
+
+    if (!output->renders[render] || reserve_usb_output(output, buffer, 0) == EXIT_ERROR)
+        return;
+    va_start(args, format);
+    length = vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size,
+        format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+    if (buffer->size + length >= buffer->capacity) {
+        if (reserve_usb_output(output, buffer, length) == EXIT_ERROR)
+            return;
+        va_start(args, format);
+        vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, args);
+        va_end(args);
+    }
+    buffer->size += length;
+}
+
+/**
+ * @brief Writes a rendered buffer to one sink, resuming short writes
+ *
+ * @details static int write_usb_output_sink(
+ *             usb_output_sink_t *sink,
+ *             usb_db_blob_t *buffer)
+ * @param sink Pointer to the sink
+ * @param buffer Buffer of the renderer of the sink
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the sink cannot be written
+ */
+static int write_usb_output_sink(usb_output_sink_t *sink, usb_db_blob_t *buffer)
+{
+    size_t sent = 0;
+    ssize_t written = 0;
+
+    while (sent < buffer->size) {
+        written = write(sink->fd, buffer->data + sent, buffer->size - sent);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            return EXIT_ERROR;
+        sent += written;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Writes the rendered records to every sink
+ *
+ * stdio text printed before (by code outside the output) is flushed
+ * first so the console keeps its order; journal entries are handed to
+ * their sender thread
+ *
+ * @details int flush_usb_output(usb_output_t *output)
+ * @param output Pointer to the output
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if a record could not be formatted or written
+ */
+int flush_usb_output(usb_output_t *output)
+{
+    fflush(stdout);
+    flush_usb_journal(output);
+    for (size_t i = 0; i < output->sink_count; ++i) {
+        if (write_usb_output_sink(&output->sinks[i],
+            &output->buffers[output->sinks[i].render]) == EXIT_ERROR)
+            output->status = EXIT_ERROR;
+    }
+    for (int i = 0; i < USB_RENDER_COUNT; ++i)
+        output->buffers[i].size = 0;
+    return output->status;
+}
+
+/**
+ * @brief Ends a record: writes it right away on a terminal, else once
+ * enough records are rendered
+ *
+ * @details void end_usb_output_record(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+void end_usb_output_record(usb_output_t *output)
+{
+    for (int i = 0; i < USB_RENDER_COUNT; ++i) {
+        if (output->interactive || output->buffers[i].size >= USB_OUTPUT_FLUSH_SIZE) {
+            flush_usb_output(output);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Writes what is left, closes the sinks the output opened and frees it
+ *
+ * the journal sender thread is waited for, so no entry is lost on exit
+ *
+ * @details int close_usb_output(usb_output_t *output)
+ * @param output Pointer to the output
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if every record was written
+ *         - 84     (EXIT_ERROR) otherwise
+ */
+int close_usb_output(usb_output_t *output)
+{
+    int result = EXIT_SUCCESS;
+
+    end_usb_json_output(output);
+    end_usb_report_output(output);
+    result = flush_usb_output(output);
+    close_usb_journal(output);
+    for (size_t i = 0; i < output->sink_count; ++i) {
+        if (output->sinks[i].owned && close(output->sinks[i].fd) != SUCCESS)
+            result = EXIT_ERROR;
+    }
+    for (int i = 0; i < USB_RENDER_COUNT; ++i)
+        free(output->buffers[i].data);
+    free_usb_report(&output->report);
+    *output = (usb_output_t){0};
+    return result;
+}
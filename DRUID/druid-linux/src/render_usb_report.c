@@ -0,0 +1,348 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file render_usb_report.c
+ * @brief binary report renderer of the output (--format-output=binary)
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Appends bytes to the binary buffer
+ *
+ * @details static void append_report(
+ *             usb_output_t *output,
+ *             const void *data,
+ *             size_t size)
+ * @param output Pointer to the output
+ * @param data Bytes to append
+ * @param size Number of bytes
+ */
+static void append_report(usb_output_t *output, const void *data, size_t size)
+{
+    usb_db_blob_t *buffer = &output->buffers[USB_RENDER_BINARY];
+
+    if (size == 0 || reserve_usb_output(output, buffer, size) == EXIT_ERROR)
+        return;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    output->report.size += size;
+}
+
+/**
+ * @brief Hashes a string with FNV-1a
+ *
+ * @details static uint64_t hash_report_string(const char *str, size_t length)
+ * @param str String to hash (not null-terminated)
+ * @param length Length of the string
+ * @return The 64 bit hash
+ */
+static uint64_t hash_report_string(const char *str, size_t length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)str[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the slot of a string in the intern table
+ *
+ * @details static size_t find_report_slot(
+ *             usb_report_t *report,
+ *             const char *str,
+ *             size_t length)
+ * @param report Pointer to the report being written
+ * @param str String looked up (not null-terminated)
+ * @param length Length of the string
+ * @return The slot holding the string, or the empty slot it belongs in
+ */
+static size_t find_report_slot(usb_report_t *report, const char *str, size_t length)
+{
+    size_t mask = report->slot_count - 1;
+    size_t slot = hash_report_string(str, length) & mask;
+    const char *interned = NULL;
+
+    for (; report->slots[slot] != 0; slot = (slot + 1) & mask) {
+        interned = report->strings.data + report->offsets[report->slots[slot] - 1];
+        if (strncmp(interned, str, length) == SUCCESS && interned[length] == '\0')
+            return slot;
+    }
+    return slot;
+}
+
+/**
+ * @brief Doubles the intern table once it is half full
+ *
+ * @details static int grow_report_slots(usb_report_t *report)
+ * @param report Pointer to the report being written
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+static int grow_report_slots(usb_report_t *report)
+{
+    size_t slot_count = report->slot_count > 0 ? report->slot_count * 2 : USB_REPORT_STRING_SLOTS;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    const char *str = NULL;
+
+    if (slots == NULL)
+        return EXIT_ERROR;
+    free(report->slots);
+    report->slots = slots;
+    report->slot_count = slot_count;
+    for (size_t i = 0; i < report->string_count; ++i) {
+        str = report->strings.data + report->offsets[i];
+        report->slots[find_report_slot(report, str, strlen(str))] = i + 1;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Adds a string to the string table of the report, once
+ *
+ * @details static uint32_t intern_report_string(
+ *             usb_output_t *output,
+ *             const char *str,
+ *             size_t length)
+ * @param output Pointer to the output
+ * @param str String to intern (not null-terminated), or NULL
+ * @param length Length of the string
+ * @return Index of the string in the table, or USB_REPORT_NO_NAME if
+ *         the string is NULL or cannot be stored
+ */
+static uint32_t intern_report_string(usb_output_t *output, const char *str, size_t length)
+{
+    usb_report_t *report = &output->report;
+    uint32_t *offsets = NULL;
+    size_t slot = 0;
+
+    if (str == NULL || memchr(str, '\0', length) != NULL)
+        return USB_REPORT_NO_NAME;
+    if ((report->string_count + 1) * 2 > report->slot_count &&
+        grow_report_slots(report) == EXIT_ERROR)
+        return USB_REPORT_NO_NAME;
+    slot = find_report_slot(report, str, length);
+    if (report->slots[slot] != 0)
+        return report->slots[slot] - 1;
+    if (report->string_count == report->string_capacity) {
+        offsets = realloc(report->offsets, (report->string_capacity * INCREASED_SIZE + 1) *
+            sizeof(uint32_t));
+        if (offsets == NULL)
+            return USB_REPORT_NO_NAME;
+        report->offsets = offsets;
+        report->string_capacity = report->string_capacity * INCREASED_SIZE + 1;
+    }
+    if (report->strings.size + length + 1 > UINT32_MAX ||
+        reserve_usb_output(output, &report->strings, length + 1) == EXIT_ERROR)
+        return USB_REPORT_NO_NAME;
+    report->offsets[report->string_count] = report->strings.size;
+    memcpy(report->strings.data + report->strings.size, str, length);
+    report->strings.data[report->strings.size + length] = '\0';
+    report->strings.size += length + 1;
+    report->slots[slot] = ++report->string_count;
+    return report->string_count - 1;
+}
+
+/**
+ * @brief Interns a null-terminated string (or NULL)
+ *
+ * @details static uint32_t intern_report_text(usb_output_t *output, const char *str)
+ * @param output Pointer to the output
+ * @param str String to intern, or NULL
+ * @return Index of the string in the table, or USB_REPORT_NO_NAME
+ */
+static uint32_t intern_report_text(usb_output_t *output, const char *str)
+{
+    return intern_report_string(output, str, str != NULL ? strlen(str) : 0);
+}
+
+/**
+ * @brief Fills the ids of a record from the ids of a device
+ *
+ * the numeric ids are for tools reading the records; the ids are also
+ * interned as read from the system, so that decoding gives back their
+ * exact text (case, or ids that are not 4 hex digits)
+ *
+ * @details static void fill_report_ids(
+ *             usb_output_t *output,
+ *             usb_report_record_t *record,
+ *             usb_device_info_t *usb_device_info)
+ * @param output Pointer to the output
+ * @param record Pointer to the record
+ * @param usb_device_info Pointer to the device (ids that are not 4 hex digits are 0)
+ */
+static void fill_report_ids(usb_output_t *output, usb_report_record_t *record,
+    usb_device_info_t *usb_device_info)
+{
+    if (usb_device_info->vendor_id != NULL)
+        parse_usb_id_field(usb_device_info->vendor_id, strlen(usb_device_info->vendor_id),
+            &record->vendor_id);
+    if (usb_device_info->product_id != NULL)
+        parse_usb_id_field(usb_device_info->product_id, strlen(usb_device_info->product_id),
+            &record->product_id);
+    record->names[USB_REPORT_VENDOR_ID] = intern_report_text(output, usb_device_info->vendor_id);
+    record->names[USB_REPORT_PRODUCT_ID] = intern_report_text(output, usb_device_info->product_id);
+}
+
+/**
+ * @brief Starts a binary report with its header
+ *
+ * @details void begin_usb_report_output(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+void begin_usb_report_output(usb_output_t *output)
+{
+    usb_report_header_t header = {{0}, USB_REPORT_VERSION, sizeof(usb_report_header_t), 0};
+
+    if (!output->renders[USB_RENDER_BINARY])
+        return;
+    memcpy(header.magic, USB_REPORT_MAGIC, USB_REPORT_MAGIC_SIZE);
+    header.created = time(NULL);
+    append_report(output, &header, sizeof(header));
+}
+
+/**
+ * @brief Renders the report record of a classified device
+ *
+ * @details void print_usb_report_device(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             usb_db_names_t *usb_db_names,
+ *             int match)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing current USB device info
+ * @param usb_db_names Pointer to the names of the matching database entry ("Unknown" if none)
+ * @param match Match level of the device (MATCH_*)
+ */
+void print_usb_report_device(usb_output_t *output, usb_device_info_t *usb_device_info,
+    usb_db_names_t *usb_db_names, int match)
+{
+    usb_report_record_t record = {sizeof(usb_report_record_t), USB_REPORT_DEVICE, match,
+        0, 0, usb_device_info->hub_depth, {0}};
+
+    if (!output->renders[USB_RENDER_BINARY])
+        return;
+    fill_report_ids(output, &record, usb_device_info);
+    record.names[USB_REPORT_VENDOR_NAME] = intern_report_text(output, usb_device_info->vendor_name);
+    record.names[USB_REPORT_PRODUCT_NAME] = intern_report_text(output, usb_device_info->product_name);
+    record.names[USB_REPORT_DB_VENDOR_NAME] = intern_report_string(output,
+        usb_db_names->vendor_name, usb_db_names->vendor_name_length);
+    record.names[USB_REPORT_DB_PRODUCT_NAME] = intern_report_string(output,
+        usb_db_names->product_name, usb_db_names->product_name_length);
+    record.names[USB_REPORT_SERIAL] = intern_report_text(output, usb_device_info->serial);
+    record.names[USB_REPORT_DEVPATH] = intern_report_text(output, usb_device_info->path_usb);
+    append_report(output, &record, sizeof(record));
+    ++output->report.record_count;
+}
+
+/**
+ * @brief Renders the report record of a device unplugged during a watch
+ *
+ * @details void print_usb_report_removed(
+ *             usb_output_t *output,
+ *             usb_device_info_t *usb_device_info,
+ *             const char *devpath)
+ * @param output Pointer to the output
+ * @param usb_device_info Pointer to the structure containing the removed device ids
+ * @param devpath Device path of the removed device, or NULL
+ */
+void print_usb_report_removed(usb_output_t *output, usb_device_info_t *usb_device_info,
+    const char *devpath)
+{
+    usb_report_record_t record = {sizeof(usb_report_record_t), USB_REPORT_REMOVED, MATCH_NONE,
+        0, 0, -1, {0}};
+
+    if (!output->renders[USB_RENDER_BINARY])
+        return;
+    for (int i = 0; i < USB_REPORT_NAME_COUNT; ++i)
+        record.names[i] = USB_REPORT_NO_NAME;
+    fill_report_ids(output, &record, usb_device_info);
+    record.names[USB_REPORT_DEVPATH] = intern_report_text(output, devpath);
+    append_report(output, &record, sizeof(record));
+    ++output->report.record_count;
+}
+
+/**
+ * @brief Keeps the risk table for the footer of the report
+ *
+ * @details void print_usb_report_risk_table(
+ *             usb_output_t *output,
+ *             usb_risk_stats_stats_t *usb_risk_stats)
+ * @param output Pointer to the output
+ * @param usb_risk_stats Pointer to the structure containing aggregated risk counters
+ */
+void print_usb_report_risk_table(usb_output_t *output, usb_risk_stats_stats_t *usb_risk_stats)
+{
+    if (!output->renders[USB_RENDER_BINARY])
+        return;
+    output->report.low = usb_risk_stats->low;
+    output->report.medium = usb_risk_stats->medium;
+    output->report.major = usb_risk_stats->major;
+}
+
+/**
+ * @brief Ends a binary report: its string table, then its footer
+ *
+ * @details void end_usb_report_output(usb_output_t *output)
+ * @param output Pointer to the output
+ */
+void end_usb_report_output(usb_output_t *output)
+{
+    static const char padding[USB_REPORT_ALIGNMENT] = {0};
+    usb_report_t *report = &output->report;
+    usb_report_footer_t footer = {report->record_count, report->low, report->medium,
+        report->major, 0, 0, report->string_count, USB_REPORT_VERSION, {0}};
+    size_t padding_size = 0;
+
+    if (!output->renders[USB_RENDER_BINARY])
+        return;
+    padding_size = (USB_REPORT_ALIGNMENT - report->size % USB_REPORT_ALIGNMENT) %
+        USB_REPORT_ALIGNMENT;
+    append_report(output, padding, padding_size);
+    footer.strings_offset = report->size;
+    footer.strings_size = report->strings.size;
+    append_report(output, report->offsets, report->string_count * sizeof(uint32_t));
+    append_report(output, report->strings.data, report->strings.size);
+    padding_size = (USB_REPORT_ALIGNMENT - report->size % USB_REPORT_ALIGNMENT) %
+        USB_REPORT_ALIGNMENT;
+    append_report(output, padding, padding_size);
+    memcpy(footer.magic, USB_REPORT_MAGIC, USB_REPORT_MAGIC_SIZE);
+    append_report(output, &footer, sizeof(footer));
+}
+
+/**
+ * @brief Frees the string table of a binary report
+ *
+ * @details void free_usb_report(usb_report_t *report)
+ * @param report Pointer to the report
+ */
+void free_usb_report(usb_report_t *report)
+{
+    free(report->strings.data);
+    free(report->offsets);
+    free(report->slots);
+    *report = (usb_report_t){0};
+}
@@ -23,219 +23,290 @@
 #include <stddef.h>
 #include <systemd/sd-device.h>
 #include "druid.h"
-#include "seen_devices.h"
-
-/**
- * @brief Checks if the CLI arguments specify an output file
- *
- * Determines whether the provided arguments contain a valid output flag
- * followed by a filename.
- * 
- * @details static int check_for_output_file(cli_args_t *cli_args)
- * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
- * @return Exit code:
- *         - 0      (SUCCESS) if a valid output file is specified
- *         - -1     (UNSEEN) otherwise
- */
-static int check_for_output_file(cli_args_t *cli_args)
-{
-    if (cli_args->ac == 3 &&
-        (strcmp(cli_args->av[1], OUTPUT_FLAG) == SUCCESS ||
-        strcmp(cli_args->av[1], OUTPUT_FLAG_OPTION) == SUCCESS)
-        && cli_args->av[2] != NULL) {
-        return SUCCESS;
-    }
-    return UNSEEN;
-}
 
 /**
  * @brief Retrieves vendor and product information from a USB device
  *
- * extracts vendor ID, vendor name, product ID, and product name
- * from the current device using systemd device properties
+ * extracts vendor ID, vendor name, product ID, product name, serial number
+ * and bus-port path from an enumerated or hotplugged device using systemd
+ * device properties
  * 
- * @details static void get_vendor_product_device(
- *             usb_tools_t *usb_tools,
+ * @details void get_vendor_product_device(
+ *             sd_device *device,
  *             usb_device_info_t *usb_device_info)
- * @param usb_tools Pointer to the usb_tools_t structure containing the current device
+ * @param device Pointer to the systemd device to read
  * @param usb_device_info Pointer to the usb_device_info_t structure to store extracted data
  */
-static void get_vendor_product_device(usb_tools_t *usb_tools,
-    usb_device_info_t *usb_device_info)
+void get_vendor_product_device(sd_device *device, usb_device_info_t *usb_device_info)
 {
-    sd_device_get_property_value(usb_tools->device, VENDOR_ID,
+    sd_device_get_property_value(device, VENDOR_ID,
         &usb_device_info->vendor_id);
-    sd_device_get_property_value(usb_tools->device, VENDOR_NAME,
+    sd_device_get_property_value(device, VENDOR_NAME,
         &usb_device_info->vendor_name);
-    sd_device_get_property_value(usb_tools->device, PRODUCT_ID,
+    sd_device_get_property_value(device, PRODUCT_ID,
         &usb_device_info->product_id);
-    sd_device_get_property_value(usb_tools->device, PRODUCT_NAME,
+    sd_device_get_property_value(device, PRODUCT_NAME,
         &usb_device_info->product_name);
+    sd_device_get_property_value(device, SERIAL_NUMBER,
+        &usb_device_info->serial);
+    sd_device_get_sysname(device, &usb_device_info->path_usb);
 }
 
 /**
- * @brief Checks if the current USB device has already been processed
+ * @brief Checks if a connected USB device exists in the known database
  *
- * compares the current device's vendor and product IDs
- * against the list of already seen devices to avoid redundant processing
+ * looks up the vendor and product IDs of the current USB device
+ * in the database hash index, decodes the names of the matching entry
+ * and updates the risk statistics accordingly based on match level
+ * (full, partial, or unknown), then records the device as seen and,
+ * with --metrics-file, its vendor and classification latency
  * 
- * @details static int check_already_seen(
- *             usb_tools_t *usb_tools,
+ * @details int check_usb_exist(
+ *             usb_db_t *usb_db,
  *             usb_device_info_t *usb_device_info,
- *             size_t seen_count,
- *             bool already_seen)
- * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output)
+ * @param usb_db Pointer to the usb_db_t structure containing loaded database entries
  * @param usb_device_info Pointer to the usb_device_info_t structure containing current device info
- * @param seen_count Number of devices already processed
- * @param already_seen Boolean flag to indicate if the device was already seen
- * @return Exit code:
- *         - 0      (EXIT_SUCCESS) if the device was already processed
- *         - -1     (UNSEEN) if the device was not yet seen
+ * @param usb_risk_stats Pointer to the usb_risk_stats_stats_t structure to update statistics
+ * @param output Pointer to the output the device is rendered to
+ * @return The risk the device was given (MATCH_*)
  */
-static int check_already_seen(usb_tools_t *usb_tools,
-    usb_device_info_t *usb_device_info, size_t seen_count, bool already_seen)
+int check_usb_exist(usb_db_t *usb_db, usb_device_info_t *usb_device_info,
+    usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output)
 {
-    for (size_t k = 0; k < seen_count; ++k) {
-        if (strcmp(usb_device_info->vendor_id, seen_devices[k].vendor_id) == SUCCESS &&
-            strcmp(usb_device_info->product_id, seen_devices[k].product_id) == SUCCESS) {
-            already_seen = true;
-            break;
-        }
-    }
-    if (already_seen == true) {
-        usb_tools->device = sd_device_enumerator_get_device_next(
-            usb_tools->enumerator);
-        return EXIT_SUCCESS;
+    double start = usb_risk_stats->metrics != NULL ? get_usb_metrics_clock() : 0;
+    usb_db_match_t usb_db_match = {NULL, 0};
+    usb_db_names_t usb_db_names = {0};
+    int match = lookup_usb_db_index(usb_db, usb_device_info, &usb_db_match);
+
+    if (match == MATCH_NONE)
+        init_struct_unknown_usb_db_names(&usb_db_names);
+    else
+        decode_usb_db_entry(usb_db_match.usb_db, usb_db_match.row, &usb_db_names);
+    if (match == MATCH_VENDOR_AND_PRODUCT) {
+        display_known_usb_device(usb_device_info, &usb_db_names, usb_risk_stats, output);
+    } else if (match == MATCH_VENDOR_ONLY) {
+        display_partially_known_usb_device(usb_device_info, &usb_db_names, usb_risk_stats, output);
+    } else {
+        display_unknown_usb_device(usb_device_info, &usb_db_names, usb_risk_stats, output);
     }
-    return UNSEEN;
+    add_usb_seen(&usb_risk_stats->seen, usb_device_info);
+    ++usb_risk_stats->seen_count;
+    observe_usb_classification(usb_risk_stats->metrics, usb_device_info, start);
+    return match;
 }
 
 /**
- * @brief Adds the current USB device to the list of seen devices
+ * @brief Classifies every USB device currently connected
  *
- * Stores the vendor and product IDs of the current USB device
- * into a global list if the maximum device limit has not been reached
- * (limit has been set to 128 devices).
- * 
- * @details static void add_to_seen(
+ * walks the enumeration backend once, building the usb tree on the way
+ * (hub depth of each device) and skipping interfaces, devices without
+ * ids and devices already classified (same vendor and product IDs, or
+ * same bus-port path in per-port mode)
+ *
+ * @details void scan_usb_devices(
+ *             usb_db_t *usb_db,
+ *             usb_tools_t *usb_tools,
  *             usb_device_info_t *usb_device_info,
- *             size_t *seen_count)
- * @param usb_device_info Pointer to the usb_device_info_t structure containing current device info
- * @param seen_count Pointer to the current count of seen devices (incremented if added)
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output)
+ * @param usb_db Pointer to the loaded database
+ * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
+ * @param usb_device_info Pointer to the usb_device_info_t structure for storing device info
+ * @param usb_risk_stats Pointer to the risk statistics to update
+ * @param output Pointer to the output the devices are rendered to
  */
-static void add_to_seen(usb_device_info_t *usb_device_info, size_t *seen_count)
+void scan_usb_devices(usb_db_t *usb_db, usb_tools_t *usb_tools,
+    usb_device_info_t *usb_device_info, usb_risk_stats_stats_t *usb_risk_stats,
+    usb_output_t *output)
 {
-    if (*seen_count < MAX_SEEN_DEVICES) {
-        seen_devices[*seen_count].vendor_id = strdup(usb_device_info->vendor_id);
-        seen_devices[*seen_count].product_id = strdup(usb_device_info->product_id);
-        ++(*seen_count);
+    usb_topology_t usb_topology = {0};
+    int status = UNSEEN;
+
+    begin_usb_metrics_walk(usb_risk_stats->metrics);
+    status = first_usb_device(usb_tools, usb_device_info);
+    for (; status == SUCCESS; status = next_usb_device(usb_tools, usb_device_info)) {
+        if (add_usb_topology_node(&usb_topology, usb_device_info) == USB_NODE_INTERFACE ||
+            usb_device_info->vendor_id == NULL || usb_device_info->product_id == NULL ||
+            check_usb_seen(&usb_risk_stats->seen, usb_device_info) == SUCCESS)
+            continue;
+        check_usb_exist(usb_db, usb_device_info, usb_risk_stats, output);
     }
+    end_usb_metrics_walk(usb_risk_stats->metrics);
+    free_usb_topology(&usb_topology);
 }
 
 /**
- * @brief Checks if a connected USB device exists in the known database
+ * @brief Classifies the devices kept while the database was loading
  *
- * compares the vendor and product IDs of the current USB device
- * against the loaded USB database and updates the risk statistics
- * accordingly based on match level (full, partial, or unknown)
- * 
- * @details static void check_usb_exist(
- *             usb_db_t *usb_db,
- *             usb_db_entry_t *usb_db_entry,
+ * @details static bool classify_pending_devices(
+ *             usb_db_loader_t *loader,
+ *             usb_device_records_t *pending,
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output,
+ *             bool wait)
+ * @param loader Pointer to the started database loader
+ * @param pending Pointer to the devices kept so far, emptied once classified
+ * @param usb_risk_stats Pointer to the risk statistics to update
+ * @param output Pointer to the output the devices are rendered to
+ * @param wait Whether to wait for the end of the load
+ * @return true if the database is ready (pending devices are classified),
+ *         false while it is loading or if its load failed
+ */
+static bool classify_pending_devices(usb_db_loader_t *loader, usb_device_records_t *pending,
+    usb_risk_stats_stats_t *usb_risk_stats, usb_output_t *output, bool wait)
+{
+    usb_device_info_t usb_device_info = {0};
+
+    init_struct_usb_device_info(&usb_device_info);
+    if (wait ? wait_usb_db_loader(loader) == EXIT_ERROR : !check_usb_db_loader(loader))
+        return false;
+    for (size_t i = 0; i < pending->count; ++i) {
+        get_usb_device_record(pending, i, &usb_device_info);
+        check_usb_exist(loader->usb_db, &usb_device_info, usb_risk_stats, output);
+    }
+    free_usb_device_records(pending);
+    return true;
+}
+
+/**
+ * @brief Classifies every USB device while the database is still loading
+ *
+ * same walk as scan_usb_devices, but devices met before the loader has
+ * published the index are kept (deduplicated) and classified, in order,
+ * as soon as it is: the enumeration overlaps the load instead of
+ * following it; if a device cannot be kept the scan waits for the load
+ *
+ * @details static int scan_usb_devices_pipelined(
+ *             usb_db_loader_t *loader,
+ *             usb_tools_t *usb_tools,
  *             usb_device_info_t *usb_device_info,
- *             usb_risk_stats_stats_t *usb_risk_stats)
- * @param usb_db Pointer to the usb_db_t structure containing loaded database entries
- * @param usb_db_entry Pointer to a reusable usb_db_entry_t structure (for matches)
- * @param usb_device_info Pointer to the usb_device_info_t structure containing current device info
- * @param usb_risk_stats Pointer to the usb_risk_stats_stats_t structure to update statistics
- * @param output_file Pointer to the FILE object where device information will be logged
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             usb_output_t *output)
+ * @param loader Pointer to the started database loader
+ * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
+ * @param usb_device_info Pointer to the usb_device_info_t structure for storing device info
+ * @param usb_risk_stats Pointer to the risk statistics to update
+ * @param output Pointer to the output the devices are rendered to
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) when every device is classified
+ *         - 84     (EXIT_ERROR) if database loading fails
  */
-static void check_usb_exist(usb_db_t *usb_db, usb_db_entry_t *usb_db_entry,
+static int scan_usb_devices_pipelined(usb_db_loader_t *loader, usb_tools_t *usb_tools,
     usb_device_info_t *usb_device_info, usb_risk_stats_stats_t *usb_risk_stats,
-    FILE *output_file)
+    usb_output_t *output)
 {
-    bool match_vendor_and_product = false;
-    bool match_vendor_only = false;
-    usb_db_entry_t *matching_entry = NULL;
-    usb_db_entry_t unknown = {0};
+    usb_topology_t usb_topology = {0};
+    usb_device_records_t pending = {0};
+    bool ready = false;
+    int status = UNSEEN;
 
-    for (size_t i = 0; i < usb_db->count; ++i) {
-        usb_db_entry = &usb_db->entries[i];
-        if (strcmp(usb_device_info->vendor_id, usb_db_entry->vendor_id) == SUCCESS) {
-            if (strcmp(usb_device_info->product_id, usb_db_entry->product_id) == SUCCESS) {
-                match_vendor_and_product = true;
-                matching_entry = usb_db_entry;
-                break;
-            } else if (matching_entry == NULL) {
-                match_vendor_only = true;
-                matching_entry = usb_db_entry;
-            }
+    begin_usb_metrics_walk(usb_risk_stats->metrics);
+    status = first_usb_device(usb_tools, usb_device_info);
+    for (; status == SUCCESS; status = next_usb_device(usb_tools, usb_device_info)) {
+        if (add_usb_topology_node(&usb_topology, usb_device_info) == USB_NODE_INTERFACE ||
+            usb_device_info->vendor_id == NULL || usb_device_info->product_id == NULL ||
+            check_usb_seen(&usb_risk_stats->seen, usb_device_info) == SUCCESS)
+            continue;
+        if (!ready)
+            ready = classify_pending_devices(loader, &pending, usb_risk_stats, output, false);
+        if (!ready && add_usb_device_record(&pending, usb_device_info) == EXIT_SUCCESS) {
+            add_usb_seen(&usb_risk_stats->seen, usb_device_info);
+            continue;
         }
+        if (!ready && !(ready = classify_pending_devices(loader, &pending,
+            usb_risk_stats, output, true)))
+            break;
+        check_usb_exist(loader->usb_db, usb_device_info, usb_risk_stats, output);
     }
-    if (match_vendor_and_product == true) {
-        display_known_usb_device(usb_device_info, matching_entry, usb_risk_stats, output_file);
-    } else if (match_vendor_only == true) {
-        display_partially_known_usb_device(usb_device_info, matching_entry, usb_risk_stats, output_file);
-    } else {
-        init_struct_unknown_usb_db_entry(&unknown);
-        display_unknown_usb_device(usb_device_info, &unknown, usb_risk_stats, output_file);
-        free_unknown_usb_db_entry(&unknown);
-    }
-    add_to_seen(usb_device_info, &usb_risk_stats->seen_count);
+    end_usb_metrics_walk(usb_risk_stats->metrics);
+    free_usb_topology(&usb_topology);
+    if (!ready)
+        ready = classify_pending_devices(loader, &pending, usb_risk_stats, output, true);
+    free_usb_device_records(&pending);
+    return ready ? EXIT_SUCCESS : EXIT_ERROR;
+}
+
+/**
+ * @brief Opens where a scan goes: the output, the journal and the metrics
+ *
+ * @details static int open_scan_outputs(
+ *             usb_output_t *output,
+ *             usb_metrics_t *metrics,
+ *             usb_risk_stats_stats_t *usb_risk_stats,
+ *             cli_args_t *cli_args)
+ * @param output Pointer to the output to open
+ * @param metrics Pointer to the metrics to prepare if --metrics-file is given
+ * @param usb_risk_stats Pointer to the risk statistics, which collect the metrics
+ * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the output file cannot be created or memory allocation fails
+ */
+static int open_scan_outputs(usb_output_t *output, usb_metrics_t *metrics,
+    usb_risk_stats_stats_t *usb_risk_stats, cli_args_t *cli_args)
+{
+    if (open_usb_output(output, cli_args->output_path, cli_args->output_format) == EXIT_ERROR)
+        return EXIT_ERROR;
+    if (cli_args->journal)
+        open_usb_journal(output, false);
+    if (cli_args->metrics_path == NULL)
+        return EXIT_SUCCESS;
+    usb_risk_stats->metrics = metrics;
+    return open_usb_metrics(metrics, cli_args->metrics_path);
 }
 
 /**
  * @brief Scans connected USB devices and checks for potential risks
  *
- * loads the USB database from file, iterates through connected USB devices,
- * compares each device against the database, and updates risk statistics
+ * loads the USB database on a background thread while the connected USB
+ * devices are enumerated, compares each device against the database as
+ * soon as it is indexed, and updates risk statistics; the metrics file,
+ * if any, is written once the risk table is
  * 
  * @details int scan_connected_usb_and_check_risks(
  *             usb_tools_t *usb_tools,
  *             usb_device_info_t *usb_device_info,
- *             usb_db_entry_t *usb_db_entry,
  *             cli_args_t *cli_args)
  * @param usb_tools Pointer to the usb_tools_t structure used for device enumeration
  * @param usb_device_info Pointer to the usb_device_info_t structure for storing device info
- * @param usb_db_entry Pointer to the usb_db_entry_t structure for matching database entries
  * @param cli_args Pointer to the cli_args_t structure containing CLI arguments
  * @return Exit code:
  *         - 0      (EXIT_SUCCESS) when scanning and risk checking complete
- *         - 84     (EXIT_ERROR) if database loading fails
+ *         - 84     (EXIT_ERROR) if database loading fails or the output cannot be written
  */
 int scan_connected_usb_and_check_risks(usb_tools_t *usb_tools, usb_device_info_t *usb_device_info,
-    usb_db_entry_t *usb_db_entry, cli_args_t *cli_args)
+    cli_args_t *cli_args)
 {
     usb_db_t usb_db = {0};
+    usb_db_loader_t loader = {0};
     usb_risk_stats_stats_t usb_risk_stats = {0};
-    bool already_seen = false;
-    FILE *output_file = NULL;
+    usb_output_t output = {0};
+    usb_metrics_t metrics = {0};
+    int result = EXIT_ERROR;
 
-    if (check_for_output_file(cli_args) == SUCCESS) {
-        output_file = fopen(cli_args->av[2], OPEN_READ_WRITE_MODE);
-        if (output_file == NULL)
-            return EXIT_ERROR;
-    }
-    if (load_usb_db_from_file(&usb_db, usb_db_entry, cli_args) == EXIT_ERROR) {
-        free_usb_db(&usb_db);
-        if (output_file != NULL)
-            fclose(output_file);
+    loader.usb_db = &usb_db;
+    loader.cli_args = cli_args;
+    usb_risk_stats.seen.per_port = cli_args->per_port;
+    if (open_scan_outputs(&output, &metrics, &usb_risk_stats, cli_args) == EXIT_ERROR) {
+        close_usb_metrics(&metrics);
+        close_usb_output(&output);
         return EXIT_ERROR;
     }
-    usb_tools->device = sd_device_enumerator_get_device_first(
-        usb_tools->enumerator);
-    while (usb_tools->device != NULL) {
-        already_seen = false;
-        get_vendor_product_device(usb_tools, usb_device_info);
-        if (check_already_seen(usb_tools, usb_device_info, usb_risk_stats.seen_count, already_seen) == SUCCESS)
-            continue;
-        check_usb_exist(&usb_db, usb_db_entry, usb_device_info, &usb_risk_stats, output_file);
-        usb_tools->device = sd_device_enumerator_get_device_next(
-            usb_tools->enumerator);
-    }
+    if (start_usb_db_loader(&loader) == EXIT_SUCCESS)
+        result = scan_usb_devices_pipelined(&loader, usb_tools, usb_device_info,
+            &usb_risk_stats, &output);
+    wait_usb_db_loader(&loader);
+    set_usb_metrics_db(usb_risk_stats.metrics, &usb_db, loader.seconds);
     free_usb_db(&usb_db);
-    display_risk_table(&usb_risk_stats, output_file);
-    if (output_file != NULL)
-        fclose(output_file);
-    return EXIT_SUCCESS;
+    if (result == EXIT_SUCCESS) {
+        display_risk_table(&usb_risk_stats, &output);
+        result = write_usb_metrics(usb_risk_stats.metrics, &usb_risk_stats);
+    }
+    free_usb_seen_set(&usb_risk_stats.seen);
+    close_usb_metrics(&metrics);
+    if (close_usb_output(&output) == EXIT_ERROR)
+        return EXIT_ERROR;
+    return result;
 }
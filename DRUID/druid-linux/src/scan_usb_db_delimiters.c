@@ -0,0 +1,169 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file scan_usb_db_delimiters.c
+ * @brief finds csv field and line separators a whole block at a time
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define HAS_X86_SCAN_KERNELS
+#endif
+
+/**
+ * @brief Portable delimiter scan, one byte at a time
+ *
+ * reference kernel used on CPUs without SSE2/AVX2 and on other
+ * architectures; the vector kernels must return the same masks
+ *
+ * @details static usb_db_delimiters_t scan_block_scalar(const char *block)
+ * @param block SCAN_BLOCK_SIZE readable bytes
+ * @return Bit i of fields/lines is set when block[i] is ';' / '\n'
+ */
+static usb_db_delimiters_t scan_block_scalar(const char *block)
+{
+    usb_db_delimiters_t delimiters = {0, 0};
+
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; ++i) {
+        if (block[i] == FIELD_SEPARATOR)
+            delimiters.fields |= (uint64_t)1 << i;
+        else if (block[i] == LINE_SEPARATOR)
+            delimiters.lines |= (uint64_t)1 << i;
+    }
+    return delimiters;
+}
+
+#ifdef HAS_X86_SCAN_KERNELS
+
+/**
+ * @brief SSE2 delimiter scan, 16 bytes per compare
+ *
+ * @details static usb_db_delimiters_t scan_block_sse2(const char *block)
+ * @param block SCAN_BLOCK_SIZE readable bytes (no alignment required)
+ * @return Bit i of fields/lines is set when block[i] is ';' / '\n'
+ */
+__attribute__((target("sse2")))
+static usb_db_delimiters_t scan_block_sse2(const char *block)
+{
+    const __m128i field = _mm_set1_epi8(FIELD_SEPARATOR);
+    const __m128i line = _mm_set1_epi8(LINE_SEPARATOR);
+    usb_db_delimiters_t delimiters = {0, 0};
+    __m128i chunk;
+
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += sizeof(__m128i)) {
+        chunk = _mm_loadu_si128((const __m128i *)(block + i));
+        delimiters.fields |= (uint64_t)(uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, field)) << i;
+        delimiters.lines |= (uint64_t)(uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, line)) << i;
+    }
+    return delimiters;
+}
+
+/**
+ * @brief AVX2 delimiter scan, 32 bytes per compare
+ *
+ * @details static usb_db_delimiters_t scan_block_avx2(const char *block)
+ * @param block SCAN_BLOCK_SIZE readable bytes (no alignment required)
+ * @return Bit i of fields/lines is set when block[i] is ';' / '\n'
+ */
+__attribute__((target("avx2")))
+static usb_db_delimiters_t scan_block_avx2(const char *block)
+{
+    const __m256i field = _mm256_set1_epi8(FIELD_SEPARATOR);
+    const __m256i line = _mm256_set1_epi8(LINE_SEPARATOR);
+    usb_db_delimiters_t delimiters = {0, 0};
+    __m256i chunk;
+
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += sizeof(__m256i)) {
+        chunk = _mm256_loadu_si256((const __m256i *)(block + i));
+        delimiters.fields |= (uint64_t)(uint32_t)
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, field)) << i;
+        delimiters.lines |= (uint64_t)(uint32_t)
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, line)) << i;
+    }
+    return delimiters;
+}
+
+#endif
+
+/**
+ * @brief Returns one delimiter scan kernel, if the running CPU has it
+ *
+ * @details usb_db_scan_block_t get_usb_db_scan_kernel(int kernel)
+ * @param kernel SCAN_KERNEL_SCALAR, SCAN_KERNEL_SSE2 or SCAN_KERNEL_AVX2
+ * @return The kernel, or NULL if this CPU or architecture lacks it
+ */
+usb_db_scan_block_t get_usb_db_scan_kernel(int kernel)
+{
+#ifdef HAS_X86_SCAN_KERNELS
+    __builtin_cpu_init();
+    if (kernel == SCAN_KERNEL_AVX2)
+        return __builtin_cpu_supports("avx2") ? scan_block_avx2 : NULL;
+    if (kernel == SCAN_KERNEL_SSE2)
+        return __builtin_cpu_supports("sse2") ? scan_block_sse2 : NULL;
+#endif
+    return kernel == SCAN_KERNEL_SCALAR ? scan_block_scalar : NULL;
+}
+
+/**
+ * @brief Picks the fastest delimiter scan kernel for the running CPU
+ *
+ * the choice is made at run time, so one binary uses AVX2 where it is
+ * available and still runs on older or non-x86 machines
+ *
+ * @details usb_db_scan_block_t select_usb_db_scan_block(void)
+ * @return The AVX2, SSE2 or scalar kernel
+ */
+usb_db_scan_block_t select_usb_db_scan_block(void)
+{
+    usb_db_scan_block_t scan_block = NULL;
+
+    for (int kernel = SCAN_KERNEL_COUNT - 1; scan_block == NULL; --kernel)
+        scan_block = get_usb_db_scan_kernel(kernel);
+    return scan_block;
+}
+
+/**
+ * @brief Scans the block starting at pos, padding past the end of a file
+ *
+ * the last block of a file is copied into a zeroed buffer so the kernel
+ * never reads beyond the file (the next file may follow in the region)
+ *
+ * @details usb_db_delimiters_t scan_usb_db_block(
+ *             usb_db_scan_block_t scan_block,
+ *             const char *pos,
+ *             const char *end)
+ * @param scan_block Kernel returned by select_usb_db_scan_block
+ * @param pos First byte of the block
+ * @param end End of the file being scanned
+ * @return Delimiter masks of the block, bits past end are cleared
+ */
+usb_db_delimiters_t scan_usb_db_block(usb_db_scan_block_t scan_block,
+    const char *pos, const char *end)
+{
+    char tail[SCAN_BLOCK_SIZE] = {0};
+
+    if ((size_t)(end - pos) >= SCAN_BLOCK_SIZE)
+        return scan_block(pos);
+    for (size_t i = 0; pos + i < end; ++i)
+        tail[i] = pos[i];
+    return scan_block(tail);
+}
@@ -0,0 +1,240 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file seen_usb_devices.c
+ * @brief set of the usb devices already classified during a scan
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Folds a string into a FNV-1a hash
+ *
+ * @details static uint64_t hash_seen_string(uint64_t hash, const char *str)
+ * @param hash Hash so far
+ * @param str Null-terminated string to fold
+ * @return The updated hash
+ */
+static uint64_t hash_seen_string(uint64_t hash, const char *str)
+{
+    for (; *str != '\0'; ++str) {
+        hash ^= (unsigned char)*str;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Computes the set key of a device
+ *
+ * hexadecimal ids are packed (vid << 16 | pid) and tagged with
+ * SEEN_KEY_ID; in per-port mode the bus-port path is hashed instead,
+ * and ids that are not hexadecimal are hashed as strings; hashed keys
+ * carry SEEN_KEY_HASH, so no key is 0 (the empty slot)
+ *
+ * @details uint64_t get_usb_seen_key(
+ *             usb_seen_set_t *seen,
+ *             usb_device_info_t *usb_device_info)
+ * @param seen Pointer to the set (gives the mode)
+ * @param usb_device_info Pointer to the device, with non-NULL ids
+ * @return The key of the device
+ */
+uint64_t get_usb_seen_key(usb_seen_set_t *seen, usb_device_info_t *usb_device_info)
+{
+    uint16_t vendor_id = 0;
+    uint16_t product_id = 0;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    if (seen->per_port && usb_device_info->path_usb != NULL)
+        return hash_seen_string(hash, usb_device_info->path_usb) | SEEN_KEY_HASH;
+    if (parse_usb_id(usb_device_info->vendor_id, &vendor_id) == SUCCESS &&
+        parse_usb_id(usb_device_info->product_id, &product_id) == SUCCESS)
+        return SEEN_KEY_ID | ((uint64_t)vendor_id << 16) | product_id;
+    hash = hash_seen_string(hash, usb_device_info->vendor_id);
+    hash = hash_seen_string(hash ^ FIELD_SEPARATOR, usb_device_info->product_id);
+    return hash | SEEN_KEY_HASH;
+}
+
+/**
+ * @brief Scrambles a key into a slot position (splitmix64 finalizer)
+ *
+ * @details static size_t hash_seen_key(uint64_t key, size_t mask)
+ * @param key Set key
+ * @param mask Table size minus one (table size is a power of two)
+ * @return Starting slot position for the key
+ */
+static size_t hash_seen_key(uint64_t key, size_t mask)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key & mask;
+}
+
+/**
+ * @brief Finds the slot of a key, or the empty slot where it belongs
+ *
+ * @details static uint64_t *find_seen_slot(
+ *             uint64_t *keys,
+ *             size_t mask,
+ *             uint64_t key)
+ * @param keys Table to search
+ * @param mask Table size minus one
+ * @param key Set key
+ * @return Pointer to the slot holding the key or to an empty slot
+ */
+static uint64_t *find_seen_slot(uint64_t *keys, size_t mask, uint64_t key)
+{
+    size_t pos = hash_seen_key(key, mask);
+
+    while (keys[pos] != 0 && keys[pos] != key)
+        pos = (pos + 1) & mask;
+    return &keys[pos];
+}
+
+/**
+ * @brief Doubles the table (or allocates the first one) and rehashes it
+ *
+ * @details static int grow_seen_set(usb_seen_set_t *seen)
+ * @param seen Pointer to the set
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if memory allocation fails (the set is kept)
+ */
+static int grow_seen_set(usb_seen_set_t *seen)
+{
+    size_t size = seen->keys != NULL ? (seen->mask + 1) * INCREASED_SIZE : SEEN_SET_SIZE;
+    uint64_t *keys = calloc(size, sizeof(uint64_t));
+
+    if (keys == NULL)
+        return EXIT_ERROR;
+    for (size_t i = 0; seen->keys != NULL && i <= seen->mask; ++i) {
+        if (seen->keys[i] != 0)
+            *find_seen_slot(keys, size - 1, seen->keys[i]) = seen->keys[i];
+    }
+    free(seen->keys);
+    seen->keys = keys;
+    seen->mask = size - 1;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Checks if a device has already been classified
+ *
+ * @details int check_usb_seen(
+ *             usb_seen_set_t *seen,
+ *             usb_device_info_t *usb_device_info)
+ * @param seen Pointer to the set
+ * @param usb_device_info Pointer to the device, with non-NULL ids
+ * @return Exit code:
+ *         - 0      (SUCCESS) if the device is in the set
+ *         - -1     (UNSEEN) otherwise
+ */
+int check_usb_seen(usb_seen_set_t *seen, usb_device_info_t *usb_device_info)
+{
+    if (seen->keys == NULL)
+        return UNSEEN;
+    if (*find_seen_slot(seen->keys, seen->mask, get_usb_seen_key(seen, usb_device_info)) == 0)
+        return UNSEEN;
+    return SUCCESS;
+}
+
+/**
+ * @brief Adds a device to the set
+ *
+ * the table is kept at most half full so probes stay short, and grows
+ * without limit
+ *
+ * @details int add_usb_seen(
+ *             usb_seen_set_t *seen,
+ *             usb_device_info_t *usb_device_info)
+ * @param seen Pointer to the set
+ * @param usb_device_info Pointer to the device, with non-NULL ids
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) if the device is in the set
+ *         - 84     (EXIT_ERROR) if memory allocation fails
+ */
+int add_usb_seen(usb_seen_set_t *seen, usb_device_info_t *usb_device_info)
+{
+    uint64_t key = get_usb_seen_key(seen, usb_device_info);
+    uint64_t *slot = NULL;
+
+    if (seen->keys == NULL || (seen->count + 1) * INDEX_LOAD_FACTOR > seen->mask + 1) {
+        if (grow_seen_set(seen) == EXIT_ERROR)
+            return EXIT_ERROR;
+    }
+    slot = find_seen_slot(seen->keys, seen->mask, key);
+    if (*slot == 0) {
+        *slot = key;
+        ++seen->count;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Removes a key from the set
+ *
+ * the keys that follow in the same probe run are shifted back into the
+ * freed slot when their own run starts at or before it, so no probe
+ * stops early on the hole
+ *
+ * @details void remove_usb_seen_key(usb_seen_set_t *seen, uint64_t key)
+ * @param seen Pointer to the set
+ * @param key Key of the device, as given by get_usb_seen_key
+ */
+void remove_usb_seen_key(usb_seen_set_t *seen, uint64_t key)
+{
+    uint64_t *slot = NULL;
+    size_t hole = 0;
+    size_t home = 0;
+
+    if (seen->keys == NULL)
+        return;
+    slot = find_seen_slot(seen->keys, seen->mask, key);
+    if (*slot == 0)
+        return;
+    hole = (size_t)(slot - seen->keys);
+    for (size_t pos = (hole + 1) & seen->mask; seen->keys[pos] != 0;
+        pos = (pos + 1) & seen->mask) {
+        home = hash_seen_key(seen->keys[pos], seen->mask);
+        if (((pos - home) & seen->mask) >= ((pos - hole) & seen->mask)) {
+            seen->keys[hole] = seen->keys[pos];
+            hole = pos;
+        }
+    }
+    seen->keys[hole] = 0;
+    --seen->count;
+}
+
+/**
+ * @brief Frees the table of the set
+ *
+ * @details void free_usb_seen_set(usb_seen_set_t *seen)
+ * @param seen Pointer to the set (may never have been filled)
+ */
+void free_usb_seen_set(usb_seen_set_t *seen)
+{
+    free(seen->keys);
+    seen->keys = NULL;
+    seen->count = 0;
+    seen->mask = 0;
+}
@@ -0,0 +1,361 @@
+/**
+ * @name druid (Detection Rogue USB and Illegitimate Devices)
+ * @version 1.0
+ * @author Sacha Lemée
+ * @author Fujitsu Technology Solutions
+ * @file serve_usb_lookups.c
+ * @brief event loop of druidd: serves lookups from a resident database over a unix socket
+ * @date 17 July 2025
+ * @copyright Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED)
+ *
+ * This file is part of the "druid" repository.
+ *
+ * You can use, modify, and distribute this code under the terms of the
+ * Creative Commons Attribution-ShareAlike 4.0 International License (CC BY-SA 4.0 DEED).
+ * See the full license at: https://creativecommons.org/licenses/by-sa/4.0/deed.fr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <systemd/sd-device.h>
+#include "druid.h"
+
+/**
+ * @brief Gives the path of the druidd socket
+ *
+ * @details const char *get_usb_lookup_socket_path(void)
+ * @return The DRUID_SOCKET environment variable if set, DRUIDD_SOCKET_PATH otherwise
+ */
+const char *get_usb_lookup_socket_path(void)
+{
+    const char *path = getenv(DRUIDD_SOCKET_ENV);
+
+    return path != NULL && path[0] != '\0' ? path : DRUIDD_SOCKET_PATH;
+}
+
+/**
+ * @brief Creates the listening socket of druidd
+ *
+ * a socket file left by a druidd that died is replaced, but not the
+ * socket of a druidd still accepting connections; anything else at the
+ * path (the path comes from the environment) is never removed, so the
+ * bind fails on it
+ *
+ * @details static int open_lookup_socket(const char *path)
+ * @param path Path of the socket
+ * @return The listening descriptor, or -1 on error
+ */
+static int open_lookup_socket(const char *path)
+{
+    struct sockaddr_un address = {0};
+    struct stat st = {0};
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int fd = -1;
+
+    if (probe < 0 || strlen(path) >= sizeof(address.sun_path)) {
+        close(probe);
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (connect(probe, (struct sockaddr *)&address, sizeof(address)) == SUCCESS) {
+        close(probe);
+        return -1;
+    }
+    if (errno == ECONNREFUSED && lstat(path, &st) == SUCCESS && S_ISSOCK(st.st_mode))
+        unlink(path);
+    close(probe);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != SUCCESS ||
+        listen(fd, DRUIDD_BACKLOG) != SUCCESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Registers a descriptor in the epoll instance of the server
+ *
+ * @details static int watch_lookup_fd(
+ *             usb_lookup_server_t *server,
+ *             int fd,
+ *             uint32_t events,
+ *             void *ptr)
+ * @param server Pointer to the server
+ * @param fd Descriptor to watch
+ * @param events Events to wait for
+ * @param ptr Pointer given back with the events (starts with the descriptor)
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if epoll refuses the descriptor
+ */
+static int watch_lookup_fd(usb_lookup_server_t *server, int fd, uint32_t events, void *ptr)
+{
+    struct epoll_event event = {0};
+
+    event.events = events;
+    event.data.ptr = ptr;
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) == SUCCESS ?
+        EXIT_SUCCESS : EXIT_ERROR;
+}
+
+/**
+ * @brief Closes a connection and forgets its client
+ *
+ * @details static void close_lookup_client(
+ *             usb_lookup_server_t *server,
+ *             usb_lookup_client_t *client)
+ * @param server Pointer to the server
+ * @param client Pointer to the client to close
+ */
+static void close_lookup_client(usb_lookup_server_t *server, usb_lookup_client_t *client)
+{
+    if (client->prev != NULL)
+        client->prev->next = client->next;
+    else
+        server->clients = client->next;
+    if (client->next != NULL)
+        client->next->prev = client->prev;
+    close(client->fd);
+    free(client->input);
+    free(client->output.data);
+    free(client);
+}
+
+/**
+ * @brief Accepts every pending connection
+ *
+ * @details static void accept_lookup_clients(usb_lookup_server_t *server)
+ * @param server Pointer to the server
+ */
+static void accept_lookup_clients(usb_lookup_server_t *server)
+{
+    usb_lookup_client_t *client = NULL;
+    int fd = -1;
+
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+        client = calloc(1, sizeof(usb_lookup_client_t));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->input = malloc(DRUIDD_INPUT_SIZE);
+        client->events = EPOLLIN;
+        client->next = server->clients;
+        if (server->clients != NULL)
+            server->clients->prev = client;
+        server->clients = client;
+        if (client->input == NULL ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 ||
+            fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ||
+            watch_lookup_fd(server, fd, client->events, client) == EXIT_ERROR)
+            close_lookup_client(server, client);
+    }
+}
+
+/**
+ * @brief Sends the replies of a client as far as its socket accepts them
+ *
+ * while replies are left the client is only watched for writing: its
+ * next requests wait in the socket, so a client that does not read its
+ * replies cannot make the server buffer without bound
+ *
+ * @details static int flush_lookup_client(
+ *             usb_lookup_server_t *server,
+ *             usb_lookup_client_t *client)
+ * @param server Pointer to the server
+ * @param client Pointer to the client
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success (replies may be left)
+ *         - 84     (EXIT_ERROR) if the connection is broken
+ */
+static int flush_lookup_client(usb_lookup_server_t *server, usb_lookup_client_t *client)
+{
+    struct epoll_event event = {0};
+    ssize_t written = 0;
+
+    while (client->output_sent < client->output.size) {
+        written = send(client->fd, client->output.data + client->output_sent,
+            client->output.size - client->output_sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (written < 0)
+            return EXIT_ERROR;
+        client->output_sent += written;
+    }
+    if (client->output_sent == client->output.size) {
+        client->output.size = 0;
+        client->output_sent = 0;
+    }
+    event.events = client->output.size > 0 ? EPOLLOUT : EPOLLIN;
+    event.data.ptr = client;
+    if (event.events == client->events)
+        return EXIT_SUCCESS;
+    client->events = event.events;
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) == SUCCESS ?
+        EXIT_SUCCESS : EXIT_ERROR;
+}
+
+/**
+ * @brief Reads what a client sent, answers it and sends the replies
+ *
+ * @details static int read_lookup_client(
+ *             usb_lookup_server_t *server,
+ *             usb_lookup_client_t *client)
+ * @param server Pointer to the server
+ * @param client Pointer to the client
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) if the connection is closed or broken
+ */
+static int read_lookup_client(usb_lookup_server_t *server, usb_lookup_client_t *client)
+{
+    ssize_t received = read(client->fd, client->input + client->input_size,
+        DRUIDD_INPUT_SIZE - client->input_size);
+
+    if (received < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ?
+            EXIT_SUCCESS : EXIT_ERROR;
+    if (received == 0)
+        return EXIT_ERROR;
+    client->input_size += received;
+    if (answer_usb_lookup_requests(server, client) == EXIT_ERROR)
+        return EXIT_ERROR;
+    return flush_lookup_client(server, client);
+}
+
+/**
+ * @brief Handles the events of one epoll wait
+ *
+ * @details static void dispatch_lookup_events(
+ *             usb_lookup_server_t *server,
+ *             struct epoll_event *events,
+ *             int count)
+ * @param server Pointer to the server
+ * @param events Ready descriptors
+ * @param count Number of ready descriptors
+ */
+static void dispatch_lookup_events(usb_lookup_server_t *server, struct epoll_event *events,
+    int count)
+{
+    usb_lookup_client_t *client = NULL;
+    int status = EXIT_SUCCESS;
+
+    for (int i = 0; i < count; ++i) {
+        if (events[i].data.ptr == &server->listen_fd) {
+            accept_lookup_clients(server);
+            continue;
+        }
+        if (events[i].data.ptr == &server->signal_fd) {
+            server->running = false;
+            continue;
+        }
+        client = events[i].data.ptr;
+        if (events[i].events & EPOLLOUT)
+            status = flush_lookup_client(server, client);
+        else if (events[i].events & EPOLLIN)
+            status = read_lookup_client(server, client);
+        else
+            status = EXIT_ERROR;
+        if (status == EXIT_ERROR)
+            close_lookup_client(server, client);
+    }
+}
+
+/**
+ * @brief Opens the socket, the epoll instance and the signal descriptor
+ *
+ * SIGINT and SIGTERM are blocked and read from a signalfd, so stopping
+ * druidd is one more event of the loop
+ *
+ * @details static int open_lookup_server(usb_lookup_server_t *server, const char *path)
+ * @param server Pointer to the server to set up
+ * @param path Path of the socket
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) on success
+ *         - 84     (EXIT_ERROR) on failure
+ */
+static int open_lookup_server(usb_lookup_server_t *server, const char *path)
+{
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) != SUCCESS)
+        return EXIT_ERROR;
+    server->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->listen_fd = open_lookup_socket(path);
+    if (server->listen_fd < 0)
+        dprintf(STDERR_FILENO, DRUIDD_SOCKET_ERROR_MESSAGE, path);
+    if (server->signal_fd < 0 || server->epoll_fd < 0 || server->listen_fd < 0 ||
+        watch_lookup_fd(server, server->signal_fd, EPOLLIN, &server->signal_fd) == EXIT_ERROR ||
+        watch_lookup_fd(server, server->listen_fd, EPOLLIN, &server->listen_fd) == EXIT_ERROR)
+        return EXIT_ERROR;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Runs druidd until SIGINT or SIGTERM
+ *
+ * the database stays loaded and indexed for the life of the process;
+ * each connection sends requests (one per line, any number per write)
+ * and receives one reply line per lookup, see answer_usb_lookup_requests;
+ * the socket file is removed on exit
+ *
+ * @details int serve_usb_lookups(usb_db_t *usb_db, cli_args_t *cli_args)
+ * @param usb_db Pointer to the loaded database
+ * @param cli_args Pointer to the cli_args_t structure holding the scan backend
+ * @return Exit code:
+ *         - 0      (EXIT_SUCCESS) when stopped by a signal
+ *         - 84     (EXIT_ERROR) if the server cannot be set up or its loop fails
+ */
+int serve_usb_lookups(usb_db_t *usb_db, cli_args_t *cli_args)
+{
+    usb_lookup_server_t server = {usb_db, cli_args, -1, -1, -1, true, NULL};
+    struct epoll_event events[DRUIDD_MAX_EVENTS];
+    const char *path = get_usb_lookup_socket_path();
+    int result = open_lookup_server(&server, path);
+    int count = 0;
+
+    if (result == EXIT_SUCCESS)
+        printf(DRUIDD_STARTED_MESSAGE, usb_db->count, path);
+    fflush(stdout);
+    while (result == EXIT_SUCCESS && server.running) {
+        count = epoll_wait(server.epoll_fd, events, DRUIDD_MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR)
+            result = EXIT_ERROR;
+        if (count > 0)
+            dispatch_lookup_events(&server, events, count);
+    }
+    while (server.clients != NULL)
+        close_lookup_client(&server, server.clients);
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(path);
+    }
+    if (server.epoll_fd >= 0)
+        close(server.epoll_fd);
+    if (server.signal_fd >= 0)
+        close(server.signal_fd);
+    return result;
+}